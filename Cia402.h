@@ -0,0 +1,73 @@
+#ifndef CIA402_H
+#define CIA402_H
+
+#include <stdint.h>
+
+/**
+ * @brief Структуры CiA 402 и разметка процессных данных привода
+ */
+
+enum class CommandStates : uint8_t
+{
+
+    RESET_FAULT = 0,
+    SHUTDOWN,
+    SWITCH_ON,
+    OP,
+    FAULT
+};
+
+union StatusWord
+{
+    uint16_t data_16;
+    struct
+    {
+        uint8_t ready_to_switch_on: 1;
+        uint8_t switched_on: 1;
+        uint8_t operation_enabled: 1;
+        uint8_t fault: 1;
+        uint8_t voltage_enabled: 1;
+        uint8_t quick_stop: 1;
+        uint8_t switch_on_disabled: 1;
+        uint8_t warning: 1;
+        uint8_t manufacturer_specific_1: 1;
+        uint8_t remote: 1;
+        uint8_t target_reached: 1;
+        uint8_t internal_limit_active: 1;
+        uint8_t operation_mode_specific: 2;
+        uint8_t manufacturer_specific_2: 2;
+    };
+} ;
+
+union ControlWord
+{
+    uint16_t data_16;
+    struct
+    {
+        uint8_t switch_on: 1;
+        uint8_t enable_voltage: 1;
+        uint8_t quick_stop: 1;
+        uint8_t enable_operation: 1;
+        uint8_t op_mode_specific : 3;
+        uint8_t fault_reset : 1;
+        uint8_t halt : 1;
+        uint8_t reserved : 2;
+        uint8_t manufacturer_specific : 5;
+    };
+};
+
+struct txPdoData_t
+{
+    ControlWord controlWord;
+    int8_t modesOfOperation;
+    int16_t targetTorque;
+} __attribute__((packed));
+
+struct rxPdoData_t
+{
+    StatusWord statusWord;
+    int8_t modesOfOperationDisplay;
+    int16_t torqueActualValue;
+} __attribute__((packed));
+
+#endif //CIA402_H
@@ -0,0 +1,188 @@
+#ifndef COETYPES_H
+#define COETYPES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "ethercat.h"
+
+#define OTYPE_VAR               0x0007
+#define OTYPE_ARRAY             0x0008
+#define OTYPE_RECORD            0x0009
+
+#define ATYPE_Rpre              0x01
+#define ATYPE_Rsafe             0x02
+#define ATYPE_Rop               0x04
+#define ATYPE_Wpre              0x08
+#define ATYPE_Wsafe             0x10
+#define ATYPE_Wop               0x20
+
+/**
+ * @brief Реестр типов данных CoE на этапе компиляции
+ * @details Связывает каждый ECT_* с типом C++, длиной в битах и названием.
+ * Все функции не выделяют память и не используют общих буферов, поэтому
+ * их можно вызывать из нескольких потоков одновременно
+ */
+namespace CoeTypes
+{
+    /**
+     * @brief Описание типа данных CoE
+     */
+    struct TypeEntry
+    {
+        uint16_t dataType;
+        uint16_t bitLength;     ///< 0 - длина переменная (строки)
+        const char *name;
+    };
+
+    constexpr TypeEntry TYPES[] =
+    {
+        { ECT_BOOLEAN, 1, "BOOLEAN" },
+        { ECT_INTEGER8, 8, "INTEGER8" },
+        { ECT_INTEGER16, 16, "INTEGER16" },
+        { ECT_INTEGER24, 24, "INTEGER24" },
+        { ECT_INTEGER32, 32, "INTEGER32" },
+        { ECT_INTEGER64, 64, "INTEGER64" },
+        { ECT_UNSIGNED8, 8, "UNSIGNED8" },
+        { ECT_UNSIGNED16, 16, "UNSIGNED16" },
+        { ECT_UNSIGNED24, 24, "UNSIGNED24" },
+        { ECT_UNSIGNED32, 32, "UNSIGNED32" },
+        { ECT_UNSIGNED64, 64, "UNSIGNED64" },
+        { ECT_REAL32, 32, "REAL32" },
+        { ECT_REAL64, 64, "REAL64" },
+        { ECT_BIT1, 1, "BIT1" },
+        { ECT_BIT2, 2, "BIT2" },
+        { ECT_BIT3, 3, "BIT3" },
+        { ECT_BIT4, 4, "BIT4" },
+        { ECT_BIT5, 5, "BIT5" },
+        { ECT_BIT6, 6, "BIT6" },
+        { ECT_BIT7, 7, "BIT7" },
+        { ECT_BIT8, 8, "BIT8" },
+        { ECT_VISIBLE_STRING, 0, "VISIBLE_STR" },
+        { ECT_OCTET_STRING, 0, "OCTET_STR" }
+    };
+
+    constexpr const TypeEntry *find(uint16_t dataType)
+    {
+        for (const TypeEntry &it : TYPES)
+        {
+            if (it.dataType == dataType)
+                return &it;
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Тип C++ для типа данных CoE, например DataType<ECT_UNSIGNED16>::type
+     */
+    template<uint16_t Type> struct DataType;
+
+    /**
+     * @brief Тип данных CoE для типа C++, например TypeOf<uint16_t>::dataType
+     */
+    template<typename T> struct TypeOf;
+
+#define COE_TYPE(ECT, CTYPE) \
+    template<> struct DataType<ECT> \
+    { \
+        using type = CTYPE; \
+        static constexpr uint16_t bitLength = find(ECT)->bitLength; \
+        static constexpr const char *name = find(ECT)->name; \
+    }; \
+    template<> struct TypeOf<CTYPE> \
+    { \
+        static constexpr uint16_t dataType = ECT; \
+    };
+
+    COE_TYPE(ECT_BOOLEAN, bool)
+    COE_TYPE(ECT_INTEGER8, int8_t)
+    COE_TYPE(ECT_INTEGER16, int16_t)
+    COE_TYPE(ECT_INTEGER32, int32_t)
+    COE_TYPE(ECT_INTEGER64, int64_t)
+    COE_TYPE(ECT_UNSIGNED8, uint8_t)
+    COE_TYPE(ECT_UNSIGNED16, uint16_t)
+    COE_TYPE(ECT_UNSIGNED32, uint32_t)
+    COE_TYPE(ECT_UNSIGNED64, uint64_t)
+    COE_TYPE(ECT_REAL32, float)
+    COE_TYPE(ECT_REAL64, double)
+
+#undef COE_TYPE
+
+    /**
+     * @brief Перевод значения из порядка байт EtherCAT (little-endian) в порядок хоста и обратно
+     */
+    template<typename T>
+    inline T swapToHost(T value)
+    {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        uint8_t bytes[sizeof(T)];
+        memcpy(bytes, &value, sizeof(T));
+        for (size_t i = 0; i < sizeof(T) / 2; i++)
+        {
+            uint8_t tmp = bytes[i];
+            bytes[i] = bytes[sizeof(T) - 1 - i];
+            bytes[sizeof(T) - 1 - i] = tmp;
+        }
+        memcpy(&value, bytes, sizeof(T));
+#endif
+        return value;
+    }
+
+    template<typename T>
+    inline T toHost(T value)
+    {
+        return swapToHost(value);
+    }
+
+    template<typename T>
+    inline T toEthercat(T value)
+    {
+        return swapToHost(value);
+    }
+
+    /**
+     * @brief Название типа данных в буфер вызывающего, например "UNSIGNED16" или "VISIBLE_STR(64)"
+     * @return число записанных символов, как у snprintf
+     */
+    inline int formatDataType(char *buffer, size_t size, uint16_t dataType, uint16_t bitLength)
+    {
+        const TypeEntry *entry = find(dataType);
+
+        if (entry == nullptr)
+            return snprintf(buffer, size, "dt:0x%4.4X (%d)", dataType, bitLength);
+
+        if (entry->bitLength == 0)
+            return snprintf(buffer, size, "%s(%d)", entry->name, bitLength);
+
+        return snprintf(buffer, size, "%s", entry->name);
+    }
+
+    inline int formatObjectCode(char *buffer, size_t size, uint16_t objectCode)
+    {
+        switch (objectCode)
+        {
+        case OTYPE_VAR:
+            return snprintf(buffer, size, "VAR");
+        case OTYPE_ARRAY:
+            return snprintf(buffer, size, "ARRAY");
+        case OTYPE_RECORD:
+            return snprintf(buffer, size, "RECORD");
+        default:
+            return snprintf(buffer, size, "ot:0x%4.4X", objectCode);
+        }
+    }
+
+    inline int formatAccess(char *buffer, size_t size, uint16_t access)
+    {
+        return snprintf(buffer, size, "%s%s%s%s%s%s",
+                        ((access & ATYPE_Rpre) != 0 ? "R" : "_"),
+                        ((access & ATYPE_Wpre) != 0 ? "W" : "_"),
+                        ((access & ATYPE_Rsafe) != 0 ? "R" : "_"),
+                        ((access & ATYPE_Wsafe) != 0 ? "W" : "_"),
+                        ((access & ATYPE_Rop) != 0 ? "R" : "_"),
+                        ((access & ATYPE_Wop) != 0 ? "W" : "_"));
+    }
+}
+
+#endif //COETYPES_H
@@ -0,0 +1,279 @@
+#include "CommandChannel.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+    CommandChannel::Segment *mapSegment(const char *name, bool create)
+    {
+        int fd = shm_open(name, create ? (O_CREAT | O_RDWR) : O_RDWR, 0666);
+
+        if (fd < 0)
+            return nullptr;
+
+        if (create && ftruncate(fd, sizeof(CommandChannel::Segment)) != 0)
+        {
+            close(fd);
+            return nullptr;
+        }
+
+        struct stat st;
+
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(CommandChannel::Segment))
+        {
+            close(fd);
+            return nullptr;
+        }
+
+        void *memory = mmap(nullptr, sizeof(CommandChannel::Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+
+        return memory == MAP_FAILED ? nullptr : static_cast<CommandChannel::Segment*>(memory);
+    }
+
+    int64_t monotonicNs()
+    {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return now.tv_sec * 1000000000LL + now.tv_nsec;
+    }
+}
+
+int64_t CommandChannel::LatencyStats::percentileNs(double percentile) const
+{
+    if (count == 0)
+        return 0;
+
+    uint64_t target = static_cast<uint64_t>(count * percentile / 100.0);
+    uint64_t accumulated = 0;
+
+    for (int i = 0; i <= BUCKETS; i++)
+    {
+        accumulated += histogram[i];
+
+        if (accumulated > target)
+            return i == BUCKETS ? maxNs : (i + 1) * BUCKET_NS;
+    }
+
+    return maxNs;
+}
+
+CommandChannel::Server::~Server()
+{
+    close();
+}
+
+/**
+ * @brief Создание канала команд
+ * @param name - имя сегмента shm_open
+ * @return true - канал создан
+ */
+bool CommandChannel::Server::open(const char *name)
+{
+    close();
+
+    segment = mapSegment(name, true);
+
+    if (segment == nullptr)
+        return false;
+
+    segment->queue.init();
+    segment->rejected.store(0, std::memory_order_relaxed);
+    segment->version = VERSION;
+
+    std::atomic_thread_fence(std::memory_order_release);
+    segment->magic = MAGIC;
+
+    strncpy(this->name, name, sizeof(this->name) - 1);
+    resetStats();
+
+    return true;
+}
+
+void CommandChannel::Server::close()
+{
+    if (segment == nullptr)
+        return;
+
+    munmap(segment, sizeof(Segment));
+    shm_unlink(name);
+    segment = nullptr;
+}
+
+int CommandChannel::Server::drain(AxisSetpoint *axes, int axisCount)
+{
+    if (segment == nullptr)
+        return 0;
+
+    Command command;
+    int applied = 0;
+
+    while (pendingCount < MAX_DRAIN)
+    {
+        if (!segment->queue.pop(command))
+        {
+            if (!skipStalled())
+                break;
+            continue;
+        }
+
+        pending[pendingCount++] = command.submitNs;
+
+        if (command.axis >= axisCount)
+            continue;
+
+        AxisSetpoint &axis = axes[command.axis];
+
+        axis.valid = true;
+
+        if (command.flags & SET_TORQUE)
+            axis.targetTorque = command.targetTorque;
+        if (command.flags & SET_MODE)
+            axis.mode = command.mode;
+        if (command.flags & ENABLE)
+            axis.enable = true;
+        if (command.flags & DISABLE)
+            axis.enable = false;
+        if (command.flags & FAULT_RESET)
+            axis.faultReset = true;
+
+        applied++;
+    }
+
+    return applied;
+}
+
+/**
+ * @brief Пропуск головной ячейки, которую клиент занял и не опубликовал за STALL_TIMEOUT_NS
+ * @return true - голова сдвинулась, можно повторить pop
+ */
+bool CommandChannel::Server::skipStalled()
+{
+    uint64_t pos;
+
+    if (!segment->queue.claimedHead(pos))
+    {
+        stalledSinceNs = 0;
+        return false;
+    }
+
+    int64_t now = monotonicNs();
+
+    if (stalledSinceNs == 0 || pos != stalledPos)
+    {
+        stalledPos = pos;
+        stalledSinceNs = now;
+        return false;
+    }
+
+    if (now - stalledSinceNs < STALL_TIMEOUT_NS)
+        return false;
+
+    stalledSinceNs = 0;
+
+    if (segment->queue.skipHead(pos))
+        latency.stalled++;
+
+    return true;
+}
+
+void CommandChannel::Server::markSent(int64_t sentNs)
+{
+    for (int i = 0; i < pendingCount; i++)
+    {
+        int64_t delay = sentNs - pending[i];
+
+        if (delay < 0)
+            delay = 0;
+
+        int bucket = static_cast<int>(delay / LatencyStats::BUCKET_NS);
+        latency.histogram[bucket < LatencyStats::BUCKETS ? bucket : LatencyStats::BUCKETS]++;
+
+        if (latency.count == 0 || delay < latency.minNs)
+            latency.minNs = delay;
+        if (delay > latency.maxNs)
+            latency.maxNs = delay;
+
+        latency.sumNs += delay;
+        latency.count++;
+    }
+
+    pendingCount = 0;
+}
+
+const CommandChannel::LatencyStats &CommandChannel::Server::stats()
+{
+    if (segment != nullptr)
+        latency.overflow = segment->rejected.load(std::memory_order_relaxed) - rejectedBase;
+
+    return latency;
+}
+
+void CommandChannel::Server::resetStats()
+{
+    memset(&latency, 0, sizeof(latency));
+
+    // Счетчик в разделяемой памяти накопительный, окно считается от снимка
+    rejectedBase = segment != nullptr ? segment->rejected.load(std::memory_order_relaxed) : 0;
+}
+
+CommandChannel::Client::~Client()
+{
+    close();
+}
+
+/**
+ * @brief Подключение к каналу, созданному мастером
+ * @param name - имя сегмента shm_open
+ * @return true - канал найден
+ */
+bool CommandChannel::Client::open(const char *name)
+{
+    close();
+
+    segment = mapSegment(name, false);
+
+    if (segment == nullptr)
+        return false;
+
+    if (segment->magic != MAGIC || segment->version != VERSION)
+    {
+        close();
+        return false;
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    return true;
+}
+
+void CommandChannel::Client::close()
+{
+    if (segment == nullptr)
+        return;
+
+    munmap(segment, sizeof(Segment));
+    segment = nullptr;
+}
+
+bool CommandChannel::Client::submit(Command command)
+{
+    if (segment == nullptr)
+        return false;
+
+    if (command.submitNs == 0)
+        command.submitNs = monotonicNs();
+
+    if (!segment->queue.push(command))
+    {
+        segment->rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,148 @@
+#ifndef COMMANDCHANNEL_H
+#define COMMANDCHANNEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "MpscQueue.h"
+
+/**
+ * @brief Канал внешних команд для осей
+ * @details Внешние процессы (планировщик движения и т.п.) кладут команды в lock-free очередь
+ * в разделяемой памяти. Цикл мастера забирает ограниченное число команд в начале расчета
+ * и применяет их к уставкам осей. Для каждой команды измеряется задержка от отправки
+ * клиентом до передачи кадра с новой уставкой в сеть
+ */
+namespace CommandChannel
+{
+    constexpr uint32_t MAGIC = 0x444D4343;      ///< "CCMD"
+    constexpr uint16_t VERSION = 2;          ///< 2 - публикация ячейки очереди через CAS
+    constexpr uint32_t QUEUE_CAPACITY = 1024;
+    constexpr int MAX_DRAIN = 64;               ///< Максимум команд, забираемых за один цикл
+    constexpr int64_t STALL_TIMEOUT_NS = 100000000;     ///< Время ожидания публикации головной ячейки, 100 мс
+    constexpr const char *DEFAULT_NAME = "/ethercat-test-cmd";
+
+    enum CommandFlags : uint8_t
+    {
+        SET_TORQUE = 0x01,
+        SET_MODE = 0x02,
+        ENABLE = 0x04,
+        DISABLE = 0x08,
+        FAULT_RESET = 0x10
+    };
+
+    struct Command
+    {
+        uint16_t axis;
+        uint8_t flags;              ///< CommandFlags
+        int8_t mode;                ///< Modes of operation (0x6060)
+        int16_t targetTorque;       ///< Target torque (0x6071)
+        int64_t submitNs;           ///< CLOCK_MONOTONIC момента отправки, заполняется клиентом
+    };
+
+    /**
+     * @brief Текущая уставка оси, собранная из команд
+     */
+    struct AxisSetpoint
+    {
+        bool valid;                 ///< Была хотя бы одна команда
+        bool enable;
+        bool faultReset;            ///< Однократный запрос, сбрасывается потребителем
+        int8_t mode;
+        int16_t targetTorque;
+    };
+
+    /**
+     * @brief Задержка от отправки команды до передачи кадра в сеть
+     */
+    struct LatencyStats
+    {
+        static constexpr int BUCKETS = 200;
+        static constexpr int64_t BUCKET_NS = 10000;     ///< Ширина корзины гистограммы, 10 мкс
+
+        uint64_t count;
+        uint64_t overflow;          ///< Команды, не поместившиеся в очередь с последнего resetStats (по данным клиентов)
+        uint64_t stalled;           ///< Ячейки, пропущенные из-за клиента, не опубликовавшего команду
+        int64_t minNs;
+        int64_t maxNs;
+        int64_t sumNs;
+        uint32_t histogram[BUCKETS + 1];    ///< Последняя корзина - задержки больше BUCKETS * BUCKET_NS
+
+        int64_t percentileNs(double percentile) const;
+    };
+
+    struct Segment
+    {
+        uint32_t magic;
+        uint16_t version;
+        alignas(64) std::atomic<uint64_t> rejected;     ///< Счетчик отказов push у клиентов
+        MpscQueue<Command, QUEUE_CAPACITY> queue;
+    };
+
+    /**
+     * @brief Сторона мастера
+     * @details Если клиент умер между захватом ячейки очереди и ее публикацией, очередь
+     * останавливается на этой ячейке. drain() ждет публикации STALL_TIMEOUT_NS, затем пропускает
+     * ячейку и считает ее в LatencyStats::stalled. Клиент, опубликовавший ячейку позже, получает
+     * отказ submit. Если клиент застрял посреди копирования команды дольше таймаута, его
+     * запоздалая запись может испортить команду следующего круга в той же ячейке
+     */
+    class Server
+    {
+    public:
+        ~Server();
+
+        bool open(const char *name);
+        void close();
+
+        /**
+         * @brief Забор команд в начале цикла
+         * @details Забирает не больше MAX_DRAIN команд, остальные остаются до следующего цикла
+         * @return число примененных команд
+         */
+        int drain(AxisSetpoint *axes, int axisCount);
+
+        /**
+         * @brief Отметка о передаче кадра, вызывается сразу после ec_send_processdata
+         */
+        void markSent(int64_t sentNs);
+
+        const LatencyStats &stats();
+        void resetStats();
+
+    private:
+        bool skipStalled();
+
+        Segment *segment = nullptr;
+        int64_t pending[MAX_DRAIN];
+        int pendingCount = 0;
+        LatencyStats latency = {};
+        uint64_t rejectedBase = 0;  ///< Счетчик отказов клиентов на момент resetStats
+        uint64_t stalledPos = 0;    ///< Головная ячейка, ожидающая публикации
+        int64_t stalledSinceNs = 0; ///< Начало ожидания, 0 - голова не зависла
+        char name[64] = { 0 };
+    };
+
+    /**
+     * @brief Сторона внешнего процесса
+     */
+    class Client
+    {
+    public:
+        ~Client();
+
+        bool open(const char *name);
+        void close();
+
+        /**
+         * @brief Отправка команды
+         * @details Если submitNs равен 0, заполняется текущим временем
+         * @return false - очередь заполнена или канал не открыт
+         */
+        bool submit(Command command);
+
+    private:
+        Segment *segment = nullptr;
+    };
+}
+
+#endif //COMMANDCHANNEL_H
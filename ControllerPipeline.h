@@ -0,0 +1,125 @@
+#ifndef CONTROLLERPIPELINE_H
+#define CONTROLLERPIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <tuple>
+#include <utility>
+#include "Cia402.h"
+#include "CommandChannel.h"
+#include "CycleTiming.h"
+
+/**
+ * @brief Конвейер расчета выходов оси внутри цикла
+ * @details Стадии собираются на этапе компиляции: Pipeline<Source, Limiter, Filter, Gate>.
+ * Каждая стадия - обычный класс с методом process(AxisContext&) и полем name, без виртуальных
+ * функций и без выделения памяти, поэтому вся цепочка встраивается в одну функцию на ось.
+ * Стоимость стадий измеряется выборочно через runProfiled
+ */
+namespace ControllerPipeline
+{
+    /**
+     * @brief Состояние оси, передаваемое между стадиями
+     */
+    struct AxisContext
+    {
+        const rxPdoData_t *inputs;
+        txPdoData_t *outputs;
+        CommandChannel::AxisSetpoint *setpoint;
+
+        CommandStates state;    ///< Состояние CiA 402, сохраняется между циклами
+
+        // Рабочие значения текущего цикла
+        int32_t torque;
+        int8_t mode;
+        bool enable;
+        bool faultReset;
+    };
+
+    template<typename... Stages>
+    class Pipeline
+    {
+    public:
+        static constexpr size_t STAGE_COUNT = sizeof...(Stages);
+
+        Pipeline() = default;
+        explicit Pipeline(Stages... stages) : stages(stages...) {}
+
+        void run(AxisContext &context)
+        {
+            std::apply([&context](Stages&... stage) { (stage.process(context), ...); }, stages);
+        }
+
+        /**
+         * @brief Расчет с замером времени каждой стадии
+         * @details Вызывается выборочно (например, раз в N циклов), чтобы замеры не добавляли
+         * стоимость каждому циклу
+         */
+        void runProfiled(AxisContext &context)
+        {
+            runProfiled(context, std::index_sequence_for<Stages...>());
+            samples++;
+        }
+
+        template<size_t I>
+        auto &stage()
+        {
+            return std::get<I>(stages);
+        }
+
+        static constexpr const char *stageName(size_t i)
+        {
+            constexpr const char *names[] = { Stages::name... };
+            return names[i];
+        }
+
+        int64_t stageAverageNs(size_t i) const
+        {
+            return samples ? stageNs[i] / static_cast<int64_t>(samples) : 0;
+        }
+
+        int64_t stageMaxNs(size_t i) const
+        {
+            return stageMax[i];
+        }
+
+        uint64_t profiledSamples() const
+        {
+            return samples;
+        }
+
+        void resetProfile()
+        {
+            stageNs.fill(0);
+            stageMax.fill(0);
+            samples = 0;
+        }
+
+    private:
+        template<size_t... I>
+        void runProfiled(AxisContext &context, std::index_sequence<I...>)
+        {
+            (profileStage<I>(context), ...);
+        }
+
+        template<size_t I>
+        void profileStage(AxisContext &context)
+        {
+            int64_t start = CycleTiming::nowNs();
+            std::get<I>(stages).process(context);
+            int64_t duration = CycleTiming::nowNs() - start;
+
+            stageNs[I] += duration;
+            if (duration > stageMax[I])
+                stageMax[I] = duration;
+        }
+
+        std::tuple<Stages...> stages;
+        std::array<int64_t, STAGE_COUNT> stageNs = {};
+        std::array<int64_t, STAGE_COUNT> stageMax = {};
+        uint64_t samples = 0;
+    };
+}
+
+#endif //CONTROLLERPIPELINE_H
@@ -0,0 +1,197 @@
+#ifndef CONTROLLERSTAGES_H
+#define CONTROLLERSTAGES_H
+
+#include <stdint.h>
+#include <math.h>
+#include "ControllerPipeline.h"
+
+/**
+ * @brief Стадии конвейера расчета оси
+ * @details Порядок стадий в конвейере
+ * 1. - SetpointSource - уставка из канала команд, либо тестовая синусоида
+ * 2. - TorqueLimiter - ограничение момента
+ * 3. - LowPassFilter - фильтр уставки момента
+ * 4. - Cia402Gate - автомат состояний CiA 402, пропускает уставку только в Operation enabled
+ */
+namespace ControllerStages
+{
+    using ControllerPipeline::AxisContext;
+
+    constexpr int8_t DEFAULT_MODE = 10;        ///< Cyclic synchronous torque
+
+    /**
+     * @brief Начальная уставка оси
+     * @details Команды меняют только переданные поля, поэтому команда с одним моментом
+     * оставляет ось включенной в режиме по умолчанию
+     */
+    constexpr CommandChannel::AxisSetpoint DEFAULT_SETPOINT = {false, true, false, DEFAULT_MODE, 0};
+
+    class SetpointSource
+    {
+    public:
+        static constexpr const char *name = "setpoint";
+
+        void process(AxisContext &context)
+        {
+            CommandChannel::AxisSetpoint &setpoint = *context.setpoint;
+
+            phase += 2;
+
+            if (setpoint.valid)
+            {
+                context.torque = setpoint.targetTorque;
+                context.mode = setpoint.mode;
+                context.enable = setpoint.enable;
+            }
+            else
+            {
+                context.torque = static_cast<int32_t>(100 * sin(2 * M_PI * phase / 10000));
+                context.mode = DEFAULT_MODE;
+                context.enable = true;
+            }
+
+            context.faultReset = setpoint.faultReset;
+            setpoint.faultReset = false;
+        }
+
+    private:
+        int phase = 0;
+    };
+
+    class TorqueLimiter
+    {
+    public:
+        static constexpr const char *name = "limiter";
+
+        /**
+         * @param maxTorque - предел момента в тысячных долях номинального (единицы 0x6071)
+         */
+        explicit TorqueLimiter(int32_t maxTorque = 1000) : maxTorque(maxTorque) {}
+
+        void process(AxisContext &context)
+        {
+            if (context.torque > maxTorque)
+                context.torque = maxTorque;
+            else if (context.torque < -maxTorque)
+                context.torque = -maxTorque;
+        }
+
+    private:
+        int32_t maxTorque;
+    };
+
+    /**
+     * @brief Апериодический фильтр первого порядка в фиксированной точке
+     * @details y += (x - y) * alpha, alpha в формате Q15. Вне Operation enabled состояние
+     * сбрасывается, чтобы после включения уставка не начиналась со старого значения
+     */
+    class LowPassFilter
+    {
+    public:
+        static constexpr const char *name = "filter";
+
+        explicit LowPassFilter(int32_t alphaQ15 = 16384) : alpha(alphaQ15) {}
+
+        void process(AxisContext &context)
+        {
+            if (context.state != CommandStates::OP)
+            {
+                state = 0;
+                return;
+            }
+
+            state += ((static_cast<int64_t>(context.torque) << 15) - state) * alpha >> 15;
+            context.torque = static_cast<int32_t>(state >> 15);
+        }
+
+    private:
+        int32_t alpha;
+        int64_t state = 0;      ///< Выход фильтра в Q15
+    };
+
+    class Cia402Gate
+    {
+    public:
+        static constexpr const char *name = "cia402";
+
+        void process(AxisContext &context)
+        {
+            const rxPdoData_t *rxPdoData = context.inputs;
+            txPdoData_t *txPdoData = context.outputs;
+
+            if (context.faultReset)
+                context.state = CommandStates::RESET_FAULT;
+
+            // Ошибка привода вне сброса фиксируется до явной команды fault reset
+            if (rxPdoData->statusWord.fault && context.state != CommandStates::RESET_FAULT)
+                context.state = CommandStates::FAULT;
+
+            switch(context.state)
+            {
+
+            case CommandStates::RESET_FAULT:
+
+                if(rxPdoData->statusWord.fault)
+                {
+                    txPdoData->controlWord.data_16 = 0;
+                    txPdoData->controlWord.fault_reset = 1;
+                }
+                else
+                {
+                    txPdoData->controlWord.data_16 = 0;
+                    context.state = CommandStates::SHUTDOWN;
+                }
+                break;
+
+            case CommandStates::SHUTDOWN:
+
+                txPdoData->controlWord.data_16 = 0;
+                txPdoData->controlWord.switch_on = 0;
+                txPdoData->controlWord.enable_voltage = 1;
+                txPdoData->controlWord.quick_stop = 1;
+                if(rxPdoData->statusWord.ready_to_switch_on)
+                {
+                    context.state = CommandStates::SWITCH_ON;
+                }
+                break;
+
+            case CommandStates::SWITCH_ON:
+
+                txPdoData->controlWord.data_16 = 0;
+                txPdoData->controlWord.switch_on = 1;
+                txPdoData->controlWord.enable_voltage = 1;
+                txPdoData->controlWord.quick_stop = 1;
+                if(rxPdoData->statusWord.switched_on && context.enable)
+                {
+                    context.state = CommandStates::OP;
+                }
+                break;
+
+            case CommandStates::OP:
+            {
+                txPdoData->controlWord.data_16 = 0;
+                txPdoData->controlWord.switch_on = 1;
+                txPdoData->controlWord.enable_voltage = 1;
+                txPdoData->controlWord.quick_stop = 1;
+                txPdoData->controlWord.enable_operation = 1;
+
+                txPdoData->modesOfOperation = context.mode;
+                txPdoData->targetTorque = static_cast<int16_t>(context.torque);
+
+                if (!context.enable)
+                    context.state = CommandStates::SWITCH_ON;
+
+                break;
+            }
+            case CommandStates::FAULT:
+                // Выходы отключены, причину сообщает сервис диагностики
+                txPdoData->controlWord.data_16 = 0;
+                txPdoData->targetTorque = 0;
+
+                break;
+            }
+        }
+    };
+}
+
+#endif //CONTROLLERSTAGES_H
@@ -0,0 +1,257 @@
+#include "CycleTiming.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+    int64_t percentileOf(std::vector<int64_t> &values, uint32_t count, double percentile)
+    {
+        if (count == 0)
+            return 0;
+
+        uint32_t index = static_cast<uint32_t>(percentile / 100.0 * (count - 1) + 0.5);
+        std::nth_element(values.begin(), values.begin() + index, values.begin() + count);
+
+        return values[index];
+    }
+
+    int64_t maxOf(const std::vector<int64_t> &values, uint32_t count)
+    {
+        return count ? *std::max_element(values.begin(), values.begin() + count) : 0;
+    }
+}
+
+CycleTiming::CycleClock::CycleClock(const CycleConfig &config, const MissPolicy &policy)
+    : config(config), policy(policy), missCounters(), deadline(), dcCorrectionNs(0), dcIntegral(0),
+      dcLocked(false), compute(true), missed(false), catchingUp(false), faultPending(false)
+{
+    if (this->policy.toleranceNs == 0)
+        this->policy.toleranceNs = config.periodNs / 4;
+}
+
+void CycleTiming::CycleClock::start()
+{
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+}
+
+/**
+ * @brief Начало цикла: проверка опоздания пробуждения
+ * @details Догоняющий цикл начинается после дедлайна намеренно, его опоздание уже учтено
+ * как overrun прошлого цикла и не считается ни опозданием, ни продолжением серии
+ */
+void CycleTiming::CycleClock::begin()
+{
+    int64_t lateness = nowNs() - toNs(deadline);
+
+    missCounters.cycles++;
+    compute = true;
+
+    if (catchingUp)
+    {
+        catchingUp = false;
+        missed = false;
+        return;
+    }
+
+    missCounters.maxLatenessNs = std::max(missCounters.maxLatenessNs, lateness);
+    missed = lateness > policy.toleranceNs;
+
+    if (missed)
+    {
+        missCounters.lateStarts++;
+
+        if (policy.skipCompute)
+        {
+            compute = false;
+            missCounters.skippedComputes++;
+        }
+    }
+}
+
+/**
+ * @brief Конец цикла: учет пропуска, выбор следующего дедлайна и сон
+ */
+void CycleTiming::CycleClock::end()
+{
+    int64_t now = nowNs();
+
+    advance(deadline, config.periodNs + dcCorrectionNs);
+    dcCorrectionNs = 0;
+
+    if (now > toNs(deadline))
+    {
+        missed = true;
+        missCounters.overruns++;
+
+        if (policy.catchUp)
+        {
+            // Следующий кадр уходит сразу, но не больше одного догоняющего кадра
+            missCounters.catchUps++;
+            catchingUp = true;
+
+            while (now - toNs(deadline) > config.periodNs)
+            {
+                advance(deadline, config.periodNs);
+                missCounters.droppedPeriods++;
+            }
+        }
+        else
+        {
+            while (toNs(deadline) <= now)
+            {
+                advance(deadline, config.periodNs);
+                missCounters.droppedPeriods++;
+            }
+        }
+    }
+
+    if (missed)
+    {
+        missCounters.consecutive++;
+        missCounters.maxConsecutive = std::max(missCounters.maxConsecutive, missCounters.consecutive);
+
+        if (policy.faultAfter != 0 && missCounters.consecutive == policy.faultAfter)
+        {
+            faultPending = true;
+            missCounters.faults++;
+        }
+    }
+    else
+    {
+        missCounters.consecutive = 0;
+    }
+
+    sleepUntil(deadline);
+}
+
+/**
+ * @brief Подстройка начала цикла под сетку SYNC0
+ * @details ec_dcsync0 ставит SYNC0 в моменты DC, кратные периоду, плюс сдвиг. ec_DCtime -
+ * время опорных часов при проходе кадра цикла. ПИ-регулятор, как ec_sync в red_test SOEM,
+ * поправляет следующий дедлайн так, чтобы кадр проходил опорные часы в кратный периоду
+ * момент, тогда SYNC0 срабатывает через dcShiftNs после кадра. Первый вызов переносит
+ * дедлайн на сетку одним шагом, дальше регулятор только компенсирует уход часов.
+ * Вызывается после приема
+ */
+void CycleTiming::CycleClock::alignToDc(int64_t dcTimeNs)
+{
+    int64_t phase = dcTimeNs % config.periodNs;
+
+    if (phase > config.periodNs / 2)
+        phase -= config.periodNs;
+
+    // Первый шаг только удлиняет цикл, иначе дедлайн мог бы оказаться в прошлом и засчитаться пропуском
+    if (!dcLocked)
+    {
+        dcCorrectionNs = phase > 0 ? config.periodNs - phase : -phase;
+        dcLocked = true;
+        return;
+    }
+
+    if (phase > 0)
+        dcIntegral++;
+    else if (phase < 0)
+        dcIntegral--;
+
+    // Поправка ограничена, чтобы сбой ec_DCtime не сорвал сетку периодов
+    int64_t limit = config.periodNs / 4;
+
+    dcCorrectionNs = std::max(-limit, std::min(limit, -(phase / 100) - (dcIntegral / 20)));
+}
+
+void CycleTiming::printCounters(const MissCounters &counters)
+{
+    std::cout << "Deadline misses: " << counters.lateStarts << " late starts, " << counters.overruns << " overruns in "
+              << counters.cycles << " cycles, max lateness " << counters.maxLatenessNs / 1000.0 << " us, max streak "
+              << counters.maxConsecutive << "; skipped computes " << counters.skippedComputes << ", catch-ups "
+              << counters.catchUps << ", dropped periods " << counters.droppedPeriods << ", faults "
+              << counters.faults << std::endl;
+}
+
+/**
+ * @brief Сводка замеров периода
+ * @details Период проходит, если не было пропущенных дедлайнов и ошибок wkc, а обмен,
+ * расчет и опоздание пробуждения на процентиле укладываются в период
+ */
+CycleTiming::PeriodResult CycleTiming::evaluate(int64_t periodNs, Samples &samples, uint32_t cycles,
+                                                uint32_t missedDeadlines, uint32_t wkcErrors, double percentile)
+{
+    PeriodResult result;
+
+    result.periodNs = periodNs;
+    result.cycles = cycles;
+    result.missedDeadlines = missedDeadlines;
+    result.wkcErrors = wkcErrors;
+    result.maxRoundTripNs = maxOf(samples.roundTrip, cycles);
+    result.maxComputeNs = maxOf(samples.compute, cycles);
+    result.roundTripNs = percentileOf(samples.roundTrip, cycles, percentile);
+    result.computeNs = percentileOf(samples.compute, cycles, percentile);
+    result.wakeLatencyNs = percentileOf(samples.wakeLatency, cycles, percentile);
+
+    result.passed = missedDeadlines == 0 && wkcErrors == 0 &&
+                    result.wakeLatencyNs + result.roundTripNs + result.computeNs < periodNs;
+
+    return result;
+}
+
+/**
+ * @brief Настройки цикла для выбранного периода
+ * @details Таймаут приема - двойное время обмена на процентиле, но не меньше максимума
+ * и не больше того, что остается от периода после расчета. SYNC0 сдвигается на время
+ * пробуждения и обмена, чтобы кадр успевал пройти все slave до применения выходов
+ */
+CycleTiming::CycleConfig CycleTiming::recommend(const PeriodResult &result)
+{
+    CycleConfig config;
+
+    int64_t timeoutNs = std::max(result.roundTripNs * 2, result.maxRoundTripNs);
+    int64_t budgetNs = result.periodNs - result.computeNs - result.wakeLatencyNs;
+
+    timeoutNs = std::min(timeoutNs, budgetNs);
+
+    config.periodNs = result.periodNs;
+    config.receiveTimeoutUs = static_cast<int>((timeoutNs + 999) / 1000);
+    config.dcShiftNs = result.wakeLatencyNs + result.roundTripNs;
+
+    return config;
+}
+
+/**
+ * @brief Включение SYNC0 на всех slave с DC по периоду и сдвигу цикла
+ * @details Вызывается в SafeOP до перехода в OP: slave с DC проверяют SYNC0 при переходе.
+ * Цикл после этого должен вызывать CycleClock::alignToDc
+ */
+void CycleTiming::applyDcShift(const CycleConfig &config)
+{
+    for (int i = 1; i <= ec_slavecount; i++)
+    {
+        if (ec_slave[i].hasdc)
+            ec_dcsync0(i, TRUE, static_cast<uint32>(config.periodNs), static_cast<int32>(config.dcShiftNs));
+    }
+}
+
+void CycleTiming::printPeriod(const PeriodResult &result)
+{
+    std::cout << "\tperiod " << result.periodNs / 1000.0 << " us: " << (result.passed ? "pass" : "FAIL")
+              << ", rtt " << result.roundTripNs / 1000.0 << "/" << result.maxRoundTripNs / 1000.0
+              << " us, compute " << result.computeNs / 1000.0 << "/" << result.maxComputeNs / 1000.0
+              << " us, wake latency " << result.wakeLatencyNs / 1000.0 << " us, missed " << result.missedDeadlines
+              << ", wkc errors " << result.wkcErrors << std::endl;
+}
+
+void CycleTiming::printResult(const SweepResult &result)
+{
+    std::cout << "Propagation delay to last slave: " << result.slaveDelayNs << " ns" << std::endl;
+
+    if (!result.found)
+    {
+        std::cout << "No period passed, keeping current cycle settings" << std::endl;
+        return;
+    }
+
+    std::cout << "Shortest period: " << result.config.periodNs / 1000.0 << " us"
+              << " (--period-us " << result.config.periodNs / 1000.0
+              << " --rx-timeout-us " << result.config.receiveTimeoutUs
+              << " --dc-shift-us " << result.config.dcShiftNs / 1000.0 << ")" << std::endl;
+}
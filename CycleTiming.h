@@ -0,0 +1,306 @@
+#ifndef CYCLETIMING_H
+#define CYCLETIMING_H
+
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+#include "ethercat.h"
+
+/**
+ * @brief Период цикла, таймаут приема и сдвиг DC
+ * @details Цикл спит до абсолютного дедлайна (clock_nanosleep TIMER_ABSTIME), поэтому
+ * время работы цикла не добавляется к периоду. Режим подбора прогоняет цикл на периодах
+ * от грубых к точным, измеряет время обмена кадром, время расчета и опоздания и выбирает
+ * самый короткий период без пропущенных дедлайнов и ошибок wkc. С включенным SYNC0 сетка
+ * дедлайнов подстраивается под часы DC, иначе сдвиг SYNC0 не имел бы фазы относительно кадра
+ */
+namespace CycleTiming
+{
+    struct CycleConfig
+    {
+        int64_t periodNs;
+        int receiveTimeoutUs;       ///< Таймаут ec_receive_processdata
+        int64_t dcShiftNs;          ///< Сдвиг SYNC0 относительно прохода кадра через опорные часы DC
+    };
+
+    constexpr CycleConfig DEFAULT_CONFIG = {1000000, EC_TIMEOUTRET, 0};
+
+    inline int64_t toNs(const timespec &time)
+    {
+        return time.tv_sec * 1000000000LL + time.tv_nsec;
+    }
+
+    inline int64_t nowNs()
+    {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return toNs(now);
+    }
+
+    inline void advance(timespec &time, int64_t ns)
+    {
+        time.tv_nsec += ns;
+
+        while (time.tv_nsec >= 1000000000L)
+        {
+            time.tv_nsec -= 1000000000L;
+            time.tv_sec++;
+        }
+    }
+
+    /**
+     * @brief Сон до абсолютного момента, повтор при прерывании сигналом
+     */
+    inline void sleepUntil(const timespec &deadline)
+    {
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) != 0)
+        {
+        }
+    }
+
+    /**
+     * @brief Реакция на пропуск дедлайна
+     * @details Пропуск - начало цикла позже дедлайна больше чем на toleranceNs, либо
+     * окончание цикла после следующего дедлайна
+     */
+    struct MissPolicy
+    {
+        bool skipCompute;           ///< Опоздавший цикл не считает, кадр уходит с прошлыми выходами
+        bool catchUp;               ///< Следующий сон укорачивается, сетка периодов сохраняется
+        uint32_t faultAfter;        ///< Перевод осей в FAULT после N пропусков подряд, 0 - выключено
+        int64_t toleranceNs;        ///< Допустимое опоздание начала цикла, 0 - четверть периода
+    };
+
+    constexpr MissPolicy DEFAULT_MISS_POLICY = {false, false, 0, 0};
+
+    struct MissCounters
+    {
+        uint64_t cycles;
+        uint64_t lateStarts;        ///< Цикл начался позже допуска
+        uint64_t overruns;          ///< Цикл закончился после следующего дедлайна
+        uint64_t skippedComputes;
+        uint64_t catchUps;          ///< Укороченный сон
+        uint64_t droppedPeriods;    ///< Периоды, пропущенные при выравнивании на сетку
+        uint64_t faults;
+        uint32_t consecutive;
+        uint32_t maxConsecutive;
+        int64_t maxLatenessNs;
+    };
+
+    /**
+     * @brief Расписание цикла по абсолютным дедлайнам с учетом пропусков
+     * @details Порядок в цикле: begin() - обмен - if (shouldCompute()) расчет - end().
+     * Без catchUp после пропуска дедлайн переносится на ближайшую будущую точку сетки,
+     * поэтому кадры не уходят пачкой и интервал между ними остается кратным периоду
+     */
+    class CycleClock
+    {
+    public:
+        CycleClock(const CycleConfig &config, const MissPolicy &policy);
+
+        void start();
+        void begin();
+        void end();
+        void alignToDc(int64_t dcTimeNs);
+
+        bool shouldCompute() const
+        {
+            return compute;
+        }
+
+        /**
+         * @brief Запрос перевода осей в FAULT, сбрасывается при чтении
+         */
+        bool takeFault()
+        {
+            bool result = faultPending;
+            faultPending = false;
+            return result;
+        }
+
+        const MissCounters &counters() const
+        {
+            return missCounters;
+        }
+
+    private:
+        CycleConfig config;
+        MissPolicy policy;
+        MissCounters missCounters;
+        timespec deadline;
+        int64_t dcCorrectionNs;     ///< Поправка следующего дедлайна от alignToDc
+        int64_t dcIntegral;
+        bool dcLocked;              ///< Первый дедлайн уже перенесен на сетку SYNC0
+        bool compute;
+        bool missed;
+        bool catchingUp;            ///< Следующий цикл догоняющий, его дедлайн уже в прошлом
+        bool faultPending;
+    };
+
+    void printCounters(const MissCounters &counters);
+
+    /**
+     * @brief Результат прогона одного периода
+     * @details Времена - на выбранном процентиле
+     */
+    struct PeriodResult
+    {
+        int64_t periodNs;
+        uint32_t cycles;
+        uint32_t missedDeadlines;   ///< Обмен и расчет не уложились до следующего дедлайна
+        uint32_t wkcErrors;
+        int64_t roundTripNs;        ///< От отправки кадров до возврата приема
+        int64_t computeNs;
+        int64_t wakeLatencyNs;      ///< Опоздание пробуждения относительно дедлайна
+        int64_t maxRoundTripNs;
+        int64_t maxComputeNs;
+        bool passed;
+    };
+
+    struct SweepOptions
+    {
+        int64_t startPeriodNs;      ///< Первый (самый длинный) период
+        int64_t minPeriodNs;
+        uint32_t cyclesPerPeriod;
+        double percentile;
+        int refineSteps;            ///< Шаги деления пополам между последним прошедшим и первым непрошедшим периодом
+    };
+
+    constexpr SweepOptions DEFAULT_SWEEP = {4000000, 62500, 2000, 99.9, 4};
+    constexpr uint32_t WARMUP_CYCLES = 100;
+
+    struct SweepResult
+    {
+        bool found;
+        PeriodResult best;
+        CycleConfig config;
+        int64_t slaveDelayNs;       ///< Задержка распространения до последнего slave (pdelay)
+        std::vector<PeriodResult> periods;
+    };
+
+    /**
+     * @brief Буферы замеров одного периода
+     * @details Выделяются один раз на весь подбор
+     */
+    struct Samples
+    {
+        std::vector<int64_t> roundTrip;
+        std::vector<int64_t> compute;
+        std::vector<int64_t> wakeLatency;
+    };
+
+    PeriodResult evaluate(int64_t periodNs, Samples &samples, uint32_t cycles,
+                          uint32_t missedDeadlines, uint32_t wkcErrors, double percentile);
+    CycleConfig recommend(const PeriodResult &result);
+    void applyDcShift(const CycleConfig &config);
+    void printPeriod(const PeriodResult &result);
+    void printResult(const SweepResult &result);
+
+    /**
+     * @brief Прогон цикла на одном периоде
+     * @param exchange - отправка и прием процессных данных, принимает таймаут приема в мкс и возвращает wkc
+     * @param compute - расчет приложения, вызывается после приема кадра
+     */
+    template<typename Exchange, typename Compute>
+    PeriodResult runPeriod(int64_t periodNs, int expectedWkc, const SweepOptions &options, Samples &samples,
+                           Exchange &exchange, Compute &compute)
+    {
+        uint32_t missedDeadlines = 0;
+        uint32_t wkcErrors = 0;
+        int receiveTimeoutUs = static_cast<int>(periodNs / 1000);
+
+        timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+        for (uint32_t i = 0; i < WARMUP_CYCLES + options.cyclesPerPeriod; i++)
+        {
+            int64_t start = nowNs();
+
+            int wkc = exchange(receiveTimeoutUs);
+
+            int64_t received = nowNs();
+
+            compute();
+
+            int64_t computed = nowNs();
+
+            advance(deadline, periodNs);
+
+            if (i >= WARMUP_CYCLES)
+            {
+                uint32_t n = i - WARMUP_CYCLES;
+
+                samples.roundTrip[n] = received - start;
+                samples.compute[n] = computed - received;
+                samples.wakeLatency[n] = start - (toNs(deadline) - periodNs);
+
+                wkcErrors += wkc < expectedWkc;
+                missedDeadlines += computed > toNs(deadline);
+            }
+
+            sleepUntil(deadline);
+        }
+
+        return evaluate(periodNs, samples, options.cyclesPerPeriod, missedDeadlines, wkcErrors, options.percentile);
+    }
+
+    /**
+     * @brief Подбор периода
+     * @details Период уменьшается вдвое, пока прогон проходит, затем граница уточняется
+     * делением пополам. Slave должны быть в OP
+     */
+    template<typename Exchange, typename Compute>
+    SweepResult sweep(int expectedWkc, const SweepOptions &options, Exchange exchange, Compute compute)
+    {
+        SweepResult result = {};
+        Samples samples;
+
+        samples.roundTrip.resize(options.cyclesPerPeriod);
+        samples.compute.resize(options.cyclesPerPeriod);
+        samples.wakeLatency.resize(options.cyclesPerPeriod);
+
+        result.slaveDelayNs = ec_slave[ec_slavecount].pdelay;
+
+        int64_t failedNs = 0;
+
+        for (int64_t period = options.startPeriodNs; period >= options.minPeriodNs; period /= 2)
+        {
+            PeriodResult run = runPeriod(period, expectedWkc, options, samples, exchange, compute);
+            result.periods.push_back(run);
+            printPeriod(run);
+
+            if (!run.passed)
+            {
+                failedNs = period;
+                break;
+            }
+
+            result.found = true;
+            result.best = run;
+        }
+
+        for (int i = 0; result.found && failedNs != 0 && i < options.refineSteps; i++)
+        {
+            int64_t period = (result.best.periodNs + failedNs) / 2;
+
+            if (result.best.periodNs - period < 1000)
+                break;
+
+            PeriodResult run = runPeriod(period, expectedWkc, options, samples, exchange, compute);
+            result.periods.push_back(run);
+            printPeriod(run);
+
+            if (run.passed)
+                result.best = run;
+            else
+                failedNs = period;
+        }
+
+        if (result.found)
+            result.config = recommend(result.best);
+
+        return result;
+    }
+}
+
+#endif //CYCLETIMING_H
@@ -0,0 +1,255 @@
+#include "Diagnostics.h"
+
+#include <iostream>
+#include <unistd.h>
+#include "CycleTiming.h"
+#include "EthercatCOE.h"
+
+namespace
+{
+    constexpr uint16_t AL_ERROR_FLAG = 0x10;
+    constexpr uint8_t SM_MAILBOX_FULL = 0x08;      ///< Бит статуса SM в режиме mailbox
+
+    const char *stateName(uint16_t state)
+    {
+        switch (state & 0x0F)
+        {
+        case EC_STATE_INIT:
+            return "INIT";
+        case EC_STATE_PRE_OP:
+            return "PRE_OP";
+        case EC_STATE_BOOT:
+            return "BOOT";
+        case EC_STATE_SAFE_OP:
+            return "SAFE_OP";
+        case EC_STATE_OPERATIONAL:
+            return "OP";
+        default:
+            return "UNKNOWN";
+        }
+    }
+}
+
+Diagnostics::Service::~Service()
+{
+    stop();
+}
+
+/**
+ * @brief Запуск фонового потока
+ * @details Вызывается после ec_config_init, число slave должно быть известно
+ * @param pollPeriodUs - период опроса
+ */
+bool Diagnostics::Service::start(int pollPeriodUs)
+{
+    if (running.load())
+        return false;
+
+    queue.init();
+    alStatus.assign(ec_slavecount + 1, 0);
+    alStatusCode.assign(ec_slavecount + 1, 0);
+
+    for (int i = 1; i <= ec_slavecount; i++)
+        alStatus[i] = ec_slave[i].state;
+
+    commonState = 0;
+
+    running.store(true);
+    worker = std::thread(&Service::run, this, pollPeriodUs);
+
+    return true;
+}
+
+void Diagnostics::Service::stop()
+{
+    running.store(false);
+
+    if (worker.joinable())
+        worker.join();
+}
+
+void Diagnostics::Service::run(int pollPeriodUs)
+{
+    while (running.load(std::memory_order_relaxed))
+    {
+        pollMailboxes();
+        pollErrorList();
+        pollAlStatus();
+
+        usleep(pollPeriodUs);
+    }
+}
+
+void Diagnostics::Service::publish(Event &event)
+{
+    event.cycle = currentCycle.load(std::memory_order_relaxed);
+    event.timestampNs = CycleTiming::nowNs();
+
+    if (!queue.push(event))
+        droppedEvents.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Чтение заполненных mailbox slave
+ * @details BRD возвращает OR статуса SM1 всех slave: без бита "mailbox full" читать нечего.
+ * Иначе статус читается у каждого slave с mailbox, заполненный mailbox забирается
+ * ec_mbxreceive без ожидания. Emergency попадает в список ошибок, остальные кадры
+ * (например, ответ на SDO, который уже не ждут) отбрасываются
+ */
+void Diagnostics::Service::pollMailboxes()
+{
+    uint8_t broadcast = 0;
+    int wkc = ec_BRD(0, ECT_REG_SM1STAT, sizeof(broadcast), &broadcast, EC_TIMEOUTRET);
+
+    if (wkc > 0 && !(broadcast & SM_MAILBOX_FULL))
+        return;
+
+    for (int i = 1; i <= ec_slavecount; i++)
+    {
+        if (ec_slave[i].mbx_rl == 0)
+            continue;
+
+        uint8_t status = 0;
+
+        if (ec_FPRD(ec_slave[i].configadr, ECT_REG_SM1STAT, sizeof(status), &status, EC_TIMEOUTRET) <= 0 ||
+            !(status & SM_MAILBOX_FULL))
+            continue;
+
+        std::unique_lock<std::mutex> lock(EthercatCOE::mailboxMutex(static_cast<uint16_t>(i)), std::try_to_lock);
+
+        if (!lock.owns_lock())
+            continue;
+
+        ec_mbxbuft mailbox;
+        ec_clearmbx(&mailbox);
+        ec_mbxreceive(static_cast<uint16_t>(i), &mailbox, 0);
+    }
+}
+
+/**
+ * @brief Вычитывание списка ошибок SOEM
+ * @details Emergency кладет туда ec_mbxreceive при чтении mailbox slave в pollMailboxes
+ * или при обмене SDO/FoE, данные производителя лежат в b1, w1, w2
+ */
+void Diagnostics::Service::pollErrorList()
+{
+    ec_errort error;
+
+    while (ec_iserror() && ec_poperror(&error))
+    {
+        Event event = {};
+        event.source = Source::ERROR_LIST;
+        event.slave = error.Slave;
+        event.errorType = static_cast<uint8_t>(error.Etype);
+        event.index = error.Index;
+        event.subindex = error.SubIdx;
+
+        if (error.Etype == EC_ERR_TYPE_EMERGENCY)
+        {
+            // SOEM уже перевел w1, w2 в порядок байт хоста
+            uint16_t w1 = error.w1;
+            uint16_t w2 = error.w2;
+
+            event.source = Source::EMERGENCY;
+            event.errorCode = error.ErrorCode;
+            event.errorRegister = error.ErrorReg;
+            event.data[0] = error.b1;
+            event.data[1] = static_cast<uint8_t>(w1);
+            event.data[2] = static_cast<uint8_t>(w1 >> 8);
+            event.data[3] = static_cast<uint8_t>(w2);
+            event.data[4] = static_cast<uint8_t>(w2 >> 8);
+        }
+        else
+        {
+            event.abortCode = error.AbortCode;
+        }
+
+        publish(event);
+    }
+}
+
+/**
+ * @brief Чтение AL status и AL status code каждого slave
+ * @details Событие создается при смене состояния или кода ошибки. BRD возвращает OR
+ * AL status всех slave: если ответили все, флага ошибки нет и OR равен общему состоянию
+ * прошлого опроса, состояние не изменилось и slave по отдельности не читаются
+ */
+void Diagnostics::Service::pollAlStatus()
+{
+    uint16_t broadcast = 0;
+    int wkc = ec_BRD(0, ECT_REG_ALSTAT, sizeof(broadcast), &broadcast, EC_TIMEOUTRET);
+
+    if (commonState != 0 && wkc == ec_slavecount && etohs(broadcast) == commonState)
+        return;
+
+    bool uniform = true;
+
+    for (int i = 1; i <= ec_slavecount; i++)
+    {
+        uint16_t registers[3] = {};
+
+        // 0x0130 AL status, 0x0132 резерв, 0x0134 AL status code
+        if (ec_FPRD(ec_slave[i].configadr, ECT_REG_ALSTAT, sizeof(registers), registers, EC_TIMEOUTRET) <= 0)
+        {
+            uniform = false;
+            continue;
+        }
+
+        uint16_t state = etohs(registers[0]);
+        uint16_t code = (state & AL_ERROR_FLAG) ? etohs(registers[2]) : 0;
+
+        if (state == alStatus[i] && code == alStatusCode[i])
+            continue;
+
+        alStatus[i] = state;
+        alStatusCode[i] = code;
+
+        Event event = {};
+        event.source = Source::AL_STATUS;
+        event.slave = static_cast<uint16_t>(i);
+        event.alState = state;
+        event.errorCode = code;
+
+        publish(event);
+    }
+
+    // По OR можно судить об изменениях, только если состояние - один бит (INIT, PRE_OP, SAFE_OP, OP)
+    uint16_t state = ec_slavecount > 0 ? alStatus[1] : 0;
+
+    for (int i = 2; uniform && i <= ec_slavecount; i++)
+        uniform = alStatus[i] == state;
+
+    bool singleBit = state != 0 && (state & (state - 1)) == 0;
+
+    commonState = uniform && singleBit ? state : 0;
+}
+
+void Diagnostics::print(const Event &event)
+{
+    std::cout << "Diag cycle " << event.cycle << " slave " << event.slave << ": ";
+
+    switch (event.source)
+    {
+    case Source::EMERGENCY:
+        std::cout << "EMCY 0x" << std::hex << event.errorCode << " reg 0x" << static_cast<int>(event.errorRegister)
+                  << " data";
+        for (uint8_t byte : event.data)
+            std::cout << " " << static_cast<int>(byte);
+        std::cout << std::dec;
+        break;
+
+    case Source::ERROR_LIST:
+        std::cout << "error type " << static_cast<int>(event.errorType) << " at 0x" << std::hex << event.index
+                  << ":" << static_cast<int>(event.subindex) << " abort 0x" << event.abortCode << std::dec;
+        break;
+
+    case Source::AL_STATUS:
+        std::cout << "AL " << stateName(event.alState);
+        if (event.alState & AL_ERROR_FLAG)
+            std::cout << " + ERROR, code 0x" << std::hex << event.errorCode << std::dec
+                      << " (" << ec_ALstatuscode2string(event.errorCode) << ")";
+        break;
+    }
+
+    std::cout << std::endl;
+}
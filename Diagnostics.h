@@ -0,0 +1,97 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "ethercat.h"
+#include "MpscQueue.h"
+
+/**
+ * @brief Сбор диагностики slave вне цикла
+ * @details Фоновый поток периодически
+ * 1. - забирает кадры из заполненных mailbox slave, ec_mbxreceive кладет Emergency в список ошибок
+ * 2. - вычитывает список ошибок SOEM (ec_poperror), в том числе CoE Emergency
+ * 3. - читает AL status и AL status code каждого slave и сообщает об изменениях
+ * Mailbox читается под EthercatCOE::mailboxMutex: если slave занят обменом SDO/FoE другого
+ * потока, опрос его пропускает, Emergency заберет этот обмен. Заполненность mailbox
+ * сначала проверяется одним BRD статуса SM1 для всего сегмента.
+ * Каждое событие помечается номером цикла и временем и передается через lock-free
+ * очередь. Цикл только сообщает сервису номер цикла одной атомарной записью.
+ * На больших сегментах AL status сначала читается одним широковещательным BRD
+ */
+namespace Diagnostics
+{
+    constexpr uint32_t QUEUE_SIZE = 256;
+
+    enum class Source : uint8_t
+    {
+        EMERGENCY = 0,      ///< CoE Emergency из списка ошибок SOEM
+        ERROR_LIST,         ///< Остальные записи списка ошибок SOEM
+        AL_STATUS           ///< Изменение AL status slave
+    };
+
+    struct Event
+    {
+        Source source;
+        uint16_t slave;
+        uint64_t cycle;
+        int64_t timestampNs;        ///< CLOCK_MONOTONIC
+
+        uint16_t errorCode;         ///< Код Emergency, либо AL status code
+        uint8_t errorRegister;      ///< 0x1001 из Emergency
+        uint8_t data[5];            ///< Данные производителя из Emergency
+
+        uint16_t alState;           ///< AL status (AL_STATUS)
+        uint8_t errorType;          ///< ec_err_type (ERROR_LIST)
+        uint16_t index;
+        uint8_t subindex;
+        int32_t abortCode;
+    };
+
+    class Service
+    {
+    public:
+        ~Service();
+
+        bool start(int pollPeriodUs);
+        void stop();
+
+        void setCycle(uint64_t cycle)
+        {
+            currentCycle.store(cycle, std::memory_order_relaxed);
+        }
+
+        bool poll(Event &event)
+        {
+            return queue.pop(event);
+        }
+
+        uint64_t dropped() const
+        {
+            return droppedEvents.load(std::memory_order_relaxed);
+        }
+
+    private:
+        void run(int pollPeriodUs);
+        void publish(Event &event);
+        void pollMailboxes();
+        void pollErrorList();
+        void pollAlStatus();
+
+        MpscQueue<Event, QUEUE_SIZE> queue;
+        std::thread worker;
+        std::atomic<bool> running{false};
+        std::atomic<uint64_t> currentCycle{0};
+        std::atomic<uint64_t> droppedEvents{0};
+
+        std::vector<uint16_t> alStatus;
+        std::vector<uint16_t> alStatusCode;
+        uint16_t commonState = 0;           ///< Общее состояние всех slave на последнем полном опросе, 0 - разные
+    };
+
+    void print(const Event &event);
+}
+
+#endif //DIAGNOSTICS_H
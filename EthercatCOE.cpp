@@ -4,6 +4,174 @@
 
 #include "EthercatCOE.h"
 
+#include <iostream>
+
+namespace
+{
+    std::mutex mailboxMutexes[EC_MAXSLAVE];
+
+    /**
+     * @brief Образ объекта назначения SM при чтении Complete Access
+     * @details Сабиндекс 0 передается как UINT8 с выравниванием до 16 бит
+     */
+    struct CompleteAssignment
+    {
+        uint8_t count;
+        uint8_t padding;
+        uint16_t pdoMappingIndex[255];
+    } __attribute__((packed));
+
+    struct CompleteMapping
+    {
+        uint8_t count;
+        uint8_t padding;
+        uint32_t entries[255];
+    } __attribute__((packed));
+
+    bool completeAccess(uint16_t slave)
+    {
+        return ec_slave[slave].CoEdetails & ECT_COEDET_SDOCA;
+    }
+
+    EthercatCOE::PDOEntry decodeEntry(uint32_t obj32)
+    {
+        EthercatCOE::PDOEntry entry;
+
+        entry.index = static_cast<uint16_t>(obj32 >> 16);
+        entry.subindex = static_cast<uint8_t>((obj32 >> 8) & 0xFF);
+        entry.bitLength = static_cast<uint8_t>(obj32 & 0xFF);
+
+        return entry;
+    }
+
+    uint32_t encodeEntry(const EthercatCOE::PDOEntry &entry)
+    {
+        return (static_cast<uint32_t>(entry.index) << 16) | (static_cast<uint32_t>(entry.subindex) << 8) | entry.bitLength;
+    }
+
+    /**
+     * @brief Чтение назначения SM (0x1C12/0x1C13)
+     * @details Slave с поддержкой Complete Access отдает весь объект одним SDO чтением,
+     * иначе читается каждый сабиндекс
+     * @param reads - счетчик SDO чтений
+     * @return число PDO по данным slave, до ограничения MAX_SM_PDOS, -1 - ошибка чтения
+     */
+    int readAssignment(uint16_t slave, EthercatCOE::SMAssignment &sm, uint16_t &reads)
+    {
+        if (completeAccess(slave))
+        {
+            CompleteAssignment raw = {};
+            int size = sizeof(raw);
+
+            Trace::Scope span(Trace::Category::MAILBOX, "SDO read CA", slave, sm.smIndex);
+
+            reads++;
+            int wkc;
+
+            {
+                std::lock_guard<std::mutex> lock(EthercatCOE::mailboxMutex(slave));
+                wkc = ec_SDOread(slave, sm.smIndex, 0, TRUE, &size, &raw, EC_TIMEOUTRXM);
+            }
+
+            span.setBytes(size);
+            span.setResult(wkc);
+
+            if (wkc > 0)
+            {
+                sm.pdoCount = raw.count > EthercatCOE::MAX_SM_PDOS ? EthercatCOE::MAX_SM_PDOS : raw.count;
+
+                for (int i = 0; i < sm.pdoCount; i++)
+                    sm.pdos[i].pdoMappingIndex = etohs(raw.pdoMappingIndex[i]);
+
+                return raw.count;
+            }
+        }
+
+        uint8_t pdoCount = 0;
+
+        reads++;
+
+        if (EthercatCOE::read(slave, sm.smIndex, 0, pdoCount) <= 0)
+            return -1;
+
+        sm.pdoCount = pdoCount > EthercatCOE::MAX_SM_PDOS ? EthercatCOE::MAX_SM_PDOS : pdoCount;
+
+        for (int i = 0; i < sm.pdoCount; i++)
+        {
+            reads++;
+
+            if (EthercatCOE::read(slave, sm.smIndex, i + 1, sm.pdos[i].pdoMappingIndex) <= 0)
+                return -1;
+        }
+
+        return pdoCount;
+    }
+
+    /**
+     * @brief Чтение содержимого PDO разметки, pdo.pdoMappingIndex должен быть задан
+     * @return число объектов по данным slave, до ограничения MAX_PDO_ENTRIES, -1 - ошибка чтения
+     */
+    int readMapping(uint16_t slave, EthercatCOE::PDOMapping &pdo, uint16_t &reads)
+    {
+        if (completeAccess(slave))
+        {
+            CompleteMapping raw = {};
+            int size = sizeof(raw);
+
+            Trace::Scope span(Trace::Category::MAILBOX, "SDO read CA", slave, pdo.pdoMappingIndex);
+
+            reads++;
+            int wkc;
+
+            {
+                std::lock_guard<std::mutex> lock(EthercatCOE::mailboxMutex(slave));
+                wkc = ec_SDOread(slave, pdo.pdoMappingIndex, 0, TRUE, &size, &raw, EC_TIMEOUTRXM);
+            }
+
+            span.setBytes(size);
+            span.setResult(wkc);
+
+            if (wkc > 0)
+            {
+                pdo.entryCount = raw.count > EthercatCOE::MAX_PDO_ENTRIES ? EthercatCOE::MAX_PDO_ENTRIES : raw.count;
+
+                for (int j = 0; j < pdo.entryCount; j++)
+                    pdo.entries[j] = decodeEntry(etohl(raw.entries[j]));
+
+                return raw.count;
+            }
+        }
+
+        uint8_t entryCount = 0;
+
+        reads++;
+
+        if (EthercatCOE::read(slave, pdo.pdoMappingIndex, 0, entryCount) <= 0)
+            return -1;
+
+        pdo.entryCount = entryCount > EthercatCOE::MAX_PDO_ENTRIES ? EthercatCOE::MAX_PDO_ENTRIES : entryCount;
+
+        for (int j = 0; j < pdo.entryCount; j++)
+        {
+            uint32_t obj32 = 0;
+
+            reads++;
+
+            if (EthercatCOE::read(slave, pdo.pdoMappingIndex, j + 1, obj32) <= 0)
+                return -1;
+
+            pdo.entries[j] = decodeEntry(obj32);
+        }
+
+        return entryCount;
+    }
+}
+
+std::mutex &EthercatCOE::mailboxMutex(uint16_t slave)
+{
+    return mailboxMutexes[slave];
+}
+
 /**
  * @brief Функция очистки SyncManager
  * @details Используется перед разметкой PDO
@@ -13,7 +181,7 @@
 int EthercatCOE::clearSM(uint16_t slave, uint16_t smIndex)
 {
     uint8_t pdoCounter = 0;
-    int wc = ec_SDOwrite(slave, static_cast<uint16_t>(smIndex), 00, FALSE, sizeof(pdoCounter), &pdoCounter, EC_TIMEOUTRXM);
+    int wc = write(slave, smIndex, 00, pdoCounter);
     return wc;
 }
 
@@ -26,7 +194,7 @@ int EthercatCOE::clearSM(uint16_t slave, uint16_t smIndex)
 int EthercatCOE::clearPDOMapping(uint16_t slave, uint16_t pdoMappingIndex)
 {
     uint32_t obj32 = 0x656C3F00;    // Неизвестная константа, используемая в TwinCAT для очистки PDO
-    int wc = ec_SDOwrite(slave, static_cast<uint16_t>(pdoMappingIndex), 00, FALSE, sizeof(obj32), &obj32, EC_TIMEOUTRXM);
+    int wc = write(slave, pdoMappingIndex, 00, obj32);
     return wc;
 }
 
@@ -46,7 +214,7 @@ int EthercatCOE::addObjectToPDOMapping(uint16_t slave, uint16_t pdoMappingIndex,
     if(position == 0)
         return -1;
     uint32_t obj32 = (objectIndex << 16) | (objectSubindex << 8) | (objectSize * 8);    // *8 так как размер передается в битах
-    int wc = ec_SDOwrite(slave, static_cast<uint16_t>(pdoMappingIndex), position, FALSE, sizeof(obj32), &obj32, EC_TIMEOUTRXM);
+    int wc = write(slave, pdoMappingIndex, position, obj32);
     return wc;
 }
 
@@ -60,7 +228,7 @@ int EthercatCOE::addObjectToPDOMapping(uint16_t slave, uint16_t pdoMappingIndex,
 int EthercatCOE::setPDOMappingSize(uint16_t slave, uint16_t pdoMappingIndex, uint8_t size)
 {
     uint32_t obj32 = 0x776F4000 + size; // 0x776F4000 - неизвестная константа, взятая из PDO разметки в TwinCAT
-    int wc = ec_SDOwrite(slave, static_cast<uint16_t>(pdoMappingIndex), 0, FALSE, sizeof(obj32), &obj32, EC_TIMEOUTRXM);
+    int wc = write(slave, pdoMappingIndex, 0, obj32);
     return wc;
 }
 
@@ -75,7 +243,7 @@ int EthercatCOE::setPDOMappingSize(uint16_t slave, uint16_t pdoMappingIndex, uin
 int EthercatCOE::addPDOMappingToSyncManager(uint16_t slave, uint16_t pdoMappingIndex, uint16_t smIndex, uint8_t position)
 {
     uint16_t obj16 = static_cast<uint16_t>(pdoMappingIndex);
-    int wc = ec_SDOwrite(slave, static_cast<uint16_t>(smIndex), position, FALSE, sizeof(obj16), &obj16, EC_TIMEOUTRXM);
+    int wc = write(slave, smIndex, position, obj16);
     return wc;
 }
 
@@ -88,7 +256,281 @@ int EthercatCOE::addPDOMappingToSyncManager(uint16_t slave, uint16_t pdoMappingI
  */
 int EthercatCOE::setSMPDONumber(uint16_t slave, uint16_t smIndex, uint8_t pdoNumber)
 {
-    int wc = ec_SDOwrite(slave, static_cast<uint16_t>(smIndex), 00, FALSE, sizeof(pdoNumber), &pdoNumber, EC_TIMEOUTRXM);
+    int wc = write(slave, smIndex, 00, pdoNumber);
     return 0;
 }
 
+
+/**
+ * @brief Функция разметки PDO по заранее описанной раскладке
+ * @details Выполняет всю последовательность из группы PDOMapping: очистка SM и разметок,
+ * запись объектов, задание размеров и регистрация разметок в SyncManager
+ * @param slave
+ * @param layout - требуемая разметка
+ * @return 1 - успех, -1 - одна из записей завершилась ошибкой
+ */
+int EthercatCOE::applyPDOLayout(uint16_t slave, const PDOLayout &layout)
+{
+    const SMAssignment *assignments[] = { &layout.rxPdo, &layout.txPdo };
+    int failed = 0;
+
+    for (const SMAssignment *sm : assignments)
+    {
+        if (clearSM(slave, sm->smIndex) <= 0)
+            failed++;
+
+        for (int i = 0; i < sm->pdoCount; i++)
+        {
+            if (clearPDOMapping(slave, sm->pdos[i].pdoMappingIndex) <= 0)
+                failed++;
+        }
+    }
+
+    for (const SMAssignment *sm : assignments)
+    {
+        for (int i = 0; i < sm->pdoCount; i++)
+        {
+            const PDOMapping &pdo = sm->pdos[i];
+
+            for (int j = 0; j < pdo.entryCount; j++)
+            {
+                // Размер передается в битах, поэтому addObjectToPDOMapping не подходит для битовых объектов
+                uint32_t obj32 = (pdo.entries[j].index << 16) | (pdo.entries[j].subindex << 8) | pdo.entries[j].bitLength;
+                if (write(slave, pdo.pdoMappingIndex, j + 1, obj32) <= 0)
+                    failed++;
+            }
+
+            if (setPDOMappingSize(slave, pdo.pdoMappingIndex, pdo.entryCount) <= 0)
+                failed++;
+        }
+    }
+
+    for (const SMAssignment *sm : assignments)
+    {
+        for (int i = 0; i < sm->pdoCount; i++)
+        {
+            if (addPDOMappingToSyncManager(slave, sm->pdos[i].pdoMappingIndex, sm->smIndex, i + 1) <= 0)
+                failed++;
+        }
+
+        setSMPDONumber(slave, sm->smIndex, sm->pdoCount);
+    }
+
+    return failed == 0 ? 1 : -1;
+}
+
+/**
+ * @brief Функция чтения текущей разметки PDO из slave
+ * @details Читает назначения 0x1C12/0x1C13 и содержимое каждой назначенной разметки,
+ * при поддержке Complete Access - одним SDO чтением на объект
+ * @param slave
+ * @param layout - прочитанная разметка
+ * @return 1 - успех, -1 - ошибка чтения
+ */
+int EthercatCOE::readPDOLayout(uint16_t slave, PDOLayout &layout)
+{
+    SMAssignment *assignments[] = { &layout.rxPdo, &layout.txPdo };
+    uint16_t reads = 0;
+
+    layout.rxPdo.smIndex = static_cast<uint16_t>(SMIndex::SM_RPDO);
+    layout.txPdo.smIndex = static_cast<uint16_t>(SMIndex::SM_TPDO);
+
+    // Разметка длиннее MAX_SM_PDOS/MAX_PDO_ENTRIES не помещается в PDOLayout целиком
+    for (SMAssignment *sm : assignments)
+    {
+        int pdoCount = readAssignment(slave, *sm, reads);
+
+        if (pdoCount < 0 || pdoCount > MAX_SM_PDOS)
+            return -1;
+
+        for (int i = 0; i < sm->pdoCount; i++)
+        {
+            int entryCount = readMapping(slave, sm->pdos[i], reads);
+
+            if (entryCount < 0 || entryCount > MAX_PDO_ENTRIES)
+                return -1;
+        }
+    }
+
+    return 1;
+}
+
+bool EthercatCOE::samePDOMapping(const PDOMapping &a, const PDOMapping &b)
+{
+    if (a.pdoMappingIndex != b.pdoMappingIndex || a.entryCount != b.entryCount)
+        return false;
+
+    for (int j = 0; j < a.entryCount; j++)
+    {
+        if (encodeEntry(a.entries[j]) != encodeEntry(b.entries[j]))
+            return false;
+    }
+
+    return true;
+}
+
+bool EthercatCOE::samePDOLayout(const PDOLayout &a, const PDOLayout &b)
+{
+    const SMAssignment *left[] = { &a.rxPdo, &a.txPdo };
+    const SMAssignment *right[] = { &b.rxPdo, &b.txPdo };
+
+    for (int k = 0; k < 2; k++)
+    {
+        if (left[k]->smIndex != right[k]->smIndex || left[k]->pdoCount != right[k]->pdoCount)
+            return false;
+
+        for (int i = 0; i < left[k]->pdoCount; i++)
+        {
+            if (!samePDOMapping(left[k]->pdos[i], right[k]->pdos[i]))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Функция приведения разметки PDO slave к требуемой
+ * @details Текущие назначения SM и разметки читаются и сравниваются с требуемыми,
+ * записываются только отличающиеся. Разметку можно менять только при пустом назначении SM,
+ * поэтому SM с измененными разметками на время записи обнуляется. Если что-то записано,
+ * разметка читается повторно и сравнивается с требуемой
+ * @param slave
+ * @param layout - требуемая разметка
+ * @param force - переписать разметку полностью через applyPDOLayout, без сравнения
+ * @param report - число чтений и записей, что переписано и результат проверки
+ * @return 1 - разметка в slave совпадает с требуемой, -1 - ошибка записи или расхождение
+ */
+int EthercatCOE::syncPDOLayout(uint16_t slave, const PDOLayout &layout, bool force, PDOSyncReport &report)
+{
+    const SMAssignment *assignments[] = { &layout.rxPdo, &layout.txPdo };
+    int failed = 0;
+
+    report = {};
+    report.forced = force;
+
+    if (force)
+    {
+        failed += applyPDOLayout(slave, layout) < 0;
+
+        for (const SMAssignment *sm : assignments)
+        {
+            // Очистка SM и разметок, объекты, размеры, назначения и число разметок в SM
+            report.writes += 2 + sm->pdoCount * 3;
+
+            for (int i = 0; i < sm->pdoCount; i++)
+                report.writes += sm->pdos[i].entryCount;
+
+            report.rewrittenMappings += sm->pdoCount;
+            report.rewrittenAssignments++;
+        }
+    }
+    else
+    {
+        for (const SMAssignment *sm : assignments)
+        {
+            SMAssignment current = {};
+            bool mappingChanged[MAX_SM_PDOS] = {};
+            bool anyMappingChanged = false;
+
+            current.smIndex = sm->smIndex;
+
+            // Сравнивается число PDO от slave до ограничения MAX_SM_PDOS: лишние PDO тоже изменение
+            bool assignmentChanged = readAssignment(slave, current, report.reads) != sm->pdoCount;
+
+            for (int i = 0; i < sm->pdoCount; i++)
+            {
+                PDOMapping pdo = {};
+                pdo.pdoMappingIndex = sm->pdos[i].pdoMappingIndex;
+
+                if (!assignmentChanged && current.pdos[i].pdoMappingIndex != pdo.pdoMappingIndex)
+                    assignmentChanged = true;
+
+                mappingChanged[i] = readMapping(slave, pdo, report.reads) != sm->pdos[i].entryCount ||
+                                    !samePDOMapping(pdo, sm->pdos[i]);
+                anyMappingChanged |= mappingChanged[i];
+            }
+
+            if (!assignmentChanged && !anyMappingChanged)
+                continue;
+
+            report.writes++;
+            failed += clearSM(slave, sm->smIndex) <= 0;
+
+            for (int i = 0; i < sm->pdoCount; i++)
+            {
+                if (!mappingChanged[i])
+                    continue;
+
+                const PDOMapping &pdo = sm->pdos[i];
+
+                report.writes++;
+                failed += clearPDOMapping(slave, pdo.pdoMappingIndex) <= 0;
+
+                for (int j = 0; j < pdo.entryCount; j++)
+                {
+                    report.writes++;
+                    failed += write(slave, pdo.pdoMappingIndex, j + 1, encodeEntry(pdo.entries[j])) <= 0;
+                }
+
+                report.writes++;
+                failed += setPDOMappingSize(slave, pdo.pdoMappingIndex, pdo.entryCount) <= 0;
+                report.rewrittenMappings++;
+            }
+
+            if (assignmentChanged)
+            {
+                for (int i = 0; i < sm->pdoCount; i++)
+                {
+                    report.writes++;
+                    failed += addPDOMappingToSyncManager(slave, sm->pdos[i].pdoMappingIndex, sm->smIndex, i + 1) <= 0;
+                }
+
+                report.rewrittenAssignments++;
+            }
+
+            report.writes++;
+            failed += write(slave, sm->smIndex, 0, sm->pdoCount) <= 0;
+        }
+    }
+
+    if (report.writes == 0)
+    {
+        // Ничего не записано: прочитанная разметка уже совпала с требуемой
+        report.verified = true;
+        return 1;
+    }
+
+    PDOLayout readBack = {};
+    SMAssignment *readBackAssignments[] = { &readBack.rxPdo, &readBack.txPdo };
+
+    readBack.rxPdo.smIndex = layout.rxPdo.smIndex;
+    readBack.txPdo.smIndex = layout.txPdo.smIndex;
+
+    for (int iSm = 0; iSm < 2; iSm++)
+    {
+        SMAssignment *sm = readBackAssignments[iSm];
+
+        if (readAssignment(slave, *sm, report.reads) != assignments[iSm]->pdoCount)
+            failed++;
+
+        for (int i = 0; i < sm->pdoCount; i++)
+        {
+            if (readMapping(slave, sm->pdos[i], report.reads) != sm->pdos[i].entryCount)
+                failed++;
+        }
+    }
+
+    report.verified = failed == 0 && samePDOLayout(readBack, layout);
+
+    return report.verified ? 1 : -1;
+}
+
+void EthercatCOE::printPDOSyncReport(uint16_t slave, const PDOSyncReport &report)
+{
+    std::cout << "Slave[" << slave << "] PDO layout " << (report.forced ? "rewritten" : "synced") << ": "
+              << report.reads << " read(s), " << report.writes << " write(s), "
+              << static_cast<int>(report.rewrittenMappings) << " mapping(s) and "
+              << static_cast<int>(report.rewrittenAssignments) << " SM assignment(s) rewritten, "
+              << (report.verified ? "verified" : "VERIFY FAILED") << std::endl;
+}
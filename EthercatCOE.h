@@ -6,7 +6,10 @@
 #define ETHERCATCOE_H
 
 #include <stdint.h>
+#include <mutex>
 #include "ethercat.h"
+#include "CoeTypes.h"
+#include "Trace.h"
 
 /**
  * @brief Функции для работы с CanOpen Over Ethercat
@@ -19,6 +22,134 @@ namespace EthercatCOE
         SM_TPDO = 0x1C13        ///< OUTPUT sync manager ex. StatusWord
     };
 
+    constexpr uint8_t MAX_PDO_ENTRIES = 16;     ///< Максимум объектов в одной PDO разметке
+    constexpr uint8_t MAX_SM_PDOS = 4;          ///< Максимум PDO разметок в одном SyncManager
+
+    /**
+     * @brief Объект, размеченный в PDO
+     */
+    struct PDOEntry
+    {
+        uint16_t index;
+        uint8_t subindex;
+        uint8_t bitLength;
+    };
+
+    /**
+     * @brief PDO разметка (0x16xx для RxPDO, 0x1Axx для TxPDO)
+     */
+    struct PDOMapping
+    {
+        uint16_t pdoMappingIndex;
+        uint8_t entryCount;
+        PDOEntry entries[MAX_PDO_ENTRIES];
+    };
+
+    /**
+     * @brief Набор PDO разметок, назначенных в SyncManager
+     */
+    struct SMAssignment
+    {
+        uint16_t smIndex;
+        uint8_t pdoCount;
+        PDOMapping pdos[MAX_SM_PDOS];
+    };
+
+    /**
+     * @brief Полная разметка PDO slave
+     */
+    struct PDOLayout
+    {
+        SMAssignment rxPdo;     ///< 0x1C12, выходы мастера
+        SMAssignment txPdo;     ///< 0x1C13, входы мастера
+    };
+
+    /**
+     * @brief Итог синхронизации разметки PDO с slave
+     */
+    struct PDOSyncReport
+    {
+        uint16_t reads;                 ///< SDO чтений, включая проверку
+        uint16_t writes;                ///< SDO записей
+        uint8_t rewrittenMappings;      ///< Разметки 0x16xx/0x1Axx, записанные заново
+        uint8_t rewrittenAssignments;   ///< SyncManager 0x1C12/0x1C13, назначение которых записано заново
+        bool forced;                    ///< Разметка переписана полностью, без сравнения
+        bool verified;                  ///< Прочитанная из slave разметка совпала с требуемой
+    };
+
+    /**
+     * @brief Блокировка mailbox slave
+     * @details Кадр из mailbox забирает тот, кто первым его прочитал. Каждый обмен через
+     * mailbox (SDO, FoE, опрос Emergency в Diagnostics) выполняется под блокировкой этого
+     * slave, поэтому ответ SDO не может достаться другому потоку
+     */
+    std::mutex &mailboxMutex(uint16_t slave);
+
+    /**
+     * @brief Типизированное чтение объекта через SDO
+     * @details Размер и порядок байт определяются типом T на этапе компиляции,
+     * T должен быть зарегистрирован в CoeTypes
+     * @return wkc ec_SDOread
+     */
+    template<typename T>
+    int read(uint16_t slave, uint16_t index, uint8_t subindex, T &value, int timeout = EC_TIMEOUTRXM)
+    {
+        static_assert(CoeTypes::TypeOf<T>::dataType != 0, "Type is not registered in CoeTypes");
+
+        Trace::Scope span(Trace::Category::MAILBOX, "SDO read", slave, index, subindex);
+
+        T raw{};
+        int size = sizeof(T);
+        std::lock_guard<std::mutex> lock(mailboxMutex(slave));
+        int wkc = ec_SDOread(slave, index, subindex, FALSE, &size, &raw, timeout);
+
+        span.setBytes(size);
+        span.setResult(wkc);
+
+        if (wkc > 0)
+            value = CoeTypes::toHost(raw);
+
+        return wkc;
+    }
+
+    /**
+     * @brief Типизированная запись объекта через SDO
+     * @return wkc ec_SDOwrite
+     */
+    template<typename T>
+    int write(uint16_t slave, uint16_t index, uint8_t subindex, T value, int timeout = EC_TIMEOUTRXM)
+    {
+        static_assert(CoeTypes::TypeOf<T>::dataType != 0, "Type is not registered in CoeTypes");
+
+        Trace::Scope span(Trace::Category::MAILBOX, "SDO write", slave, index, subindex);
+
+        T raw = CoeTypes::toEthercat(value);
+        std::lock_guard<std::mutex> lock(mailboxMutex(slave));
+        int wkc = ec_SDOwrite(slave, index, subindex, FALSE, sizeof(T), &raw, timeout);
+
+        span.setBytes(sizeof(T));
+        span.setResult(wkc);
+
+        return wkc;
+    }
+
+    /**
+     * @brief Чтение объекта по типу данных CoE, например read<ECT_UNSIGNED16>(...)
+     */
+    template<uint16_t Type>
+    int read(uint16_t slave, uint16_t index, uint8_t subindex, typename CoeTypes::DataType<Type>::type &value,
+             int timeout = EC_TIMEOUTRXM)
+    {
+        return read<typename CoeTypes::DataType<Type>::type>(slave, index, subindex, value, timeout);
+    }
+
+    template<uint16_t Type>
+    int write(uint16_t slave, uint16_t index, uint8_t subindex, typename CoeTypes::DataType<Type>::type value,
+              int timeout = EC_TIMEOUTRXM)
+    {
+        return write<typename CoeTypes::DataType<Type>::type>(slave, index, subindex, value, timeout);
+    }
+
     /**
      * @defgroup PDOMapping
      * @brief Функции разметки PDO в EtherCAT Slave
@@ -46,6 +177,14 @@ namespace EthercatCOE
     int addPDOMappingToSyncManager(uint16_t slave, uint16_t pdoMappingIndex, uint16_t smIndex, uint8_t position);
     int setSMPDONumber(uint16_t slave, uint16_t smIndex, uint8_t pdoNumber);
 
+    int applyPDOLayout(uint16_t slave, const PDOLayout &layout);
+    int readPDOLayout(uint16_t slave, PDOLayout &layout);
+
+    bool samePDOMapping(const PDOMapping &a, const PDOMapping &b);
+    bool samePDOLayout(const PDOLayout &a, const PDOLayout &b);
+    int syncPDOLayout(uint16_t slave, const PDOLayout &layout, bool force, PDOSyncReport &report);
+    void printPDOSyncReport(uint16_t slave, const PDOSyncReport &report);
+
     /**
      * @}
      */
@@ -0,0 +1,417 @@
+#include "FirmwareUpdate.h"
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ethercat.h"
+#include "CycleTiming.h"
+#include "EthercatCOE.h"
+#include "Trace.h"
+
+namespace
+{
+    constexpr size_t FOE_HEADER_SIZE = 12;      ///< Заголовок mailbox (6) + заголовок FoE (6)
+    constexpr int FOE_TIMEOUT = 200000;
+
+    /**
+     * @brief Номер 0 в SOEM - весь сегмент, ec_writestate(0) разослал бы состояние всем slave
+     */
+    bool validSlave(uint16_t slave)
+    {
+        return slave >= 1 && slave <= ec_slavecount;
+    }
+
+    const char *statusName(FirmwareUpdate::Status status)
+    {
+        switch (status)
+        {
+        case FirmwareUpdate::Status::OK:
+            return "OK";
+        case FirmwareUpdate::Status::BOOT_FAILED:
+            return "BOOT failed";
+        case FirmwareUpdate::Status::WRITE_FAILED:
+            return "write failed";
+        case FirmwareUpdate::Status::VERIFY_FAILED:
+            return "verify failed";
+        }
+        return "unknown";
+    }
+}
+
+/**
+ * @brief Перевод slave в BOOT
+ * @details Mailbox в BOOT задается отдельными словами SII (boot rx/tx mailbox) и обычно
+ * больше рабочего, поэтому SM0/SM1 перенастраиваются по ним перед сменой состояния
+ * @return 1 - slave в BOOT, -1 - ошибка
+ */
+int FirmwareUpdate::SoemTransport::enterBoot(uint16_t slave)
+{
+    if (!validSlave(slave))
+        return -1;
+
+    Trace::Scope span(Trace::Category::STATE, "Enter BOOT", slave, EC_STATE_BOOT);
+
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+
+        ec_slave[slave].state = EC_STATE_INIT;
+        ec_writestate(slave);
+    }
+
+    // Активный SM не принимает новые настройки, поэтому mailbox перенастраивается только в INIT.
+    // Ожидание идет без блокировки, иначе параллельные обновления ждали бы друг друга
+    uint16_t state = ec_statecheck(slave, EC_STATE_INIT, EC_TIMEOUTSTATE);
+
+    if (state != EC_STATE_INIT)
+    {
+        span.setResult(state);
+        return -1;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+
+        // Адреса и длины mailbox меняются, опрос Emergency не должен читать его посередине
+        std::lock_guard<std::mutex> mailboxLock(EthercatCOE::mailboxMutex(slave));
+
+        uint32_t data;
+
+        {
+            Trace::Scope eeprom(Trace::Category::EEPROM, "EEPROM read", slave, ECT_SII_BOOTRXMBX);
+            data = ec_readeeprom(slave, ECT_SII_BOOTRXMBX, EC_TIMEOUTEEP);
+            eeprom.setBytes(sizeof(data));
+        }
+
+        ec_slave[slave].SM[0].StartAddr = static_cast<uint16_t>(LO_WORD(data));
+        ec_slave[slave].SM[0].SMlength = static_cast<uint16_t>(HI_WORD(data));
+        ec_slave[slave].mbx_wo = static_cast<uint16_t>(LO_WORD(data));
+        ec_slave[slave].mbx_l = static_cast<uint16_t>(HI_WORD(data));
+
+        {
+            Trace::Scope eeprom(Trace::Category::EEPROM, "EEPROM read", slave, ECT_SII_BOOTTXMBX);
+            data = ec_readeeprom(slave, ECT_SII_BOOTTXMBX, EC_TIMEOUTEEP);
+            eeprom.setBytes(sizeof(data));
+        }
+
+        ec_slave[slave].SM[1].StartAddr = static_cast<uint16_t>(LO_WORD(data));
+        ec_slave[slave].SM[1].SMlength = static_cast<uint16_t>(HI_WORD(data));
+        ec_slave[slave].mbx_ro = static_cast<uint16_t>(LO_WORD(data));
+        ec_slave[slave].mbx_rl = static_cast<uint16_t>(HI_WORD(data));
+
+        if (ec_slave[slave].mbx_l == 0 || ec_slave[slave].mbx_rl == 0)
+            return -1;
+
+        int wkc = ec_FPWR(ec_slave[slave].configadr, ECT_REG_SM0, sizeof(ec_smt), &ec_slave[slave].SM[0], EC_TIMEOUTRET);
+
+        if (wkc == 1)
+            wkc = ec_FPWR(ec_slave[slave].configadr, ECT_REG_SM1, sizeof(ec_smt), &ec_slave[slave].SM[1], EC_TIMEOUTRET);
+
+        if (wkc != 1)
+        {
+            span.setResult(wkc);
+            return -1;
+        }
+
+        ec_slave[slave].state = EC_STATE_BOOT;
+        ec_writestate(slave);
+    }
+
+    state = ec_statecheck(slave, EC_STATE_BOOT, EC_TIMEOUTSTATE * 10);
+    span.setResult(state);
+
+    if (state != EC_STATE_BOOT)
+        return -1;
+
+    return 1;
+}
+
+int FirmwareUpdate::SoemTransport::write(uint16_t slave, const char *fileName, uint32_t password, const void *data, size_t size)
+{
+    if (!validSlave(slave))
+        return -1;
+
+    char name[64];
+    strncpy(name, fileName, sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+
+    Trace::Scope span(Trace::Category::MAILBOX, "FoE write", slave);
+    std::lock_guard<std::mutex> lock(EthercatCOE::mailboxMutex(slave));
+    int wkc = ec_FOEwrite(slave, name, password, static_cast<int>(size), const_cast<void*>(data), FOE_TIMEOUT);
+
+    span.setBytes(static_cast<int32_t>(size));
+    span.setResult(wkc);
+
+    return wkc;
+}
+
+int FirmwareUpdate::SoemTransport::read(uint16_t slave, const char *fileName, uint32_t password, void *data, size_t &size)
+{
+    if (!validSlave(slave))
+        return -1;
+
+    char name[64];
+    strncpy(name, fileName, sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+
+    Trace::Scope span(Trace::Category::MAILBOX, "FoE read", slave);
+
+    int psize = static_cast<int>(size);
+    std::lock_guard<std::mutex> lock(EthercatCOE::mailboxMutex(slave));
+    int wkc = ec_FOEread(slave, name, password, &psize, data, FOE_TIMEOUT);
+    size = wkc > 0 ? static_cast<size_t>(psize) : 0;
+
+    span.setBytes(static_cast<int32_t>(size));
+    span.setResult(wkc);
+
+    return wkc;
+}
+
+int FirmwareUpdate::SoemTransport::leaveBoot(uint16_t slave)
+{
+    if (!validSlave(slave))
+        return -1;
+
+    std::lock_guard<std::mutex> lock(stateMutex);
+    Trace::Scope span(Trace::Category::STATE, "Leave BOOT", slave, EC_STATE_INIT);
+
+    ec_slave[slave].state = EC_STATE_INIT;
+    ec_writestate(slave);
+
+    return 1;
+}
+
+uint16_t FirmwareUpdate::SoemTransport::mailboxSize(uint16_t slave)
+{
+    return validSlave(slave) ? ec_slave[slave].mbx_l : 0;
+}
+
+FirmwareUpdate::SimulatedTransport::SimulatedTransport(int slaveCount, uint16_t mailboxSize, uint32_t segmentDelayUs)
+    : slaves(slaveCount + 1), mbxSize(mailboxSize), segmentDelayUs(segmentDelayUs)
+{
+}
+
+int FirmwareUpdate::SimulatedTransport::enterBoot(uint16_t slave)
+{
+    if (slave == 0 || slave >= slaves.size())
+        return -1;
+
+    slaves[slave].boot = true;
+    return 1;
+}
+
+void FirmwareUpdate::SimulatedTransport::transferDelay(size_t size)
+{
+    size_t segmentData = mbxSize - FOE_HEADER_SIZE;
+    size_t segments = (size + segmentData - 1) / segmentData;
+
+    usleep(static_cast<useconds_t>(segments * segmentDelayUs));
+}
+
+int FirmwareUpdate::SimulatedTransport::write(uint16_t slave, const char *fileName, uint32_t password, const void *data, size_t size)
+{
+    if (slave == 0 || slave >= slaves.size() || !slaves[slave].boot)
+        return -1;
+
+    transferDelay(size);
+
+    const uint8_t *bytes = static_cast<const uint8_t*>(data);
+    slaves[slave].flash.assign(bytes, bytes + size);
+
+    return 1;
+}
+
+int FirmwareUpdate::SimulatedTransport::read(uint16_t slave, const char *fileName, uint32_t password, void *data, size_t &size)
+{
+    if (slave == 0 || slave >= slaves.size() || !slaves[slave].boot)
+        return -1;
+
+    size_t available = slaves[slave].flash.size();
+
+    transferDelay(available);
+
+    size = available < size ? available : size;
+    memcpy(data, slaves[slave].flash.data(), size);
+
+    return 1;
+}
+
+int FirmwareUpdate::SimulatedTransport::leaveBoot(uint16_t slave)
+{
+    if (slave == 0 || slave >= slaves.size())
+        return -1;
+
+    slaves[slave].boot = false;
+    return 1;
+}
+
+uint16_t FirmwareUpdate::SimulatedTransport::mailboxSize(uint16_t slave)
+{
+    return mbxSize;
+}
+
+/**
+ * @brief Выбор всех slave заданного типа
+ * @details Вызывается после ec_config_init
+ * @param vendorId
+ * @param productCode
+ * @return номера slave
+ */
+std::vector<uint16_t> FirmwareUpdate::selectSlaves(uint32_t vendorId, uint32_t productCode)
+{
+    std::vector<uint16_t> result;
+
+    for (int i = 1; i <= ec_slavecount; i++)
+    {
+        if (ec_slave[i].eep_man == vendorId && ec_slave[i].eep_id == productCode &&
+            (ec_slave[i].mbx_proto & ECT_MBXPROT_FOE))
+        {
+            result.push_back(static_cast<uint16_t>(i));
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief Одновременное обновление прошивки выбранных slave
+ * @param transport - SOEM или программная модель
+ * @param slaves - номера slave
+ * @param imagePath - файл прошивки, отображается в память и читается всеми потоками
+ * @param options
+ * @return результат по каждому slave
+ */
+std::vector<FirmwareUpdate::SlaveResult> FirmwareUpdate::update(Transport &transport, const std::vector<uint16_t> &slaves,
+                                                                const char *imagePath, const Options &options)
+{
+    std::vector<SlaveResult> results(slaves.size());
+
+    int fd = open(imagePath, O_RDONLY);
+    struct stat st;
+
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        std::cout << "Can't open firmware image " << imagePath << std::endl;
+        if (fd >= 0)
+            close(fd);
+        return {};
+    }
+
+    size_t imageSize = static_cast<size_t>(st.st_size);
+    void *image = mmap(nullptr, imageSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (image == MAP_FAILED)
+    {
+        std::cout << "Can't map firmware image " << imagePath << std::endl;
+        return {};
+    }
+
+    madvise(image, imageSize, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+    std::atomic<size_t> next(0);
+    size_t threadCount = options.maxParallel > 0 && static_cast<size_t>(options.maxParallel) < slaves.size() ?
+                         options.maxParallel : slaves.size();
+    std::vector<std::thread> threads;
+
+    for (size_t t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([&]()
+        {
+            std::vector<uint8_t> readBack;
+
+            for (size_t i = next++; i < slaves.size(); i = next++)
+            {
+                SlaveResult &result = results[i];
+                uint16_t slave = slaves[i];
+
+                result.slave = slave;
+                result.status = Status::OK;
+                result.verified = false;
+                result.mailboxSize = 0;
+                result.bytes = 0;
+                result.seconds = 0;
+
+                int64_t start = CycleTiming::nowNs();
+
+                if (transport.enterBoot(slave) <= 0)
+                {
+                    result.status = Status::BOOT_FAILED;
+                    continue;
+                }
+
+                result.mailboxSize = transport.mailboxSize(slave);
+
+                if (transport.write(slave, options.fileName, options.password, image, imageSize) <= 0)
+                {
+                    result.status = Status::WRITE_FAILED;
+                }
+                else
+                {
+                    result.bytes = imageSize;
+                    result.seconds = (CycleTiming::nowNs() - start) / 1e9;
+
+                    if (options.verify)
+                    {
+                        size_t size = imageSize;
+                        readBack.resize(imageSize);
+
+                        if (transport.read(slave, options.fileName, options.password, readBack.data(), size) <= 0 ||
+                            size != imageSize || memcmp(readBack.data(), image, imageSize) != 0)
+                        {
+                            result.status = Status::VERIFY_FAILED;
+                        }
+                        else
+                        {
+                            result.verified = true;
+                        }
+                    }
+                }
+
+                transport.leaveBoot(slave);
+            }
+        });
+    }
+
+    for (auto &it : threads)
+        it.join();
+
+    munmap(image, imageSize);
+
+    return results;
+}
+
+void FirmwareUpdate::printReport(const std::vector<SlaveResult> &results)
+{
+    size_t totalBytes = 0;
+    double longest = 0;
+    int failed = 0;
+
+    for (const auto &it : results)
+    {
+        std::cout << "\tSlave[" << it.slave << "]: " << statusName(it.status);
+
+        if (it.bytes)
+        {
+            std::cout << ", " << it.bytes << " bytes in " << it.seconds << " s ("
+                      << (it.seconds > 0 ? it.bytes / it.seconds / 1024 : 0) << " KiB/s), mailbox "
+                      << it.mailboxSize << " bytes" << (it.verified ? ", verified" : "");
+        }
+
+        std::cout << std::endl;
+
+        totalBytes += it.bytes;
+        longest = it.seconds > longest ? it.seconds : longest;
+        failed += it.status != Status::OK;
+    }
+
+    std::cout << "Updated " << results.size() - failed << "/" << results.size() << " slave(s), "
+              << totalBytes << " bytes in " << longest << " s";
+    if (longest > 0)
+        std::cout << " (aggregate " << totalBytes / longest / 1024 << " KiB/s)";
+    std::cout << std::endl;
+}
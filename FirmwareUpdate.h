@@ -0,0 +1,114 @@
+#ifndef FIRMWAREUPDATE_H
+#define FIRMWAREUPDATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Параллельное обновление прошивки slave через FoE
+ * @details Порядок для каждого slave
+ * 1. - enterBoot - перевод в BOOT с настройкой boot-mailbox максимального размера из SII
+ * 2. - write - передача образа прошивки (файл отображается в память один раз на все slave)
+ * 3. - read - чтение образа обратно и сравнение, если включена проверка
+ * 4. - leaveBoot - возврат в INIT
+ * Slave обновляются одновременно, каждый в своем потоке
+ */
+namespace FirmwareUpdate
+{
+    /**
+     * @brief Транспорт FoE
+     * @details Позволяет проверять обновление без сети на программной модели slave
+     */
+    class Transport
+    {
+    public:
+        virtual ~Transport() = default;
+
+        virtual int enterBoot(uint16_t slave) = 0;
+        virtual int write(uint16_t slave, const char *fileName, uint32_t password, const void *data, size_t size) = 0;
+        virtual int read(uint16_t slave, const char *fileName, uint32_t password, void *data, size_t &size) = 0;
+        virtual int leaveBoot(uint16_t slave) = 0;
+        virtual uint16_t mailboxSize(uint16_t slave) = 0;
+    };
+
+    /**
+     * @brief FoE через SOEM
+     */
+    class SoemTransport : public Transport
+    {
+    public:
+        int enterBoot(uint16_t slave) override;
+        int write(uint16_t slave, const char *fileName, uint32_t password, const void *data, size_t size) override;
+        int read(uint16_t slave, const char *fileName, uint32_t password, void *data, size_t &size) override;
+        int leaveBoot(uint16_t slave) override;
+        uint16_t mailboxSize(uint16_t slave) override;
+
+    private:
+        std::mutex stateMutex;      ///< Чтение SII и смена состояний выполняются по очереди
+    };
+
+    /**
+     * @brief Программная модель slave с FoE
+     * @details Образ делится на сегменты по размеру mailbox, каждый сегмент задерживается
+     * на segmentDelayUs, как подтверждение от реального slave
+     */
+    class SimulatedTransport : public Transport
+    {
+    public:
+        SimulatedTransport(int slaveCount, uint16_t mailboxSize, uint32_t segmentDelayUs);
+
+        int enterBoot(uint16_t slave) override;
+        int write(uint16_t slave, const char *fileName, uint32_t password, const void *data, size_t size) override;
+        int read(uint16_t slave, const char *fileName, uint32_t password, void *data, size_t &size) override;
+        int leaveBoot(uint16_t slave) override;
+        uint16_t mailboxSize(uint16_t slave) override;
+
+    private:
+        struct SimulatedSlave
+        {
+            bool boot;
+            std::vector<uint8_t> flash;
+        };
+
+        void transferDelay(size_t size);
+
+        std::vector<SimulatedSlave> slaves;
+        uint16_t mbxSize;
+        uint32_t segmentDelayUs;
+    };
+
+    struct Options
+    {
+        const char *fileName;       ///< Имя файла FoE, которое ожидает slave
+        uint32_t password;
+        bool verify;
+        int maxParallel;            ///< 0 - все выбранные slave одновременно
+    };
+
+    enum class Status : uint8_t
+    {
+        OK = 0,
+        BOOT_FAILED,
+        WRITE_FAILED,
+        VERIFY_FAILED
+    };
+
+    struct SlaveResult
+    {
+        uint16_t slave;
+        Status status;
+        bool verified;
+        uint16_t mailboxSize;
+        size_t bytes;
+        double seconds;
+    };
+
+    std::vector<uint16_t> selectSlaves(uint32_t vendorId, uint32_t productCode);
+    std::vector<SlaveResult> update(Transport &transport, const std::vector<uint16_t> &slaves,
+                                    const char *imagePath, const Options &options);
+    void printReport(const std::vector<SlaveResult> &results);
+}
+
+#endif //FIRMWAREUPDATE_H
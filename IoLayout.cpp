@@ -0,0 +1,365 @@
+#include "IoLayout.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+    constexpr uint32_t FRAME_OVERHEAD = 8 + 12;         ///< Преамбула с SFD и межкадровый интервал
+    constexpr uint32_t ETHERNET_HEADER = 14;
+    constexpr uint32_t ETHERNET_FCS = 4;
+    constexpr uint32_t ETHERNET_MIN_FRAME = 64;
+    constexpr uint32_t ECAT_HEADER = 2;
+    constexpr uint32_t DATAGRAM_HEADER = 10;
+    constexpr uint32_t DATAGRAM_WKC = 2;
+
+    uint32_t alignUp(uint32_t value, uint32_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    /**
+     * @brief Байт на проводе для одного кадра с одной датаграммой LRW
+     * @details Первый кадр группы с DC несет еще датаграмму распределенных часов
+     */
+    uint32_t frameBytes(uint32_t dataBytes, bool withDc)
+    {
+        uint32_t frame = ETHERNET_HEADER + ECAT_HEADER + DATAGRAM_HEADER + dataBytes + DATAGRAM_WKC + ETHERNET_FCS;
+
+        if (withDc)
+            frame += EC_FIRSTDCDATAGRAM;
+
+        return FRAME_OVERHEAD + std::max(frame, ETHERNET_MIN_FRAME);
+    }
+
+    /**
+     * @brief Разбиение данных на датаграммы так же, как это делает SOEM
+     * @details Данные slave не делятся между датаграммами, новая датаграмма начинается,
+     * когда очередной slave не помещается в текущую
+     */
+    void segment(const std::vector<uint32_t> &units, bool withDc, IoLayout::GroupPlan &group)
+    {
+        uint32_t current = 0;
+
+        group.datagrams = 0;
+        group.wireBytes = 0;
+        group.logicalBytes = 0;
+        group.datagramBytes.clear();
+
+        for (uint32_t unit : units)
+        {
+            if (unit == 0)
+                continue;
+
+            if (current != 0 && current + unit > IoLayout::MAX_DATAGRAM_DATA)
+            {
+                group.wireBytes += frameBytes(current, withDc && group.datagrams == 0);
+                group.datagramBytes.push_back(current);
+                group.datagrams++;
+                current = 0;
+            }
+
+            current += unit;
+            group.logicalBytes += unit;
+        }
+
+        if (current != 0)
+        {
+            group.wireBytes += frameBytes(current, withDc && group.datagrams == 0);
+            group.datagramBytes.push_back(current);
+            group.datagrams++;
+        }
+    }
+
+    bool groupHasDc(const std::vector<uint8_t> &slaveGroups, uint8_t group)
+    {
+        for (int i = 1; i <= ec_slavecount && i < static_cast<int>(slaveGroups.size()); i++)
+        {
+            if (slaveGroups[i] == group && ec_slave[i].hasdc)
+                return true;
+        }
+
+        return false;
+    }
+
+    IoLayout::GroupPlan planGroup(const NetworkConfig::Config &config, const std::vector<uint8_t> &slaveGroups,
+                                  uint8_t group, bool overlap)
+    {
+        IoLayout::GroupPlan result = {};
+        std::vector<uint32_t> outputs;
+        std::vector<uint32_t> inputs;
+        std::vector<uint32_t> overlapped;
+
+        result.group = group;
+        result.overlap = overlap;
+
+        for (size_t i = 0; i < config.slaves.size(); i++)
+        {
+            uint16_t slave = static_cast<uint16_t>(i + 1);
+
+            // Группа 0 в SOEM включает все slave
+            if (group != 0 && (slave >= slaveGroups.size() || slaveGroups[slave] != group))
+                continue;
+
+            uint32_t outputBytes = (config.slaves[i].outputBits + 7) / 8;
+            uint32_t inputBytes = (config.slaves[i].inputBits + 7) / 8;
+
+            outputs.push_back(outputBytes);
+            inputs.push_back(inputBytes);
+            overlapped.push_back(std::max(outputBytes, inputBytes));
+
+            result.outputBytes += outputBytes;
+            result.inputBytes += inputBytes;
+            result.slaveCount++;
+        }
+
+        if (!overlap)
+            outputs.insert(outputs.end(), inputs.begin(), inputs.end());
+
+        segment(overlap ? overlapped : outputs, groupHasDc(slaveGroups, group), result);
+
+        return result;
+    }
+
+    void summarize(IoLayout::Plan &plan)
+    {
+        uint32_t offset = 0;
+        uint32_t logical = 0;
+
+        plan.datagrams = 0;
+        plan.wireBytes = 0;
+
+        for (auto &it : plan.groups)
+        {
+            offset = alignUp(offset, IoLayout::CACHE_LINE);
+            it.offset = offset;
+            offset += IoLayout::iomapBytes(it);
+
+            logical = alignUp(logical, IoLayout::LOGICAL_ALIGNMENT);
+            it.logicalStart = logical;
+            logical += it.logicalBytes;
+
+            plan.datagrams += it.datagrams;
+            plan.wireBytes += it.wireBytes;
+        }
+
+        plan.iomapSize = offset;
+    }
+}
+
+/**
+ * @brief Место группы в IOmap
+ * @details При перекрытии выходы и входы лежат в IOmap раздельно, каждая часть занимает
+ * до длины логического образа группы
+ */
+uint32_t IoLayout::iomapBytes(const GroupPlan &group)
+{
+    return group.overlap ? 2 * group.logicalBytes : group.outputBytes + group.inputBytes;
+}
+
+/**
+ * @brief Раскладка, которую дал бы ec_config_map: одна группа, без перекрытия
+ */
+IoLayout::Plan IoLayout::planDefault(const NetworkConfig::Config &config)
+{
+    Plan result;
+
+    result.slaveGroups.assign(config.slaves.size() + 1, 0);
+    result.groups.push_back(planGroup(config, result.slaveGroups, 0, false));
+    summarize(result);
+
+    return result;
+}
+
+/**
+ * @brief План раскладки
+ * @param config - размеры процессных данных slave (флаг HAS_SM)
+ * @param slaveGroups - группа каждого slave, индекс - номер slave. Пусто - все slave в группе 0
+ * @return план, группы с номерами больше EC_MAXGROUP - 1 отбрасываются
+ */
+IoLayout::Plan IoLayout::plan(const NetworkConfig::Config &config, const std::vector<uint8_t> &slaveGroups)
+{
+    Plan result;
+
+    result.slaveGroups = slaveGroups;
+    result.slaveGroups.resize(config.slaves.size() + 1, 0);
+
+    uint8_t lastGroup = 0;
+    for (uint8_t group : result.slaveGroups)
+        lastGroup = std::max(lastGroup, group);
+
+    for (uint8_t group = lastGroup == 0 ? 0 : 1; group <= lastGroup && group < EC_MAXGROUP; group++)
+    {
+        GroupPlan standard = planGroup(config, result.slaveGroups, group, false);
+        GroupPlan overlapped = planGroup(config, result.slaveGroups, group, true);
+
+        if (standard.slaveCount == 0)
+            continue;
+
+        bool useOverlap = overlapped.datagrams < standard.datagrams ||
+                          (overlapped.datagrams == standard.datagrams && overlapped.wireBytes < standard.wireBytes);
+
+        result.groups.push_back(useOverlap ? overlapped : standard);
+    }
+
+    summarize(result);
+
+    return result;
+}
+
+/**
+ * @brief Фактическая раскладка после apply по данным ec_group
+ */
+IoLayout::Plan IoLayout::measure(const Plan &plan)
+{
+    Plan result = plan;
+
+    for (auto &it : result.groups)
+    {
+        const ec_groupt &group = ec_group[it.group];
+
+        it.logicalStart = group.logstartaddr;
+        it.outputBytes = group.Obytes;
+        it.inputBytes = group.Ibytes;
+        it.datagrams = group.nsegments;
+        it.logicalBytes = 0;
+        it.wireBytes = 0;
+        it.datagramBytes.clear();
+
+        for (int i = 0; i < group.nsegments; i++)
+        {
+            it.logicalBytes += group.IOsegment[i];
+            it.datagramBytes.push_back(group.IOsegment[i]);
+            it.wireBytes += frameBytes(group.IOsegment[i], group.hasdc && i == 0);
+        }
+    }
+
+    result.datagrams = 0;
+    result.wireBytes = 0;
+
+    for (const auto &it : result.groups)
+    {
+        result.datagrams += it.datagrams;
+        result.wireBytes += it.wireBytes;
+    }
+
+    return result;
+}
+
+/**
+ * @brief Размер IOmap, который нужно выделить под план
+ * @details Если размеры процессных данных всех slave есть в конфигурации (HAS_SM) -
+ * размер плана, иначе предел SOEM MAX_IOMAP_BYTES
+ */
+uint32_t IoLayout::capacity(const NetworkConfig::Config &config, const Plan &plan)
+{
+    bool sized = !config.slaves.empty();
+
+    for (const auto &it : config.slaves)
+        sized &= (it.flags & NetworkConfig::HAS_SM) != 0;
+
+    return sized && plan.iomapSize > 0 ? alignUp(plan.iomapSize, CACHE_LINE) : MAX_IOMAP_BYTES;
+}
+
+/**
+ * @brief Отображение процессных данных по плану вместо ec_config_map
+ * @details Каждая группа отображается со своего выровненного смещения в IOmap. Логическое
+ * окно группы начинается после фактического конца окна прошлой группы (сумма длин
+ * датаграмм), с выравниванием LOGICAL_ALIGNMENT
+ * @return использованный размер IOmap, -1 - IOmap мал
+ */
+int IoLayout::apply(const Plan &plan, uint8_t *ioMap, uint32_t ioMapSize)
+{
+    if (plan.iomapSize > ioMapSize)
+        return -1;
+
+    for (int i = 1; i <= ec_slavecount && i < static_cast<int>(plan.slaveGroups.size()); i++)
+        ec_slave[i].group = plan.slaveGroups[i];
+
+    uint32_t offset = 0;
+    uint32_t logical = 0;
+
+    for (const auto &it : plan.groups)
+    {
+        offset = alignUp(offset, CACHE_LINE);
+        logical = alignUp(logical, LOGICAL_ALIGNMENT);
+
+        ec_group[it.group].logstartaddr = logical;
+
+        int size = it.overlap ? ec_config_overlap_map_group(ioMap + offset, it.group)
+                              : ec_config_map_group(ioMap + offset, it.group);
+
+        offset += size;
+
+        if (offset > ioMapSize)
+            return -1;
+
+        for (int i = 0; i < ec_group[it.group].nsegments; i++)
+            logical += ec_group[it.group].IOsegment[i];
+    }
+
+    return static_cast<int>(offset);
+}
+
+int IoLayout::expectedWkc(const Plan &plan)
+{
+    int wkc = 0;
+
+    for (const auto &it : plan.groups)
+        wkc += ec_group[it.group].outputsWKC * 2 + ec_group[it.group].inputsWKC;
+
+    return wkc;
+}
+
+void IoLayout::send(const Plan &plan)
+{
+    for (const auto &it : plan.groups)
+        ec_send_processdata_group(it.group);
+}
+
+/**
+ * @brief Прием всех групп плана
+ * @return суммарный wkc
+ */
+int IoLayout::receive(const Plan &plan, int timeoutUs)
+{
+    int wkc = 0;
+
+    for (const auto &it : plan.groups)
+    {
+        int groupWkc = ec_receive_processdata_group(it.group, timeoutUs);
+
+        if (groupWkc > 0)
+            wkc += groupWkc;
+    }
+
+    return wkc;
+}
+
+void IoLayout::printReport(const Plan &before, const Plan &after)
+{
+    auto print = [](const char *title, const Plan &plan)
+    {
+        std::cout << title << ": " << plan.groups.size() << " group(s), " << plan.datagrams << " datagram(s), "
+                  << plan.wireBytes << " bytes on the wire per cycle, IOmap " << plan.iomapSize << " bytes" << std::endl;
+
+        for (const auto &it : plan.groups)
+        {
+            std::cout << "\tgroup " << static_cast<int>(it.group) << ": " << it.slaveCount << " slave(s), "
+                      << (it.overlap ? "overlapped" : "separate") << " outputs/inputs, offset " << it.offset
+                      << ", logical 0x" << std::hex << it.logicalStart << std::dec
+                      << ", O " << it.outputBytes << " + I " << it.inputBytes << " bytes, LRW " << it.logicalBytes
+                      << " bytes in " << it.datagrams << " datagram(s), " << it.wireBytes << " wire bytes" << std::endl;
+        }
+    };
+
+    print("IOmap before", before);
+    print("IOmap after", after);
+
+    if (before.wireBytes > 0)
+    {
+        std::cout << "Wire bytes per cycle: " << before.wireBytes << " -> " << after.wireBytes << " ("
+                  << 100.0 * (static_cast<double>(after.wireBytes) - before.wireBytes) / before.wireBytes << "%)"
+                  << std::endl;
+    }
+}
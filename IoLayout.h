@@ -0,0 +1,71 @@
+#ifndef IOLAYOUT_H
+#define IOLAYOUT_H
+
+#include <stdint.h>
+#include <vector>
+#include "ethercat.h"
+#include "NetworkConfig.h"
+
+/**
+ * @brief Планирование раскладки IOmap
+ * @details ec_config_map кладет выходы, затем входы всех slave в порядке обнаружения в одну
+ * группу. План по размерам из NetworkConfig
+ * 1. - делит slave на группы (группа - данные одного потока приложения), данные группы
+ *      лежат в IOmap непрерывно и начинаются с границы кэш-линии
+ * 2. - для каждой группы выбирает обычную или перекрывающуюся (LRW overlap) раскладку,
+ *      в зависимости от того, что дает меньше датаграмм и байт в кадре
+ * Логические адреса и FMMU каждой группы назначает SOEM (ec_config_map_group или
+ * ec_config_overlap_map_group) от ec_group[].logstartaddr. Окна групп в логическом
+ * пространстве не пересекаются: каждое начинается после конца окна прошлой группы,
+ * иначе датаграммы LRW одной группы попадали бы в FMMU slave другой.
+ * Группа 0 в SOEM означает все slave, поэтому план с группами использует номера с 1
+ */
+namespace IoLayout
+{
+    constexpr uint32_t CACHE_LINE = 64;
+    constexpr uint32_t LOGICAL_ALIGNMENT = 0x1000;     ///< Выравнивание начала логического окна группы
+    constexpr uint32_t MAX_DATAGRAM_DATA = EC_MAXLRWDATA - EC_FIRSTDCDATAGRAM;
+    /// Предел SOEM: в каждой группе до EC_MAXIOSEGMENTS датаграмм, выходы и входы в IOmap раздельно
+    constexpr uint32_t MAX_IOMAP_BYTES = EC_MAXGROUP * (2 * EC_MAXIOSEGMENTS * EC_MAXLRWDATA + CACHE_LINE);
+
+    struct GroupPlan
+    {
+        uint8_t group;
+        bool overlap;
+        uint16_t slaveCount;
+        uint32_t offset;            ///< Смещение данных группы в IOmap
+        uint32_t logicalStart;      ///< Начало логического окна группы (logstartaddr)
+        uint32_t outputBytes;
+        uint32_t inputBytes;
+        uint32_t logicalBytes;      ///< Длина данных LRW на проводе
+        uint32_t datagrams;
+        uint32_t wireBytes;         ///< Байт на проводе за цикл, с заголовками, FCS и межкадровым интервалом
+        std::vector<uint32_t> datagramBytes;    ///< Длина данных каждой датаграммы LRW
+    };
+
+    struct Plan
+    {
+        std::vector<uint8_t> slaveGroups;   ///< Группа каждого slave, индекс - номер slave
+        std::vector<GroupPlan> groups;
+        uint32_t iomapSize;
+        uint32_t datagrams;
+        uint32_t wireBytes;
+    };
+
+    uint32_t iomapBytes(const GroupPlan &group);
+
+    Plan planDefault(const NetworkConfig::Config &config);
+    Plan plan(const NetworkConfig::Config &config, const std::vector<uint8_t> &slaveGroups);
+    Plan measure(const Plan &plan);
+
+    uint32_t capacity(const NetworkConfig::Config &config, const Plan &plan);
+    int apply(const Plan &plan, uint8_t *ioMap, uint32_t ioMapSize);
+
+    int expectedWkc(const Plan &plan);
+    void send(const Plan &plan);
+    int receive(const Plan &plan, int timeoutUs);
+
+    void printReport(const Plan &before, const Plan &after);
+}
+
+#endif //IOLAYOUT_H
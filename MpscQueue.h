@@ -0,0 +1,133 @@
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * @brief Ограниченная lock-free очередь: много писателей, один читатель
+ * @details Очередь Вьюкова на кольцевом буфере с номером последовательности в каждой ячейке.
+ * Не содержит указателей, поэтому может размещаться в разделяемой памяти
+ * и использоваться несколькими процессами. Перед использованием вызывается init()
+ *
+ * Писатель, умерший между захватом ячейки и ее публикацией, останавливает читателя на этой
+ * ячейке. Читатель обнаруживает такую ячейку через claimedHead() и пропускает ее через skipHead().
+ * Публикация сделана через CAS, поэтому опоздавший писатель после пропуска получает отказ,
+ * а не портит номер последовательности
+ */
+template<typename T, uint32_t Capacity>
+struct MpscQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "64-bit atomics must be lock-free for shared memory");
+
+    struct Cell
+    {
+        std::atomic<uint64_t> sequence;
+        T value;
+    };
+
+    alignas(64) std::atomic<uint64_t> enqueuePos;
+    alignas(64) std::atomic<uint64_t> dequeuePos;
+    alignas(64) Cell cells[Capacity];
+
+    void init()
+    {
+        for (uint32_t i = 0; i < Capacity; i++)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+
+        enqueuePos.store(0, std::memory_order_relaxed);
+        dequeuePos.store(0, std::memory_order_release);
+    }
+
+    /**
+     * @brief Добавление элемента, безопасно из нескольких потоков и процессов
+     * @return false - очередь заполнена
+     */
+    bool push(const T &value)
+    {
+        uint64_t pos = enqueuePos.load(std::memory_order_relaxed);
+
+        while (true)
+        {
+            Cell &cell = cells[pos & (Capacity - 1)];
+            uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+            int64_t diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(pos);
+
+            if (diff == 0)
+            {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.value = value;
+
+                    // Ячейку могли пропустить как зависшую, тогда номер уже не равен pos
+                    uint64_t claimed = pos;
+                    return cell.sequence.compare_exchange_strong(claimed, pos + 1,
+                                                                 std::memory_order_release, std::memory_order_relaxed);
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Извлечение элемента, вызывается только одним читателем
+     * @return false - очередь пуста
+     */
+    bool pop(T &value)
+    {
+        uint64_t pos = dequeuePos.load(std::memory_order_relaxed);
+        Cell &cell = cells[pos & (Capacity - 1)];
+
+        if (cell.sequence.load(std::memory_order_acquire) != pos + 1)
+            return false;
+
+        value = cell.value;
+        cell.sequence.store(pos + Capacity, std::memory_order_release);
+        dequeuePos.store(pos + 1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    /**
+     * @brief Проверка, что головная ячейка захвачена писателем, но не опубликована
+     * @param pos - номер головной ячейки
+     * @return true - читатель ждет публикации этой ячейки
+     */
+    bool claimedHead(uint64_t &pos) const
+    {
+        pos = dequeuePos.load(std::memory_order_relaxed);
+
+        if (enqueuePos.load(std::memory_order_acquire) <= pos)
+            return false;
+
+        return cells[pos & (Capacity - 1)].sequence.load(std::memory_order_acquire) == pos;
+    }
+
+    /**
+     * @brief Пропуск зависшей головной ячейки, вызывается только читателем
+     * @details Ячейка возвращается писателям следующего круга, значение не читается
+     * @return false - писатель успел опубликовать ячейку, она будет прочитана обычным pop()
+     */
+    bool skipHead(uint64_t pos)
+    {
+        Cell &cell = cells[pos & (Capacity - 1)];
+        uint64_t claimed = pos;
+
+        if (!cell.sequence.compare_exchange_strong(claimed, pos + Capacity, std::memory_order_acq_rel))
+            return false;
+
+        dequeuePos.store(pos + 1, std::memory_order_relaxed);
+
+        return true;
+    }
+};
+
+#endif //MPSCQUEUE_H
@@ -0,0 +1,1112 @@
+#include "NetworkConfig.h"
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include "Trace.h"
+
+namespace
+{
+    const NetworkConfig::Config *activeConfig = nullptr;
+    bool forceLayoutRewrite = false;
+
+    /**
+     * @brief Узел разобранного XML документа
+     * @details Поддерживается подмножество XML, достаточное для ENI/ESI: элементы, атрибуты, текст,
+     * комментарии, CDATA и стандартные сущности
+     */
+    struct XmlNode
+    {
+        std::string name;
+        std::vector<std::pair<std::string, std::string>> attributes;
+        std::string text;
+        std::vector<XmlNode> children;
+
+        const XmlNode *child(const char *childName) const
+        {
+            for (const auto &it : children)
+            {
+                if (it.name == childName)
+                    return &it;
+            }
+            return nullptr;
+        }
+
+        std::string childText(const char *childName) const
+        {
+            const XmlNode *node = child(childName);
+            return node ? node->text : std::string();
+        }
+
+        std::string attribute(const char *attributeName) const
+        {
+            for (const auto &it : attributes)
+            {
+                if (it.first == attributeName)
+                    return it.second;
+            }
+            return std::string();
+        }
+    };
+
+    std::string decodeEntities(const std::string &str)
+    {
+        static const struct { const char *entity; char symbol; } entities[] =
+        {
+            { "&lt;", '<' }, { "&gt;", '>' }, { "&amp;", '&' }, { "&quot;", '"' }, { "&apos;", '\'' }
+        };
+
+        std::string result;
+        result.reserve(str.size());
+
+        for (size_t i = 0; i < str.size(); i++)
+        {
+            bool decoded = false;
+
+            if (str[i] == '&')
+            {
+                for (const auto &it : entities)
+                {
+                    size_t len = strlen(it.entity);
+                    if (str.compare(i, len, it.entity) == 0)
+                    {
+                        result += it.symbol;
+                        i += len - 1;
+                        decoded = true;
+                        break;
+                    }
+                }
+            }
+
+            if (!decoded)
+                result += str[i];
+        }
+
+        return result;
+    }
+
+    std::string trim(const std::string &str)
+    {
+        size_t begin = str.find_first_not_of(" \t\r\n");
+        if (begin == std::string::npos)
+            return std::string();
+        size_t end = str.find_last_not_of(" \t\r\n");
+        return str.substr(begin, end - begin + 1);
+    }
+
+    bool parseXml(const std::string &xml, XmlNode &root)
+    {
+        std::vector<XmlNode*> stack;
+        size_t pos = 0;
+
+        root = XmlNode();
+        stack.push_back(&root);
+
+        while (pos < xml.size())
+        {
+            size_t tagStart = xml.find('<', pos);
+            std::string text = xml.substr(pos, tagStart == std::string::npos ? std::string::npos : tagStart - pos);
+            stack.back()->text += decodeEntities(text);
+
+            if (tagStart == std::string::npos)
+                break;
+
+            if (xml.compare(tagStart, 4, "<!--") == 0)
+            {
+                size_t end = xml.find("-->", tagStart);
+                if (end == std::string::npos)
+                    return false;
+                pos = end + 3;
+                continue;
+            }
+
+            if (xml.compare(tagStart, 9, "<![CDATA[") == 0)
+            {
+                size_t end = xml.find("]]>", tagStart);
+                if (end == std::string::npos)
+                    return false;
+                stack.back()->text += xml.substr(tagStart + 9, end - tagStart - 9);
+                pos = end + 3;
+                continue;
+            }
+
+            size_t tagEnd = xml.find('>', tagStart);
+            if (tagEnd == std::string::npos)
+                return false;
+
+            pos = tagEnd + 1;
+
+            // Пролог <?xml ...?> и <!DOCTYPE ...>
+            if (xml[tagStart + 1] == '?' || xml[tagStart + 1] == '!')
+                continue;
+
+            if (xml[tagStart + 1] == '/')
+            {
+                if (stack.size() <= 1)
+                    return false;
+                stack.back()->text = trim(stack.back()->text);
+                stack.pop_back();
+                continue;
+            }
+
+            bool selfClosing = xml[tagEnd - 1] == '/';
+            std::string tag = xml.substr(tagStart + 1, tagEnd - tagStart - 1 - (selfClosing ? 1 : 0));
+
+            XmlNode node;
+            size_t i = tag.find_first_of(" \t\r\n");
+            node.name = tag.substr(0, i);
+
+            while (i != std::string::npos && i < tag.size())
+            {
+                size_t nameStart = tag.find_first_not_of(" \t\r\n", i);
+                if (nameStart == std::string::npos)
+                    break;
+                size_t eq = tag.find('=', nameStart);
+                if (eq == std::string::npos)
+                    break;
+                size_t quoteStart = tag.find_first_of("\"'", eq);
+                if (quoteStart == std::string::npos)
+                    return false;
+                size_t quoteEnd = tag.find(tag[quoteStart], quoteStart + 1);
+                if (quoteEnd == std::string::npos)
+                    return false;
+
+                node.attributes.emplace_back(trim(tag.substr(nameStart, eq - nameStart)),
+                                             decodeEntities(tag.substr(quoteStart + 1, quoteEnd - quoteStart - 1)));
+                i = quoteEnd + 1;
+            }
+
+            stack.back()->children.push_back(std::move(node));
+
+            if (!selfClosing)
+                stack.push_back(&stack.back()->children.back());
+        }
+
+        return stack.size() == 1;
+    }
+
+    /**
+     * @brief Разбор числа в нотации ENI/ESI: "#x1A00", "0x1A00" или десятичное
+     */
+    uint32_t parseNumber(const std::string &str)
+    {
+        std::string value = trim(str);
+
+        if (value.size() > 2 && value[0] == '#' && (value[1] == 'x' || value[1] == 'X'))
+            return static_cast<uint32_t>(strtoul(value.c_str() + 2, nullptr, 16));
+
+        return static_cast<uint32_t>(strtoul(value.c_str(), nullptr, 0));
+    }
+
+    /**
+     * @brief Разбор описания PDO (RxPdo/TxPdo) в ENI или ESI
+     * @return номер SyncManager, к которому назначена разметка, либо -1, если разметка не назначена
+     */
+    int parsePdo(const XmlNode &pdoNode, EthercatCOE::PDOMapping &pdo, uint16_t &bits)
+    {
+        std::string sm = pdoNode.attribute("Sm");
+
+        pdo.pdoMappingIndex = static_cast<uint16_t>(parseNumber(pdoNode.childText("Index")));
+        pdo.entryCount = 0;
+
+        for (const auto &entry : pdoNode.children)
+        {
+            if (entry.name != "Entry" || pdo.entryCount >= EthercatCOE::MAX_PDO_ENTRIES)
+                continue;
+
+            EthercatCOE::PDOEntry &it = pdo.entries[pdo.entryCount++];
+            it.index = static_cast<uint16_t>(parseNumber(entry.childText("Index")));
+            it.subindex = static_cast<uint8_t>(parseNumber(entry.childText("SubIndex")));
+            it.bitLength = static_cast<uint8_t>(parseNumber(entry.childText("BitLen")));
+            bits += it.bitLength;
+        }
+
+        return sm.empty() ? -1 : static_cast<int>(parseNumber(sm));
+    }
+
+    /**
+     * @brief Разбор списка RxPdo/TxPdo в разметку PDO slave
+     */
+    void parsePdoLayout(const XmlNode &parent, NetworkConfig::SlaveConfig &slave)
+    {
+        slave.pdoLayout.rxPdo.smIndex = static_cast<uint16_t>(EthercatCOE::SMIndex::SM_RPDO);
+        slave.pdoLayout.txPdo.smIndex = static_cast<uint16_t>(EthercatCOE::SMIndex::SM_TPDO);
+
+        uint16_t outputBits = 0;
+        uint16_t inputBits = 0;
+
+        for (const auto &it : parent.children)
+        {
+            bool isRx = it.name == "RxPdo";
+
+            if (!isRx && it.name != "TxPdo")
+                continue;
+
+            EthercatCOE::SMAssignment &sm = isRx ? slave.pdoLayout.rxPdo : slave.pdoLayout.txPdo;
+            EthercatCOE::PDOMapping pdo;
+            uint16_t bits = 0;
+
+            if (parsePdo(it, pdo, bits) < 0 || sm.pdoCount >= EthercatCOE::MAX_SM_PDOS)
+                continue;
+
+            sm.pdos[sm.pdoCount++] = pdo;
+            (isRx ? outputBits : inputBits) += bits;
+        }
+
+        if (slave.pdoLayout.rxPdo.pdoCount || slave.pdoLayout.txPdo.pdoCount)
+        {
+            slave.flags |= NetworkConfig::HAS_PDO_LAYOUT;
+            slave.outputBits = outputBits;
+            slave.inputBits = inputBits;
+        }
+    }
+
+    /**
+     * @brief Тип SyncManager в нумерации SOEM (SMtype) по его названию в ENI/ESI
+     */
+    uint8_t smTypeFromString(const std::string &type)
+    {
+        if (type == "MBoxOut")
+            return 1;
+        if (type == "MBoxIn")
+            return 2;
+        if (type == "Outputs")
+            return 3;
+        if (type == "Inputs")
+            return 4;
+        return 0;
+    }
+
+    /**
+     * @brief Длина SM процессных данных по сумме битов PDO
+     * @details В ESI у Sm процессных данных обычно нет DefaultSize, а apply() выставляет
+     * configindex, и SOEM не считает размеры сам. Без этого SM2/SM3 записались бы с длиной 0
+     * и были бы выключены. Длина берется у первого SM типа Outputs/Inputs, у которого она не задана
+     */
+    void fillProcessDataLengths(NetworkConfig::SlaveConfig &slave)
+    {
+        bool outputsDone = false;
+        bool inputsDone = false;
+
+        for (int iSm = 0; iSm < EC_MAXSM; iSm++)
+        {
+            if (slave.smType[iSm] == 3 && !outputsDone)
+            {
+                if (slave.sm[iSm].SMlength == 0)
+                    slave.sm[iSm].SMlength = static_cast<uint16_t>((slave.outputBits + 7) / 8);
+                outputsDone = true;
+            }
+            else if (slave.smType[iSm] == 4 && !inputsDone)
+            {
+                if (slave.sm[iSm].SMlength == 0)
+                    slave.sm[iSm].SMlength = static_cast<uint16_t>((slave.inputBits + 7) / 8);
+                inputsDone = true;
+            }
+        }
+    }
+
+    void initSlave(NetworkConfig::SlaveConfig &slave)
+    {
+        memset(&slave, 0, sizeof(slave));
+        slave.outputsOffset = NetworkConfig::NO_OFFSET;
+        slave.inputsOffset = NetworkConfig::NO_OFFSET;
+    }
+
+    void copyName(NetworkConfig::SlaveConfig &slave, const std::string &name)
+    {
+        strncpy(slave.name, name.c_str(), EC_MAXNAME);
+        slave.name[EC_MAXNAME] = '\0';
+    }
+
+    /**
+     * @brief Сборка конфигурации из ENI (EtherCATConfig)
+     */
+    int compileEni(const XmlNode &root, NetworkConfig::Config &config)
+    {
+        const XmlNode *configNode = root.child("Config");
+
+        if (configNode == nullptr)
+            return -1;
+
+        for (const auto &it : configNode->children)
+        {
+            if (it.name != "Slave")
+                continue;
+
+            NetworkConfig::SlaveConfig slave;
+            initSlave(slave);
+
+            const XmlNode *info = it.child("Info");
+            if (info == nullptr)
+                return -1;
+
+            copyName(slave, info->childText("Name"));
+            slave.vendorId = parseNumber(info->childText("VendorId"));
+            slave.productCode = parseNumber(info->childText("ProductCode"));
+            slave.revision = parseNumber(info->childText("RevisionNo"));
+            slave.configAddress = static_cast<uint16_t>(parseNumber(info->childText("PhysAddr")));
+
+            const XmlNode *processData = it.child("ProcessData");
+
+            if (processData != nullptr)
+            {
+                parsePdoLayout(*processData, slave);
+
+                const XmlNode *send = processData->child("Send");
+                const XmlNode *recv = processData->child("Recv");
+
+                if (send != nullptr)
+                    slave.outputBits = static_cast<uint16_t>(parseNumber(send->childText("BitLength")));
+                if (recv != nullptr)
+                    slave.inputBits = static_cast<uint16_t>(parseNumber(recv->childText("BitLength")));
+
+                for (int iSm = 0; iSm < EC_MAXSM; iSm++)
+                {
+                    std::string smName = "Sm" + std::to_string(iSm);
+                    const XmlNode *smNode = processData->child(smName.c_str());
+
+                    if (smNode == nullptr)
+                        continue;
+
+                    slave.sm[iSm].StartAddr = static_cast<uint16_t>(parseNumber(smNode->childText("StartAddress")));
+                    slave.sm[iSm].SMlength = static_cast<uint16_t>(parseNumber(smNode->childText("DefaultSize")));
+                    slave.sm[iSm].SMflags = parseNumber(smNode->childText("ControlByte"));
+                    if (smNode->childText("Enable") == "true" || smNode->childText("Enable") == "1")
+                        slave.sm[iSm].SMflags |= 0x10000;
+                    slave.smType[iSm] = smTypeFromString(smNode->childText("Type"));
+                    slave.flags |= NetworkConfig::HAS_SM;
+                }
+
+                fillProcessDataLengths(slave);
+            }
+
+            config.slaves.push_back(slave);
+        }
+
+        return static_cast<int>(config.slaves.size());
+    }
+
+    /**
+     * @brief Сборка конфигурации из ESI (EtherCATInfo)
+     * @details ESI описывает типы устройств, а не топологию, поэтому устройства
+     * считаются ожидаемыми slave в порядке следования в файле
+     */
+    int compileEsi(const XmlNode &root, NetworkConfig::Config &config)
+    {
+        const XmlNode *vendor = root.child("Vendor");
+        const XmlNode *descriptions = root.child("Descriptions");
+        const XmlNode *devices = descriptions ? descriptions->child("Devices") : nullptr;
+
+        if (vendor == nullptr || devices == nullptr)
+            return -1;
+
+        uint32_t vendorId = parseNumber(vendor->childText("Id"));
+
+        for (const auto &it : devices->children)
+        {
+            if (it.name != "Device")
+                continue;
+
+            NetworkConfig::SlaveConfig slave;
+            initSlave(slave);
+
+            const XmlNode *type = it.child("Type");
+            if (type == nullptr)
+                return -1;
+
+            slave.vendorId = vendorId;
+            slave.productCode = parseNumber(type->attribute("ProductCode"));
+            slave.revision = parseNumber(type->attribute("RevisionNo"));
+            copyName(slave, type->text);
+
+            int iSm = 0;
+
+            for (const auto &smNode : it.children)
+            {
+                if (smNode.name != "Sm" || iSm >= EC_MAXSM)
+                    continue;
+
+                slave.sm[iSm].StartAddr = static_cast<uint16_t>(parseNumber(smNode.attribute("StartAddress")));
+                slave.sm[iSm].SMlength = static_cast<uint16_t>(parseNumber(smNode.attribute("DefaultSize")));
+                slave.sm[iSm].SMflags = parseNumber(smNode.attribute("ControlByte"));
+                if (parseNumber(smNode.attribute("Enable")))
+                    slave.sm[iSm].SMflags |= 0x10000;
+                slave.smType[iSm] = smTypeFromString(smNode.text);
+                slave.flags |= NetworkConfig::HAS_SM;
+                iSm++;
+            }
+
+            parsePdoLayout(it, slave);
+            fillProcessDataLengths(slave);
+
+            config.slaves.push_back(slave);
+        }
+
+        return static_cast<int>(config.slaves.size());
+    }
+
+    /**
+     * @brief FNV-1a, контрольная сумма бинарного файла конфигурации
+     */
+    uint32_t checksum(const uint8_t *data, size_t size)
+    {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= data[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    class Writer
+    {
+    public:
+        template<typename T>
+        void put(T value)
+        {
+            const uint8_t *bytes = reinterpret_cast<const uint8_t*>(&value);
+            data.insert(data.end(), bytes, bytes + sizeof(T));
+        }
+
+        std::vector<uint8_t> data;
+    };
+
+    class Reader
+    {
+    public:
+        Reader(const uint8_t *data, size_t size) : data(data), size(size) {}
+
+        template<typename T>
+        T get()
+        {
+            T value{};
+            if (pos + sizeof(T) > size)
+            {
+                ok = false;
+                return value;
+            }
+            memcpy(&value, data + pos, sizeof(T));
+            pos += sizeof(T);
+            return value;
+        }
+
+        const uint8_t *data;
+        size_t size;
+        size_t pos = 0;
+        bool ok = true;
+    };
+
+    void writeAssignment(Writer &writer, const EthercatCOE::SMAssignment &sm)
+    {
+        writer.put<uint16_t>(sm.smIndex);
+        writer.put<uint8_t>(sm.pdoCount);
+
+        for (int i = 0; i < sm.pdoCount; i++)
+        {
+            writer.put<uint16_t>(sm.pdos[i].pdoMappingIndex);
+            writer.put<uint8_t>(sm.pdos[i].entryCount);
+
+            for (int j = 0; j < sm.pdos[i].entryCount; j++)
+            {
+                writer.put<uint16_t>(sm.pdos[i].entries[j].index);
+                writer.put<uint8_t>(sm.pdos[i].entries[j].subindex);
+                writer.put<uint8_t>(sm.pdos[i].entries[j].bitLength);
+            }
+        }
+    }
+
+    void readAssignment(Reader &reader, EthercatCOE::SMAssignment &sm)
+    {
+        sm.smIndex = reader.get<uint16_t>();
+        sm.pdoCount = reader.get<uint8_t>();
+
+        if (sm.pdoCount > EthercatCOE::MAX_SM_PDOS)
+        {
+            reader.ok = false;
+            return;
+        }
+
+        for (int i = 0; i < sm.pdoCount; i++)
+        {
+            sm.pdos[i].pdoMappingIndex = reader.get<uint16_t>();
+            sm.pdos[i].entryCount = reader.get<uint8_t>();
+
+            if (sm.pdos[i].entryCount > EthercatCOE::MAX_PDO_ENTRIES)
+            {
+                reader.ok = false;
+                return;
+            }
+
+            for (int j = 0; j < sm.pdos[i].entryCount; j++)
+            {
+                sm.pdos[i].entries[j].index = reader.get<uint16_t>();
+                sm.pdos[i].entries[j].subindex = reader.get<uint8_t>();
+                sm.pdos[i].entries[j].bitLength = reader.get<uint8_t>();
+            }
+        }
+    }
+}
+
+/**
+ * @brief Функция сборки конфигурации из ENI/ESI XML или дампа предыдущего запуска
+ * @param inputPath - путь к ENI/ESI XML либо к бинарному дампу
+ * @param config - собранная конфигурация
+ * @return число slave в конфигурации, -1 при ошибке
+ */
+int NetworkConfig::compile(const char *inputPath, Config &config)
+{
+    std::ifstream file(inputPath, std::ios::binary);
+
+    if (!file)
+    {
+        std::cout << "Can't open " << inputPath << std::endl;
+        return -1;
+    }
+
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    uint32_t magic = 0;
+    if (content.size() >= sizeof(magic))
+        memcpy(&magic, content.data(), sizeof(magic));
+
+    if (magic == MAGIC)
+        return load(inputPath, config);
+
+    XmlNode document;
+
+    if (!parseXml(content, document))
+    {
+        std::cout << "Can't parse XML " << inputPath << std::endl;
+        return -1;
+    }
+
+    config.iomapSize = 0;
+    config.slaves.clear();
+
+    for (const auto &root : document.children)
+    {
+        if (root.name == "EtherCATConfig")
+            return compileEni(root, config);
+        if (root.name == "EtherCATInfo")
+            return compileEsi(root, config);
+    }
+
+    std::cout << "Unknown XML root in " << inputPath << " (expected EtherCATConfig or EtherCATInfo)" << std::endl;
+    return -1;
+}
+
+/**
+ * @brief Функция сохранения конфигурации в бинарный файл
+ * @param path
+ * @param config
+ * @return размер файла в байтах, -1 при ошибке
+ */
+int NetworkConfig::save(const char *path, const Config &config)
+{
+    Writer writer;
+
+    writer.put<uint32_t>(MAGIC);
+    writer.put<uint16_t>(VERSION);
+    writer.put<uint16_t>(static_cast<uint16_t>(config.slaves.size()));
+    writer.put<uint32_t>(config.iomapSize);
+
+    for (const auto &slave : config.slaves)
+    {
+        writer.put<uint8_t>(slave.flags);
+        writer.put<uint32_t>(slave.vendorId);
+        writer.put<uint32_t>(slave.productCode);
+        writer.put<uint32_t>(slave.revision);
+        writer.put<uint16_t>(slave.configAddress);
+
+        uint8_t nameLength = static_cast<uint8_t>(strnlen(slave.name, EC_MAXNAME));
+        writer.put<uint8_t>(nameLength);
+        writer.data.insert(writer.data.end(), slave.name, slave.name + nameLength);
+
+        if (slave.flags & HAS_SII_DETAILS)
+        {
+            writer.put<uint8_t>(slave.coeDetails);
+            writer.put<uint8_t>(slave.foeDetails);
+            writer.put<uint8_t>(slave.eoeDetails);
+            writer.put<uint8_t>(slave.soeDetails);
+            writer.put<uint8_t>(slave.blockLRW);
+            writer.put<int16_t>(slave.ebusCurrent);
+        }
+
+        writer.put<uint16_t>(slave.outputBits);
+        writer.put<uint16_t>(slave.inputBits);
+
+        if (slave.flags & HAS_SM)
+        {
+            for (int i = 0; i < EC_MAXSM; i++)
+            {
+                writer.put<uint16_t>(slave.sm[i].StartAddr);
+                writer.put<uint16_t>(slave.sm[i].SMlength);
+                writer.put<uint32_t>(slave.sm[i].SMflags);
+                writer.put<uint8_t>(slave.smType[i]);
+            }
+        }
+
+        if (slave.flags & HAS_FMMU)
+        {
+            for (int i = 0; i < EC_MAXFMMU; i++)
+            {
+                writer.put<uint32_t>(slave.fmmu[i].LogStart);
+                writer.put<uint16_t>(slave.fmmu[i].LogLength);
+                writer.put<uint8_t>(slave.fmmu[i].LogStartbit);
+                writer.put<uint8_t>(slave.fmmu[i].LogEndbit);
+                writer.put<uint16_t>(slave.fmmu[i].PhysStart);
+                writer.put<uint8_t>(slave.fmmu[i].PhysStartBit);
+                writer.put<uint8_t>(slave.fmmu[i].FMMUtype);
+                writer.put<uint8_t>(slave.fmmu[i].FMMUactive);
+            }
+        }
+
+        if (slave.flags & HAS_OFFSETS)
+        {
+            writer.put<uint32_t>(slave.outputsOffset);
+            writer.put<uint32_t>(slave.inputsOffset);
+        }
+
+        if (slave.flags & HAS_PDO_LAYOUT)
+        {
+            writeAssignment(writer, slave.pdoLayout.rxPdo);
+            writeAssignment(writer, slave.pdoLayout.txPdo);
+        }
+    }
+
+    writer.put<uint32_t>(checksum(writer.data.data(), writer.data.size()));
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(writer.data.data()), writer.data.size());
+
+    if (!file)
+    {
+        std::cout << "Can't write " << path << std::endl;
+        return -1;
+    }
+
+    return static_cast<int>(writer.data.size());
+}
+
+/**
+ * @brief Функция загрузки бинарной конфигурации
+ * @param path
+ * @param config
+ * @return число slave в конфигурации, -1 при ошибке
+ */
+int NetworkConfig::load(const char *path, Config &config)
+{
+    std::ifstream file(path, std::ios::binary);
+
+    if (!file)
+    {
+        std::cout << "Can't open " << path << std::endl;
+        return -1;
+    }
+
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    uint32_t storedChecksum = 0;
+
+    if (data.size() >= sizeof(uint32_t))
+        memcpy(&storedChecksum, &data[data.size() - sizeof(uint32_t)], sizeof(storedChecksum));
+
+    if (data.size() < sizeof(uint32_t) || checksum(data.data(), data.size() - sizeof(uint32_t)) != storedChecksum)
+    {
+        std::cout << "Bad config checksum in " << path << std::endl;
+        return -1;
+    }
+
+    Reader reader(data.data(), data.size() - sizeof(uint32_t));
+
+    if (reader.get<uint32_t>() != MAGIC || reader.get<uint16_t>() != VERSION)
+    {
+        std::cout << "Unsupported config format in " << path << std::endl;
+        return -1;
+    }
+
+    uint16_t slaveCount = reader.get<uint16_t>();
+    config.iomapSize = reader.get<uint32_t>();
+    config.slaves.clear();
+    config.slaves.reserve(slaveCount);
+
+    for (int i = 0; i < slaveCount && reader.ok; i++)
+    {
+        SlaveConfig slave;
+        initSlave(slave);
+
+        slave.flags = reader.get<uint8_t>();
+        slave.vendorId = reader.get<uint32_t>();
+        slave.productCode = reader.get<uint32_t>();
+        slave.revision = reader.get<uint32_t>();
+        slave.configAddress = reader.get<uint16_t>();
+
+        uint8_t nameLength = reader.get<uint8_t>();
+        for (int j = 0; j < nameLength && j < EC_MAXNAME; j++)
+            slave.name[j] = reader.get<char>();
+
+        if (slave.flags & HAS_SII_DETAILS)
+        {
+            slave.coeDetails = reader.get<uint8_t>();
+            slave.foeDetails = reader.get<uint8_t>();
+            slave.eoeDetails = reader.get<uint8_t>();
+            slave.soeDetails = reader.get<uint8_t>();
+            slave.blockLRW = reader.get<uint8_t>();
+            slave.ebusCurrent = reader.get<int16_t>();
+        }
+
+        slave.outputBits = reader.get<uint16_t>();
+        slave.inputBits = reader.get<uint16_t>();
+
+        if (slave.flags & HAS_SM)
+        {
+            for (int j = 0; j < EC_MAXSM; j++)
+            {
+                slave.sm[j].StartAddr = reader.get<uint16_t>();
+                slave.sm[j].SMlength = reader.get<uint16_t>();
+                slave.sm[j].SMflags = reader.get<uint32_t>();
+                slave.smType[j] = reader.get<uint8_t>();
+            }
+        }
+
+        if (slave.flags & HAS_FMMU)
+        {
+            for (int j = 0; j < EC_MAXFMMU; j++)
+            {
+                slave.fmmu[j].LogStart = reader.get<uint32_t>();
+                slave.fmmu[j].LogLength = reader.get<uint16_t>();
+                slave.fmmu[j].LogStartbit = reader.get<uint8_t>();
+                slave.fmmu[j].LogEndbit = reader.get<uint8_t>();
+                slave.fmmu[j].PhysStart = reader.get<uint16_t>();
+                slave.fmmu[j].PhysStartBit = reader.get<uint8_t>();
+                slave.fmmu[j].FMMUtype = reader.get<uint8_t>();
+                slave.fmmu[j].FMMUactive = reader.get<uint8_t>();
+            }
+        }
+
+        if (slave.flags & HAS_OFFSETS)
+        {
+            slave.outputsOffset = reader.get<uint32_t>();
+            slave.inputsOffset = reader.get<uint32_t>();
+        }
+
+        if (slave.flags & HAS_PDO_LAYOUT)
+        {
+            readAssignment(reader, slave.pdoLayout.rxPdo);
+            readAssignment(reader, slave.pdoLayout.txPdo);
+        }
+
+        config.slaves.push_back(slave);
+    }
+
+    if (!reader.ok || reader.pos != reader.size)
+    {
+        std::cout << "Truncated config in " << path << std::endl;
+        return -1;
+    }
+
+    return static_cast<int>(config.slaves.size());
+}
+
+/**
+ * @brief Функция снятия конфигурации с работающей сети
+ * @details Вызывается после ec_config_map. Разметка PDO читается из slave через CoE
+ * @param config
+ * @param ioMap - IOmap, переданный в ec_config_map
+ * @param iomapSize - результат ec_config_map
+ * @return число slave в конфигурации
+ */
+int NetworkConfig::capture(Config &config, const void *ioMap, int iomapSize)
+{
+    const uint8_t *base = static_cast<const uint8_t*>(ioMap);
+
+    config.iomapSize = static_cast<uint32_t>(iomapSize);
+    config.slaves.clear();
+
+    for (int i = 1; i <= ec_slavecount; i++)
+    {
+        SlaveConfig slave;
+        initSlave(slave);
+
+        slave.flags = HAS_SII_DETAILS | HAS_SM | HAS_FMMU | HAS_OFFSETS;
+        slave.vendorId = ec_slave[i].eep_man;
+        slave.productCode = ec_slave[i].eep_id;
+        slave.revision = ec_slave[i].eep_rev;
+        slave.configAddress = ec_slave[i].configadr;
+        copyName(slave, ec_slave[i].name);
+
+        slave.coeDetails = ec_slave[i].CoEdetails;
+        slave.foeDetails = ec_slave[i].FoEdetails;
+        slave.eoeDetails = ec_slave[i].EoEdetails;
+        slave.soeDetails = ec_slave[i].SoEdetails;
+        slave.blockLRW = ec_slave[i].blockLRW;
+        slave.ebusCurrent = ec_slave[i].Ebuscurrent;
+
+        memcpy(slave.sm, ec_slave[i].SM, sizeof(slave.sm));
+        memcpy(slave.smType, ec_slave[i].SMtype, sizeof(slave.smType));
+        memcpy(slave.fmmu, ec_slave[i].FMMU, sizeof(slave.fmmu));
+
+        slave.outputBits = ec_slave[i].Obits;
+        slave.inputBits = ec_slave[i].Ibits;
+        slave.outputsOffset = ec_slave[i].outputs ? static_cast<uint32_t>(ec_slave[i].outputs - base) : NO_OFFSET;
+        slave.inputsOffset = ec_slave[i].inputs ? static_cast<uint32_t>(ec_slave[i].inputs - base) : NO_OFFSET;
+
+        if ((ec_slave[i].mbx_proto & ECT_MBXPROT_COE) && EthercatCOE::readPDOLayout(i, slave.pdoLayout) > 0)
+            slave.flags |= HAS_PDO_LAYOUT;
+
+        config.slaves.push_back(slave);
+    }
+
+    return static_cast<int>(config.slaves.size());
+}
+
+void NetworkConfig::print(const Config &config)
+{
+    std::cout << "Config: " << std::dec << config.slaves.size() << " slave(s), IOmap " << config.iomapSize << " bytes" << std::endl;
+
+    for (size_t i = 0; i < config.slaves.size(); i++)
+    {
+        const SlaveConfig &slave = config.slaves[i];
+
+        std::cout << "\tSlave[" << std::dec << i + 1 << "]: " << slave.name << std::hex
+                  << " vendor 0x" << slave.vendorId
+                  << " product 0x" << slave.productCode
+                  << " rev 0x" << slave.revision << std::dec
+                  << " out " << slave.outputBits << " bits, in " << slave.inputBits << " bits" << std::endl;
+
+        const EthercatCOE::SMAssignment *assignments[] = { &slave.pdoLayout.rxPdo, &slave.pdoLayout.txPdo };
+
+        if (!(slave.flags & HAS_PDO_LAYOUT))
+            continue;
+
+        for (const auto *sm : assignments)
+        {
+            for (int j = 0; j < sm->pdoCount; j++)
+            {
+                std::cout << "\t\t0x" << std::hex << sm->smIndex << " <- 0x" << sm->pdos[j].pdoMappingIndex << ":";
+                for (int k = 0; k < sm->pdos[j].entryCount; k++)
+                {
+                    std::cout << " 0x" << sm->pdos[j].entries[k].index << ":" << std::dec
+                              << static_cast<int>(sm->pdos[j].entries[k].subindex) << "/"
+                              << static_cast<int>(sm->pdos[j].entries[k].bitLength) << std::hex;
+                }
+                std::cout << std::dec << std::endl;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Функция сверки найденных slave с конфигурацией
+ * @details Вызывается после ec_config_init
+ * @param config
+ * @return число несовпадений, 0 - сеть соответствует конфигурации
+ */
+int NetworkConfig::verifyIdentity(const Config &config)
+{
+    if (static_cast<size_t>(ec_slavecount) != config.slaves.size())
+    {
+        std::cout << "Slave count mismatch (found " << ec_slavecount << ", expected " << config.slaves.size() << ")" << std::endl;
+        return 1;
+    }
+
+    int mismatches = 0;
+
+    for (int i = 1; i <= ec_slavecount; i++)
+    {
+        const SlaveConfig &slave = config.slaves[i - 1];
+
+        if (ec_slave[i].eep_man != slave.vendorId || ec_slave[i].eep_id != slave.productCode ||
+            ec_slave[i].eep_rev != slave.revision)
+        {
+            std::cout << "Slave[" << i << "] identity mismatch: found " << std::hex
+                      << "0x" << ec_slave[i].eep_man << "/0x" << ec_slave[i].eep_id << "/0x" << ec_slave[i].eep_rev
+                      << ", expected 0x" << slave.vendorId << "/0x" << slave.productCode << "/0x" << slave.revision
+                      << std::dec << std::endl;
+            mismatches++;
+        }
+    }
+
+    return mismatches;
+}
+
+/**
+ * @brief Функция применения конфигурации перед ec_config_map
+ * @details Для slave с известными SM и размерами PDO выставляется configindex, поэтому SOEM
+ * не читает разметку повторно из CoE/SII. Разметка PDO записывается в slave хуком po2soHook
+ * @param config - должна существовать до окончания ec_config_map
+ * @param forcePdoRewrite - переписывать разметку PDO полностью, а не только отличия
+ */
+void NetworkConfig::apply(const Config &config, bool forcePdoRewrite)
+{
+    activeConfig = &config;
+    forceLayoutRewrite = forcePdoRewrite;
+
+    for (int i = 1; i <= ec_slavecount; i++)
+    {
+        const SlaveConfig &slave = config.slaves[i - 1];
+
+        if (slave.flags & HAS_SII_DETAILS)
+        {
+            ec_slave[i].CoEdetails = slave.coeDetails;
+            ec_slave[i].FoEdetails = slave.foeDetails;
+            ec_slave[i].EoEdetails = slave.eoeDetails;
+            ec_slave[i].SoEdetails = slave.soeDetails;
+        }
+
+        if (slave.flags & HAS_SM)
+        {
+            // SM0/SM1 (mailbox) уже настроены в ec_config_init
+            for (int iSm = 2; iSm < EC_MAXSM; iSm++)
+            {
+                ec_slave[i].SM[iSm] = slave.sm[iSm];
+                ec_slave[i].SMtype[iSm] = slave.smType[iSm];
+            }
+
+            ec_slave[i].Obits = slave.outputBits;
+            ec_slave[i].Ibits = slave.inputBits;
+            ec_slave[i].configindex = static_cast<uint16_t>(i);
+        }
+
+        if (slave.flags & HAS_PDO_LAYOUT)
+            ec_slave[i].PO2SOconfig = po2soHook;
+    }
+}
+
+/**
+ * @brief Параллельная запись разметки PDO всех slave в PreOP
+ * @details Хук po2soHook вызывается SOEM внутри ec_config_map по очереди для каждого slave,
+ * и время запуска растет линейно с числом slave. Здесь разметка пишется заранее пулом из
+ * maxThreads потоков, каждый поток берет следующий slave. Хук успешно синхронизированных
+ * slave снимается, ec_config_map разметку не повторяет. Отчеты печатаются после завершения
+ * @param config - то же, что передано в apply, либо только разметки PDO
+ * @param maxThreads - число одновременных mailbox обменов, 0 - поток на каждый slave
+ * @param forcePdoRewrite - переписывать разметку PDO полностью, а не только отличия
+ * @return число slave с ошибкой записи или проверки
+ */
+int NetworkConfig::syncPdoLayouts(const Config &config, int maxThreads, bool forcePdoRewrite)
+{
+    int slaveCount = ec_slavecount < static_cast<int>(config.slaves.size()) ? ec_slavecount
+                                                                              : static_cast<int>(config.slaves.size());
+    std::vector<EthercatCOE::PDOSyncReport> reports(slaveCount + 1);
+    std::vector<int> results(slaveCount + 1, 0);
+    std::atomic<int> next(1);
+
+    int threadCount = maxThreads > 0 && maxThreads < slaveCount ? maxThreads : slaveCount;
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([&]()
+        {
+            for (int slave = next++; slave <= slaveCount; slave = next++)
+            {
+                if (!(config.slaves[slave - 1].flags & HAS_PDO_LAYOUT))
+                    continue;
+
+                Trace::Scope span(Trace::Category::STARTUP, "PDO layout sync", static_cast<uint16_t>(slave));
+
+                results[slave] = EthercatCOE::syncPDOLayout(static_cast<uint16_t>(slave), config.slaves[slave - 1].pdoLayout,
+                                                            forcePdoRewrite, reports[slave]);
+            }
+        });
+    }
+
+    for (auto &it : threads)
+        it.join();
+
+    int failed = 0;
+
+    for (int i = 1; i <= slaveCount; i++)
+    {
+        if (results[i] == 0)
+            continue;
+
+        EthercatCOE::printPDOSyncReport(static_cast<uint16_t>(i), reports[i]);
+
+        // При ошибке хук остается, ec_config_map повторит запись
+        if (results[i] > 0)
+            ec_slave[i].PO2SOconfig = nullptr;
+        else
+            failed++;
+    }
+
+    return failed;
+}
+
+/**
+ * @brief Функция сверки результата ec_config_map с конфигурацией
+ * @param config
+ * @param ioMap - IOmap, переданный в ec_config_map
+ * @return число несовпадений, 0 - разметка IOmap соответствует конфигурации
+ */
+int NetworkConfig::verifyMapping(const Config &config, const void *ioMap)
+{
+    const uint8_t *base = static_cast<const uint8_t*>(ioMap);
+    int mismatches = 0;
+
+    for (int i = 1; i <= ec_slavecount && static_cast<size_t>(i) <= config.slaves.size(); i++)
+    {
+        const SlaveConfig &slave = config.slaves[i - 1];
+
+        if (ec_slave[i].Obits != slave.outputBits || ec_slave[i].Ibits != slave.inputBits)
+        {
+            std::cout << "Slave[" << i << "] process data size mismatch (out " << ec_slave[i].Obits << "/" << slave.outputBits
+                      << " bits, in " << ec_slave[i].Ibits << "/" << slave.inputBits << " bits)" << std::endl;
+            mismatches++;
+        }
+
+        if ((slave.flags & HAS_OFFSETS) &&
+            ((slave.outputsOffset != NO_OFFSET && ec_slave[i].outputs != base + slave.outputsOffset) ||
+             (slave.inputsOffset != NO_OFFSET && ec_slave[i].inputs != base + slave.inputsOffset)))
+        {
+            std::cout << "Slave[" << i << "] IOmap offset mismatch" << std::endl;
+            mismatches++;
+        }
+
+        if (slave.flags & HAS_FMMU)
+        {
+            for (int j = 0; j < EC_MAXFMMU; j++)
+            {
+                if (ec_slave[i].FMMU[j].LogStart != slave.fmmu[j].LogStart ||
+                    ec_slave[i].FMMU[j].LogLength != slave.fmmu[j].LogLength)
+                {
+                    std::cout << "Slave[" << i << "] FMMU" << j << " mismatch" << std::endl;
+                    mismatches++;
+                }
+            }
+        }
+    }
+
+    return mismatches;
+}
+
+/**
+ * @brief Хук перехода PreOP -> SafeOP, записывающий разметку PDO из активной конфигурации
+ * @details Записываются только отличия от разметки, уже хранящейся в slave
+ * @param slave
+ * @return
+ */
+int NetworkConfig::po2soHook(uint16_t slave)
+{
+    if (activeConfig == nullptr || slave == 0 || slave > activeConfig->slaves.size())
+        return 0;
+
+    const SlaveConfig &slaveConfig = activeConfig->slaves[slave - 1];
+
+    Trace::Scope span(Trace::Category::STARTUP, "PDO layout sync", slave);
+    EthercatCOE::PDOSyncReport report;
+
+    if (EthercatCOE::syncPDOLayout(slave, slaveConfig.pdoLayout, forceLayoutRewrite, report) <= 0)
+        std::cout << "Slave[" << slave << "] PDO layout write failed" << std::endl;
+
+    EthercatCOE::printPDOSyncReport(slave, report);
+
+    return 1;
+}
@@ -0,0 +1,100 @@
+#ifndef NETWORKCONFIG_H
+#define NETWORKCONFIG_H
+
+#include <stdint.h>
+#include <vector>
+#include "ethercat.h"
+#include "EthercatCOE.h"
+
+/**
+ * @brief Предварительно скомпилированная конфигурация сети
+ * @details Конфигурация собирается офлайн из ENI/ESI XML или из дампа предыдущего запуска
+ * и хранится в компактном бинарном виде. При старте мастер только сверяет идентификаторы
+ * slave и применяет готовые разметки PDO, SM и размеры процессных данных, не читая их
+ * повторно через CoE и SII
+ */
+namespace NetworkConfig
+{
+    constexpr uint32_t MAGIC = 0x47464345;      ///< "ECFG"
+    constexpr uint16_t VERSION = 1;
+    constexpr uint32_t NO_OFFSET = 0xFFFFFFFF;  ///< Смещение в IOmap неизвестно (например, для ENI)
+
+    /**
+     * @brief Какие части конфигурации slave заполнены
+     */
+    enum SlaveFlags : uint8_t
+    {
+        HAS_SII_DETAILS = 0x01,     ///< CoE/FoE/EoE/SoE details, blockLRW, ток E-Bus
+        HAS_SM = 0x02,              ///< Настройки SyncManager и размеры процессных данных
+        HAS_FMMU = 0x04,            ///< Настройки FMMU
+        HAS_OFFSETS = 0x08,         ///< Смещения входов/выходов в IOmap
+        HAS_PDO_LAYOUT = 0x10       ///< Разметка PDO
+    };
+
+    struct SlaveConfig
+    {
+        uint8_t flags;
+
+        uint32_t vendorId;
+        uint32_t productCode;
+        uint32_t revision;
+        uint16_t configAddress;
+        char name[EC_MAXNAME + 1];
+
+        uint8_t coeDetails;
+        uint8_t foeDetails;
+        uint8_t eoeDetails;
+        uint8_t soeDetails;
+        uint8_t blockLRW;
+        int16_t ebusCurrent;
+
+        ec_smt sm[EC_MAXSM];
+        uint8_t smType[EC_MAXSM];
+        ec_fmmut fmmu[EC_MAXFMMU];
+
+        uint16_t outputBits;
+        uint16_t inputBits;
+        uint32_t outputsOffset;     ///< Смещение выходов в IOmap, байт
+        uint32_t inputsOffset;      ///< Смещение входов в IOmap, байт
+
+        EthercatCOE::PDOLayout pdoLayout;
+    };
+
+    struct Config
+    {
+        uint32_t iomapSize;
+        std::vector<SlaveConfig> slaves;
+    };
+
+    int compile(const char *inputPath, Config &config);
+    int load(const char *path, Config &config);
+    int save(const char *path, const Config &config);
+    int capture(Config &config, const void *ioMap, int iomapSize);
+    void print(const Config &config);
+
+    /**
+     * @defgroup ConfigStartup
+     * @brief Функции запуска по скомпилированной конфигурации
+     * @details Порядок вызова
+     * 1. - ec_config_init
+     * 2. - verifyIdentity - сверка числа slave и их идентификаторов
+     * 3. - apply - применение SM, размеров PDO, SII details и хука разметки PDO
+     * 3a. - syncPdoLayouts - необязательная параллельная запись разметки PDO вместо хука,
+     *       годится и для конфигурации только из разметок PDO (без apply)
+     * 4. - ec_config_map
+     * 5. - verifyMapping - сверка итоговых смещений IOmap и FMMU
+     *
+     * @{
+     */
+    int verifyIdentity(const Config &config);
+    void apply(const Config &config, bool forcePdoRewrite = false);
+    int syncPdoLayouts(const Config &config, int maxThreads, bool forcePdoRewrite = false);
+    int verifyMapping(const Config &config, const void *ioMap);
+    int po2soHook(uint16_t slave);
+
+    /**
+     * @}
+     */
+}
+
+#endif //NETWORKCONFIG_H
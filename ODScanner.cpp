@@ -0,0 +1,270 @@
+#include "ODScanner.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include "ethercat.h"
+#include "CoeTypes.h"
+#include "Trace.h"
+
+namespace
+{
+    using ODScanner::OutputFormat;
+
+    constexpr size_t FLUSH_THRESHOLD = 48 * 1024;
+    constexpr uint16_t BINARY_VERSION = 1;
+
+    /**
+     * @brief Общий для потоков вывод
+     * @details Потоки пишут целыми блоками, поэтому записи разных slave не перемешиваются внутри строки
+     */
+    struct Output
+    {
+        FILE *file;
+        OutputFormat format;
+        std::mutex mutex;
+
+        void write(std::string &buffer)
+        {
+            if (buffer.empty())
+                return;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            fwrite(buffer.data(), 1, buffer.size(), file);
+            buffer.clear();
+        }
+    };
+
+    void appendJsonString(std::string &buffer, const char *str)
+    {
+        buffer += '"';
+        for (const char *c = str; *c; c++)
+        {
+            switch (*c)
+            {
+            case '"':
+                buffer += "\\\"";
+                break;
+            case '\\':
+                buffer += "\\\\";
+                break;
+            default:
+                if (static_cast<unsigned char>(*c) < 0x20)
+                {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+                    buffer += escaped;
+                }
+                else
+                {
+                    buffer += *c;
+                }
+            }
+        }
+        buffer += '"';
+    }
+
+    template<typename T>
+    void appendBinary(std::string &buffer, T value)
+    {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void appendBinaryString(std::string &buffer, const char *str)
+    {
+        uint8_t length = static_cast<uint8_t>(strnlen(str, EC_MAXNAME));
+        appendBinary(buffer, length);
+        buffer.append(str, length);
+    }
+
+    bool entryExists(const ec_OElistt &oe, int subindex)
+    {
+        return oe.DataType[subindex] != 0 || oe.Name[subindex][0] != '\0';
+    }
+
+    void appendObject(std::string &buffer, OutputFormat format, uint16_t slave,
+                      const ec_ODlistt &od, int item, const ec_OElistt &oe)
+    {
+        int maxSub = od.MaxSub[item];
+
+        if (format == OutputFormat::BINARY)
+        {
+            uint8_t entryCount = 0;
+            for (int j = 0; j <= maxSub; j++)
+                entryCount += entryExists(oe, j) ? 1 : 0;
+
+            appendBinary<uint16_t>(buffer, slave);
+            appendBinary<uint16_t>(buffer, od.Index[item]);
+            appendBinary<uint16_t>(buffer, od.DataType[item]);
+            appendBinary<uint8_t>(buffer, od.ObjectCode[item]);
+            appendBinary<uint8_t>(buffer, od.MaxSub[item]);
+            appendBinary<uint8_t>(buffer, entryCount);
+            appendBinaryString(buffer, od.Name[item]);
+
+            for (int j = 0; j <= maxSub; j++)
+            {
+                if (!entryExists(oe, j))
+                    continue;
+
+                appendBinary<uint8_t>(buffer, static_cast<uint8_t>(j));
+                appendBinary<uint16_t>(buffer, oe.DataType[j]);
+                appendBinary<uint16_t>(buffer, oe.BitLength[j]);
+                appendBinary<uint16_t>(buffer, oe.ObjAccess[j]);
+                appendBinaryString(buffer, oe.Name[j]);
+            }
+            return;
+        }
+
+        char number[96];
+
+        snprintf(number, sizeof(number), "{\"slave\":%u,\"index\":\"0x%04X\",\"objectCode\":%u,\"maxSub\":%u,\"name\":",
+                 slave, od.Index[item], od.ObjectCode[item], od.MaxSub[item]);
+        buffer += number;
+        appendJsonString(buffer, od.Name[item]);
+        buffer += ",\"entries\":[";
+
+        bool first = true;
+
+        for (int j = 0; j <= maxSub; j++)
+        {
+            if (!entryExists(oe, j))
+                continue;
+
+            char typeName[32];
+            CoeTypes::formatDataType(typeName, sizeof(typeName), oe.DataType[j], oe.BitLength[j]);
+
+            snprintf(number, sizeof(number), "%s{\"sub\":%d,\"dataType\":%u,\"bitLength\":%u,\"access\":%u,\"type\":",
+                     first ? "" : ",", j, oe.DataType[j], oe.BitLength[j], oe.ObjAccess[j]);
+            buffer += number;
+            appendJsonString(buffer, typeName);
+            buffer += ",\"name\":";
+            appendJsonString(buffer, oe.Name[j]);
+            buffer += '}';
+            first = false;
+        }
+
+        buffer += "]}\n";
+    }
+
+    /**
+     * @brief Сканирование OD одного slave
+     * @details Для объектов ARRAY/RECORD сабиндекс 0 отдельно не читается: число сабиндексов
+     * уже есть в описании объекта, а ec_readOE читает все записи до MaxSub
+     */
+    void scanSlave(uint16_t slave, Output &output, std::string &buffer,
+                   ec_ODlistt &od, ec_OElistt &oe, ODScanner::ScanResult &result)
+    {
+        Trace::Scope scan(Trace::Category::STARTUP, "OD scan", slave);
+
+        od.Entries = 0;
+
+        {
+            Trace::Scope span(Trace::Category::MAILBOX, "SDO info OD list", slave);
+            int wkc = ec_readODlist(slave, &od);
+
+            span.setBytes(od.Entries * sizeof(uint16_t));
+            span.setResult(wkc);
+
+            if (!wkc)
+            {
+                result.failedSlaves++;
+                return;
+            }
+        }
+
+        for (int i = 0; i < od.Entries; i++)
+        {
+            {
+                Trace::Scope span(Trace::Category::MAILBOX, "SDO info OD description", slave, od.Index[i]);
+                span.setResult(ec_readODdescription(i, &od));
+            }
+
+            oe.Entries = 0;
+            memset(oe.DataType, 0, sizeof(oe.DataType));
+            memset(oe.Name, 0, sizeof(oe.Name));
+
+            {
+                Trace::Scope span(Trace::Category::MAILBOX, "SDO info OE", slave, od.Index[i]);
+                span.setResult(ec_readOE(i, &od, &oe));
+                span.setBytes(oe.Entries);
+            }
+
+            appendObject(buffer, output.format, slave, od, i, oe);
+
+            result.objects++;
+            result.entries += oe.Entries;
+
+            if (buffer.size() >= FLUSH_THRESHOLD)
+                output.write(buffer);
+        }
+
+        result.slaves++;
+    }
+}
+
+/**
+ * @brief Функция параллельного сканирования OD всех slave
+ * @details Slave должны быть в PreOP или выше. Вывод не сбрасывается построчно,
+ * fflush выполняется один раз в конце
+ * @param out - куда писать результат
+ * @param format - JSON Lines или бинарный формат
+ * @param maxThreads - максимум одновременно сканируемых slave, 0 - по числу slave
+ * @return итог сканирования
+ */
+ODScanner::ScanResult ODScanner::scan(FILE *out, OutputFormat format, int maxThreads)
+{
+    Output output;
+    output.file = out;
+    output.format = format;
+
+    if (format == OutputFormat::BINARY)
+    {
+        std::string header;
+        appendBinary<uint32_t>(header, BINARY_MAGIC);
+        appendBinary<uint16_t>(header, BINARY_VERSION);
+        output.write(header);
+    }
+
+    int threadCount = maxThreads > 0 && maxThreads < ec_slavecount ? maxThreads : ec_slavecount;
+    std::atomic<int> nextSlave(1);
+    std::vector<ScanResult> results(threadCount, ScanResult{0, 0, 0, 0});
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([&, t]()
+        {
+            // Буферы OD занимают десятки килобайт, поэтому размещаются в куче, по одному на поток
+            std::unique_ptr<ec_ODlistt> od(new ec_ODlistt);
+            std::unique_ptr<ec_OElistt> oe(new ec_OElistt);
+            std::string buffer;
+            buffer.reserve(FLUSH_THRESHOLD * 2);
+
+            for (int slave = nextSlave++; slave <= ec_slavecount; slave = nextSlave++)
+                scanSlave(static_cast<uint16_t>(slave), output, buffer, *od, *oe, results[t]);
+
+            output.write(buffer);
+        });
+    }
+
+    for (auto &it : threads)
+        it.join();
+
+    fflush(out);
+
+    ScanResult total{0, 0, 0, 0};
+
+    for (const auto &it : results)
+    {
+        total.slaves += it.slaves;
+        total.failedSlaves += it.failedSlaves;
+        total.objects += it.objects;
+        total.entries += it.entries;
+    }
+
+    return total;
+}
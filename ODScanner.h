@@ -0,0 +1,37 @@
+#ifndef ODSCANNER_H
+#define ODSCANNER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @brief Параллельное сканирование словарей объектов (OD) всех slave
+ * @details Каждый slave сканируется в своем потоке со своими буферами ec_ODlistt/ec_OElistt.
+ * Результат пишется потоком в JSON Lines (одна строка на индекс) либо в компактный
+ * бинарный формат. Записи копятся в буферах потоков и сбрасываются крупными блоками
+ */
+namespace ODScanner
+{
+    enum class OutputFormat : uint8_t
+    {
+        JSON_LINES = 0,
+        BINARY
+    };
+
+    constexpr uint32_t BINARY_MAGIC = 0x4353444F;     ///< "ODSC"
+
+    /**
+     * @brief Итог сканирования
+     */
+    struct ScanResult
+    {
+        int slaves;         ///< Число просканированных slave
+        int failedSlaves;   ///< Число slave, у которых не удалось прочитать список OD
+        int objects;        ///< Число индексов
+        int entries;        ///< Число сабиндексов
+    };
+
+    ScanResult scan(FILE *out, OutputFormat format, int maxThreads);
+}
+
+#endif //ODSCANNER_H
@@ -0,0 +1,416 @@
+#include "PdoRemap.h"
+
+#include <iostream>
+#include "ethercat.h"
+#include "CycleTiming.h"
+#include "Trace.h"
+
+namespace
+{
+    constexpr uint8_t SM_TYPE_OUTPUTS = 3;
+    constexpr uint8_t SM_TYPE_INPUTS = 4;
+    constexpr uint8_t FMMU_TYPE_INPUTS = 1;
+    constexpr uint8_t FMMU_TYPE_OUTPUTS = 2;
+
+    /**
+     * @param acknowledge - подтвердить ошибку AL, без этого slave с флагом ошибки не меняет состояние
+     */
+    bool setState(uint16_t slave, uint16_t state, bool acknowledge = false)
+    {
+        Trace::Scope span(Trace::Category::STATE, "State change", slave, state);
+
+        ec_slave[slave].state = acknowledge ? state | EC_STATE_ACK : state;
+        ec_writestate(slave);
+
+        uint16_t reached = ec_statecheck(slave, state, EC_TIMEOUTSTATE);
+        span.setResult(reached);
+
+        return reached == state;
+    }
+
+    /**
+     * @brief Поиск единственного SM процессных данных заданного типа
+     * @return номер SM, -1 - нет или несколько
+     */
+    int findSM(uint16_t slave, uint8_t type)
+    {
+        int found = -1;
+
+        for (int i = 2; i < EC_MAXSM; i++)
+        {
+            if (ec_slave[slave].SMtype[i] != type || ec_slave[slave].SM[i].SMlength == 0)
+                continue;
+
+            if (found >= 0)
+                return -1;
+
+            found = i;
+        }
+
+        return found;
+    }
+
+    int findFMMU(uint16_t slave, uint8_t type)
+    {
+        int found = -1;
+
+        for (int i = 0; i < EC_MAXFMMU; i++)
+        {
+            if (!ec_slave[slave].FMMU[i].FMMUactive || ec_slave[slave].FMMU[i].FMMUtype != type)
+                continue;
+
+            if (found >= 0)
+                return -1;
+
+            found = i;
+        }
+
+        return found;
+    }
+
+    int resizeDirection(uint16_t slave, uint8_t smType, uint8_t fmmuType, uint32_t bits)
+    {
+        int sm = findSM(slave, smType);
+        int fmmu = findFMMU(slave, fmmuType);
+
+        if (sm < 0 || fmmu < 0)
+            return -1;
+
+        ec_slavet &s = ec_slave[slave];
+        uint16_t bytes = static_cast<uint16_t>((bits + 7) / 8);
+
+        s.SM[sm].SMlength = bytes;
+        s.FMMU[fmmu].LogLength = bytes;
+        s.FMMU[fmmu].LogEndbit = static_cast<uint8_t>((s.FMMU[fmmu].LogStartbit + bits - 1) % 8);
+
+        int wkc = ec_FPWR(s.configadr, ECT_REG_SM0 + sm * sizeof(ec_smt), sizeof(ec_smt), &s.SM[sm], EC_TIMEOUTRET);
+        wkc += ec_FPWR(s.configadr, ECT_REG_FMMU0 + fmmu * sizeof(ec_fmmut), sizeof(ec_fmmut), &s.FMMU[fmmu], EC_TIMEOUTRET);
+
+        return wkc == 2 ? 1 : -1;
+    }
+
+    /**
+     * @brief Проверка, что объекты bound идут первыми в layout в том же порядке
+     * @details При совпадении объектов совпадают и их битовые смещения в процессных данных
+     */
+    bool startsWith(const EthercatCOE::SMAssignment &layout, const EthercatCOE::SMAssignment &bound)
+    {
+        int pdo = 0;
+        int entry = 0;
+
+        for (int i = 0; i < bound.pdoCount; i++)
+        {
+            for (int j = 0; j < bound.pdos[i].entryCount; j++)
+            {
+                while (pdo < layout.pdoCount && entry >= layout.pdos[pdo].entryCount)
+                {
+                    pdo++;
+                    entry = 0;
+                }
+
+                if (pdo >= layout.pdoCount)
+                    return false;
+
+                const EthercatCOE::PDOEntry &expected = bound.pdos[i].entries[j];
+                const EthercatCOE::PDOEntry &actual = layout.pdos[pdo].entries[entry++];
+
+                if (actual.index != expected.index || actual.subindex != expected.subindex ||
+                    actual.bitLength != expected.bitLength)
+                    return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+/**
+ * @brief Суммарная длина объектов, назначенных в SyncManager
+ * @return длина в битах
+ */
+int PdoRemap::layoutBits(const EthercatCOE::SMAssignment &assignment)
+{
+    int bits = 0;
+
+    for (int i = 0; i < assignment.pdoCount; i++)
+    {
+        for (int j = 0; j < assignment.pdos[i].entryCount; j++)
+            bits += assignment.pdos[i].entries[j].bitLength;
+    }
+
+    return bits;
+}
+
+/**
+ * @brief Проверка, что разметка помещается в часть IOmap slave
+ * @details Направление не может появиться или исчезнуть, иначе изменится ожидаемый wkc
+ * сегмента. Поддерживаются slave с одним SM и одним FMMU на направление
+ * @return 1 - подходит, -1 - не помещается, меняет направления, либо SM/FMMU не единственные
+ */
+int PdoRemap::checkLayout(uint16_t slave, const Allocation &allocation, uint32_t outputBits, uint32_t inputBits)
+{
+    if ((outputBits + 7) / 8 > allocation.outputBytes || (inputBits + 7) / 8 > allocation.inputBytes)
+        return -1;
+
+    if ((outputBits == 0) != (allocation.outputBytes == 0) || (inputBits == 0) != (allocation.inputBytes == 0))
+        return -1;
+
+    if (outputBits && (findSM(slave, SM_TYPE_OUTPUTS) < 0 || findFMMU(slave, FMMU_TYPE_OUTPUTS) < 0))
+        return -1;
+
+    if (inputBits && (findSM(slave, SM_TYPE_INPUTS) < 0 || findFMMU(slave, FMMU_TYPE_INPUTS) < 0))
+        return -1;
+
+    return 1;
+}
+
+/**
+ * @brief Проверка, что новая разметка сохраняет объекты закрепленной на тех же смещениях
+ * @details Объекты могут добавляться только после закрепленных
+ */
+bool PdoRemap::keepsEntries(const EthercatCOE::PDOLayout &bound, const EthercatCOE::PDOLayout &layout)
+{
+    return startsWith(layout.rxPdo, bound.rxPdo) && startsWith(layout.txPdo, bound.txPdo);
+}
+
+/**
+ * @brief Изменение длины процессных данных slave в пределах его части IOmap
+ * @details Slave должен быть в PreOP, разметка проверена checkLayout
+ * @return 1 - успех, -1 - SM/FMMU не удалось записать
+ */
+int PdoRemap::resizeProcessData(uint16_t slave, uint32_t outputBits, uint32_t inputBits)
+{
+    ec_slavet &s = ec_slave[slave];
+
+    if (outputBits && resizeDirection(slave, SM_TYPE_OUTPUTS, FMMU_TYPE_OUTPUTS, outputBits) < 0)
+        return -1;
+
+    if (inputBits && resizeDirection(slave, SM_TYPE_INPUTS, FMMU_TYPE_INPUTS, inputBits) < 0)
+        return -1;
+
+    // Указатели outputs/inputs остаются прежними, меняется только занятая длина, выделенная
+    // часть IOmap хранится в Remapper
+    s.Obits = static_cast<uint16_t>(outputBits);
+    s.Obytes = (outputBits + 7) / 8;
+    s.Ibits = static_cast<uint16_t>(inputBits);
+    s.Ibytes = (inputBits + 7) / 8;
+
+    return 1;
+}
+
+PdoRemap::Remapper::~Remapper()
+{
+    if (worker.joinable())
+        worker.join();
+}
+
+/**
+ * @brief Запоминание частей IOmap всех slave
+ * @details Вызывается после ec_config_map до первой перенастройки. Obytes/Ibytes дальше
+ * хранят занятую длину, после уменьшения разметки она меньше выделенной, и возврат
+ * к исходной разметке проверяется по сохраненному размеру
+ */
+void PdoRemap::Remapper::init()
+{
+    allocations.assign(ec_slavecount + 1, Allocation{});
+
+    for (int i = 1; i <= ec_slavecount; i++)
+        allocations[i] = {ec_slave[i].Obytes, ec_slave[i].Ibytes};
+}
+
+/**
+ * @brief Закрепление разметки slave, процессные данные которого читает цикл
+ * @details Цикл обращается к данным по фиксированным смещениям, поэтому перенастройка
+ * такого slave допускается, только если объекты остаются на своих местах (keepsEntries)
+ */
+void PdoRemap::Remapper::bind(uint16_t slave, const EthercatCOE::PDOLayout &layout)
+{
+    bindings.push_back({slave, layout});
+}
+
+/**
+ * @brief Запуск перенастройки в отдельном потоке
+ * @details Вся проверка разметки выполняется до того, как slave будет выведен из OP.
+ * Поток наследует политику планирования вызывающего, поэтому start() вызывается не из цикла
+ * @return false - перенастройка уже идет, не было init(), разметка не подходит (checkLayout)
+ * либо сдвигает объекты закрепленного slave (bind)
+ */
+bool PdoRemap::Remapper::start(uint16_t slave, const EthercatCOE::PDOLayout &newLayout)
+{
+    if (running.load() || worker.joinable() || slave == 0 || slave >= allocations.size())
+        return false;
+
+    uint32_t outputBits = layoutBits(newLayout.rxPdo);
+    uint32_t inputBits = layoutBits(newLayout.txPdo);
+
+    if (checkLayout(slave, allocations[slave], outputBits, inputBits) < 0)
+        return false;
+
+    for (const auto &binding : bindings)
+    {
+        if (binding.slave == slave && !keepsEntries(binding.layout, newLayout))
+            return false;
+    }
+
+    layout = newLayout;
+    report = Report();
+    report.slave = slave;
+    report.oldOutputBits = ec_slave[slave].Obits;
+    report.oldInputBits = ec_slave[slave].Ibits;
+    report.outputBits = outputBits;
+    report.inputBits = inputBits;
+
+    slaveWkc = (allocations[slave].outputBytes ? 2 : 0) + (allocations[slave].inputBytes ? 1 : 0);
+    lowWkc.store(0);
+    segmentLowWkc.store(0);
+    startCycle = currentCycle.load();
+    done.store(false);
+    running.store(true);
+
+    worker = std::thread(&Remapper::run, this);
+
+    return true;
+}
+
+void PdoRemap::Remapper::run()
+{
+    uint16_t slave = report.slave;
+    int64_t start = CycleTiming::nowNs();
+    int64_t mark = start;
+    EthercatCOE::PDOLayout previous;
+    bool mappingChanged = false;
+
+    auto phase = [&mark]()
+    {
+        int64_t now = CycleTiming::nowNs();
+        int64_t elapsed = now - mark;
+        mark = now;
+        return elapsed;
+    };
+
+    report.success = false;
+    report.restored = false;
+
+    // Без прежней разметки откатывать нечего, поэтому slave не выводится из OP
+    if (EthercatCOE::readPDOLayout(slave, previous) < 0)
+    {
+        report.error = "current PDO layout read failed";
+        report.restored = true;
+    }
+    else
+    {
+        report.readNs = phase();
+
+        if (!setState(slave, EC_STATE_PRE_OP))
+        {
+            report.error = "slave didn't reach PreOP";
+        }
+        else
+        {
+            report.preOpNs = phase();
+            mappingChanged = true;
+
+            if (EthercatCOE::applyPDOLayout(slave, layout) < 0)
+            {
+                report.error = "PDO layout write failed";
+            }
+            else
+            {
+                report.mappingNs = phase();
+
+                if (resizeProcessData(slave, report.outputBits, report.inputBits) < 0)
+                {
+                    report.error = "SM/FMMU resize failed";
+                }
+                else
+                {
+                    report.remapNs = phase();
+
+                    if (!setState(slave, EC_STATE_SAFE_OP) || !setState(slave, EC_STATE_OPERATIONAL))
+                    {
+                        report.error = "slave didn't return to OP";
+                    }
+                    else
+                    {
+                        report.opNs = phase();
+                        report.success = true;
+                    }
+                }
+            }
+        }
+
+        if (!report.success)
+            report.restored = restore(previous, mappingChanged);
+    }
+
+    report.totalNs = CycleTiming::nowNs() - start;
+    report.cycles = currentCycle.load() - startCycle;
+    report.lowWkcCycles = lowWkc.load();
+    report.segmentLowWkcCycles = segmentLowWkc.load();
+
+    running.store(false);
+    done.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Откат к прежней разметке после ошибки
+ * @details Slave может стоять в PreOP или SafeOP с флагом ошибки AL, поэтому ошибка
+ * подтверждается. Если разметка не менялась и slave остался в OP, ничего не делается
+ * @return true - slave снова в OP с прежней разметкой
+ */
+bool PdoRemap::Remapper::restore(const EthercatCOE::PDOLayout &previous, bool mappingChanged)
+{
+    uint16_t slave = report.slave;
+
+    if (!mappingChanged && ec_slave[slave].state == EC_STATE_OPERATIONAL)
+        return true;
+
+    if (mappingChanged)
+    {
+        if (!setState(slave, EC_STATE_PRE_OP, true))
+            return false;
+
+        if (EthercatCOE::applyPDOLayout(slave, previous) < 0 ||
+            resizeProcessData(slave, report.oldOutputBits, report.oldInputBits) < 0)
+            return false;
+    }
+
+    return setState(slave, EC_STATE_SAFE_OP, true) && setState(slave, EC_STATE_OPERATIONAL);
+}
+
+/**
+ * @brief Проверка завершения перенастройки
+ * @details Не блокирует: поток присоединяется только после того, как выставил done
+ * @return true - перенастройка завершена, report заполнен (один раз на каждый start)
+ */
+bool PdoRemap::Remapper::finished(Report &result)
+{
+    if (!done.load(std::memory_order_acquire))
+        return false;
+
+    worker.join();
+    done.store(false);
+    result = report;
+
+    return true;
+}
+
+void PdoRemap::printReport(const Report &report)
+{
+    std::cout << "PDO remap of slave " << report.slave << ": " << (report.success ? "done" : report.error)
+              << ", outputs " << report.oldOutputBits << " -> " << report.outputBits
+              << " bits, inputs " << report.oldInputBits << " -> " << report.inputBits << " bits" << std::endl;
+
+    if (!report.success)
+    {
+        std::cout << "\t" << (report.restored ? "previous layout kept, slave in OP" :
+                                                 "previous layout NOT restored, slave left out of OP") << std::endl;
+    }
+
+    std::cout << "\ttotal " << report.totalNs / 1000000.0 << " ms (read " << report.readNs / 1000000.0
+              << ", PreOP " << report.preOpNs / 1000000.0
+              << ", mapping " << report.mappingNs / 1000000.0 << ", SM/FMMU " << report.remapNs / 1000000.0
+              << ", OP " << report.opNs / 1000000.0 << ")" << std::endl;
+    std::cout << "\t" << report.cycles << " cycles, " << report.lowWkcCycles << " with reduced wkc, "
+              << report.segmentLowWkcCycles << " affecting other slaves" << std::endl;
+}
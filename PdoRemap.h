@@ -0,0 +1,129 @@
+#ifndef PDOREMAP_H
+#define PDOREMAP_H
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "EthercatCOE.h"
+
+/**
+ * @brief Перенастройка PDO одного slave без остановки сегмента
+ * @details Размеры, направления и SM/FMMU проверяются в start(), до того как slave покинет OP.
+ * Дальше в отдельном потоке, пока цикл продолжает обмен с остальными slave
+ * 1. - текущая разметка читается через EthercatCOE::readPDOLayout для отката
+ * 2. - slave переводится в PreOP
+ * 3. - новая разметка записывается через EthercatCOE::applyPDOLayout
+ * 4. - длины SM2/SM3 и FMMU slave меняются в пределах выделенной ему части IOmap
+ * 5. - slave возвращается в SafeOP и OP
+ * При ошибке на шагах 2-5 записывается прежняя разметка и slave возвращается в OP.
+ * Раскладка IOmap, длина кадра и смещения остальных slave не меняются, поэтому новая
+ * разметка не может быть больше части IOmap, выделенной slave при ec_config_map.
+ * Slave, чьи данные цикл читает через фиксированные структуры, закрепляется через bind():
+ * его новая разметка должна начинаться с тех же объектов, что и закрепленная
+ */
+namespace PdoRemap
+{
+    /**
+     * @brief Часть IOmap slave, выделенная ec_config_map
+     */
+    struct Allocation
+    {
+        uint32_t outputBytes;
+        uint32_t inputBytes;
+    };
+
+    struct Report
+    {
+        uint16_t slave;
+        bool success;
+        bool restored;              ///< После ошибки прежняя разметка записана и slave снова в OP
+        const char *error;
+
+        uint32_t oldOutputBits;
+        uint32_t oldInputBits;
+        uint32_t outputBits;
+        uint32_t inputBits;
+
+        int64_t readNs;             ///< Чтение текущей разметки для отката
+        int64_t preOpNs;
+        int64_t mappingNs;
+        int64_t remapNs;
+        int64_t opNs;
+        int64_t totalNs;
+
+        uint64_t cycles;            ///< Циклов за время перенастройки
+        uint64_t lowWkcCycles;      ///< Циклов с wkc ниже ожидаемого
+        uint64_t segmentLowWkcCycles;   ///< Циклов, где wkc упал ниже вклада остальных slave
+    };
+
+    int layoutBits(const EthercatCOE::SMAssignment &assignment);
+    int checkLayout(uint16_t slave, const Allocation &allocation, uint32_t outputBits, uint32_t inputBits);
+    bool keepsEntries(const EthercatCOE::PDOLayout &bound, const EthercatCOE::PDOLayout &layout);
+    int resizeProcessData(uint16_t slave, uint32_t outputBits, uint32_t inputBits);
+
+    class Remapper
+    {
+    public:
+        ~Remapper();
+
+        void init();
+        void bind(uint16_t slave, const EthercatCOE::PDOLayout &layout);
+        bool start(uint16_t slave, const EthercatCOE::PDOLayout &layout);
+        bool finished(Report &report);
+
+        bool active() const
+        {
+            return running.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Учет цикла, вызывается циклом после приема кадра
+         * @details Пока перенастройки нет - одна атомарная загрузка
+         */
+        void observe(uint64_t cycle, int wkc, int expectedWkc)
+        {
+            currentCycle.store(cycle, std::memory_order_relaxed);
+
+            if (!running.load(std::memory_order_relaxed))
+                return;
+
+            if (wkc < expectedWkc)
+                lowWkc.fetch_add(1, std::memory_order_relaxed);
+
+            if (wkc < expectedWkc - slaveWkc)
+                segmentLowWkc.fetch_add(1, std::memory_order_relaxed);
+        }
+
+    private:
+        /**
+         * @brief Разметка slave, которую читает цикл
+         */
+        struct Binding
+        {
+            uint16_t slave;
+            EthercatCOE::PDOLayout layout;
+        };
+
+        void run();
+        bool restore(const EthercatCOE::PDOLayout &previous, bool mappingChanged);
+
+        std::thread worker;
+        std::atomic<bool> running{false};
+        std::atomic<bool> done{false};
+        std::atomic<uint64_t> currentCycle{0};
+        std::atomic<uint64_t> lowWkc{0};
+        std::atomic<uint64_t> segmentLowWkc{0};
+
+        std::vector<Allocation> allocations;    ///< По номеру slave, заполняется в init()
+        std::vector<Binding> bindings;
+        int slaveWkc = 0;       ///< Вклад перенастраиваемого slave в wkc
+        uint64_t startCycle = 0;
+        EthercatCOE::PDOLayout layout;
+        Report report;
+    };
+
+    void printReport(const Report &report);
+}
+
+#endif //PDOREMAP_H
@@ -0,0 +1,206 @@
+#include "ProcessImage.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    size_t alignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+}
+
+ProcessImage::Publisher::~Publisher()
+{
+    close();
+}
+
+/**
+ * @brief Создание сегмента разделяемой памяти
+ * @param name - имя сегмента shm_open, например "/ethercat-test"
+ * @param ioMap - IOmap мастера, копируется целиком каждый цикл
+ * @param iomapSize - результат ec_config_map
+ * @param slaves - положение данных каждого slave в IOmap
+ * @param slaveCount
+ * @param axisCount - число осей в CycleInfo::axisStates
+ * @return true - сегмент создан
+ */
+bool ProcessImage::Publisher::open(const char *name, const void *ioMap, uint32_t iomapSize,
+                                   const SlaveEntry *slaves, uint16_t slaveCount, uint16_t axisCount)
+{
+    close();
+
+    size_t dataOffset = alignUp(sizeof(Header) + slaveCount * sizeof(SlaveEntry), 64);
+    size_t size = dataOffset + iomapSize;
+
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+
+    if (fd < 0)
+        return false;
+
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (memory == MAP_FAILED)
+        return false;
+
+    // Страницы сегмента заранее подгружаются, чтобы первая публикация в цикле не вызвала page fault
+    memset(memory, 0, size);
+
+    header = static_cast<Header*>(memory);
+    data = static_cast<uint8_t*>(memory) + dataOffset;
+    this->ioMap = ioMap;
+    mapSize = size;
+    strncpy(this->name, name, sizeof(this->name) - 1);
+
+    memcpy(reinterpret_cast<uint8_t*>(memory) + sizeof(Header), slaves, slaveCount * sizeof(SlaveEntry));
+
+    header->slaveCount = slaveCount;
+    header->axisCount = axisCount > MAX_AXES ? MAX_AXES : axisCount;
+    header->iomapSize = iomapSize;
+    header->dataOffset = static_cast<uint32_t>(dataOffset);
+    header->sequence.store(0, std::memory_order_relaxed);
+    header->version = VERSION;
+
+    // magic пишется последним: читатель не примет сегмент, пока заголовок не заполнен
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = MAGIC;
+
+    return true;
+}
+
+void ProcessImage::Publisher::close()
+{
+    if (header == nullptr)
+        return;
+
+    munmap(header, mapSize);
+    shm_unlink(name);
+
+    header = nullptr;
+    data = nullptr;
+}
+
+void ProcessImage::Publisher::copyIomap()
+{
+    memcpy(data, ioMap, header->iomapSize);
+}
+
+ProcessImage::Subscriber::~Subscriber()
+{
+    close();
+}
+
+/**
+ * @brief Подключение к сегменту, созданному Publisher
+ * @param name - имя сегмента shm_open
+ * @return true - сегмент найден и заголовок корректен
+ */
+bool ProcessImage::Subscriber::open(const char *name)
+{
+    close();
+
+    int fd = shm_open(name, O_RDONLY, 0);
+
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void *memory = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (memory == MAP_FAILED)
+        return false;
+
+    const Header *mapped = static_cast<const Header*>(memory);
+
+    if (mapped->magic != MAGIC || mapped->version != VERSION ||
+        mapped->dataOffset + mapped->iomapSize > static_cast<size_t>(st.st_size))
+    {
+        munmap(memory, st.st_size);
+        return false;
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    header = mapped;
+    data = static_cast<const uint8_t*>(memory) + mapped->dataOffset;
+    mapSize = st.st_size;
+
+    return true;
+}
+
+void ProcessImage::Subscriber::close()
+{
+    if (header == nullptr)
+        return;
+
+    munmap(const_cast<Header*>(header), mapSize);
+
+    header = nullptr;
+    data = nullptr;
+}
+
+bool ProcessImage::Subscriber::read(CycleInfo &info, void *iomap, size_t size, int maxRetries) const
+{
+    if (header == nullptr)
+        return false;
+
+    size_t copySize = size < header->iomapSize ? size : header->iomapSize;
+
+    for (int i = 0; i < maxRetries; i++)
+    {
+        uint32_t begin = header->sequence.load(std::memory_order_acquire);
+
+        if (begin & 1)
+            continue;
+
+        info = header->info;
+        if (iomap != nullptr)
+            memcpy(iomap, data, copySize);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (header->sequence.load(std::memory_order_relaxed) == begin)
+            return true;
+    }
+
+    return false;
+}
+
+uint32_t ProcessImage::Subscriber::iomapSize() const
+{
+    return header ? header->iomapSize : 0;
+}
+
+uint16_t ProcessImage::Subscriber::slaveCount() const
+{
+    return header ? header->slaveCount : 0;
+}
+
+uint16_t ProcessImage::Subscriber::axisCount() const
+{
+    return header ? header->axisCount : 0;
+}
+
+const ProcessImage::SlaveEntry *ProcessImage::Subscriber::slaves() const
+{
+    return header ? reinterpret_cast<const SlaveEntry*>(reinterpret_cast<const uint8_t*>(header) + sizeof(Header)) : nullptr;
+}
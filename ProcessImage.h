@@ -0,0 +1,135 @@
+#ifndef PROCESSIMAGE_H
+#define PROCESSIMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/**
+ * @brief Публикация процессного образа в разделяемую память
+ * @details Каждый цикл мастер копирует IOmap (выходы и входы) и метаданные цикла в сегмент
+ * POSIX shared memory. Запись защищена seqlock: писатель никогда не ждет читателей,
+ * читатель повторяет чтение, если попал на запись, и никогда не видит разорванных данных.
+ * Стоимость публикации для цикла - один memcpy IOmap вне зависимости от числа читателей
+ *
+ * Раскладка сегмента: Header | SlaveEntry[slaveCount] | IOmap (выровнен на 64 байта)
+ */
+namespace ProcessImage
+{
+    constexpr uint32_t MAGIC = 0x474D4950;      ///< "PIMG"
+    constexpr uint16_t VERSION = 1;
+    constexpr int MAX_AXES = 32;
+    constexpr const char *DEFAULT_NAME = "/ethercat-test";
+
+    /**
+     * @brief Положение процессных данных slave в IOmap
+     */
+    struct SlaveEntry
+    {
+        uint32_t outputsOffset;
+        uint32_t outputsSize;
+        uint32_t inputsOffset;
+        uint32_t inputsSize;
+    };
+
+    /**
+     * @brief Метаданные цикла
+     */
+    struct CycleInfo
+    {
+        uint64_t cycle;
+        int64_t timestampNs;        ///< CLOCK_MONOTONIC
+        int32_t wkc;
+        int32_t expectedWkc;
+        uint8_t axisStates[MAX_AXES];
+    };
+
+    struct Header
+    {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t slaveCount;
+        uint16_t axisCount;
+        uint32_t iomapSize;
+        uint32_t dataOffset;        ///< Смещение копии IOmap от начала сегмента
+
+        alignas(64) std::atomic<uint32_t> sequence;     ///< Нечетное значение - идет запись
+        CycleInfo info;
+    };
+
+    /**
+     * @brief Писатель процессного образа, используется циклом мастера
+     */
+    class Publisher
+    {
+    public:
+        ~Publisher();
+
+        bool open(const char *name, const void *ioMap, uint32_t iomapSize,
+                  const SlaveEntry *slaves, uint16_t slaveCount, uint16_t axisCount);
+        void close();
+
+        /**
+         * @brief Публикация цикла
+         * @details Не выделяет память и не делает системных вызовов
+         */
+        void publish(const CycleInfo &info)
+        {
+            if (header == nullptr)
+                return;
+
+            uint32_t sequence = header->sequence.load(std::memory_order_relaxed);
+
+            header->sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            header->info = info;
+            copyIomap();
+
+            header->sequence.store(sequence + 2, std::memory_order_release);
+        }
+
+    private:
+        void copyIomap();
+
+        Header *header = nullptr;
+        uint8_t *data = nullptr;
+        const void *ioMap = nullptr;
+        size_t mapSize = 0;
+        char name[64] = { 0 };
+    };
+
+    /**
+     * @brief Читатель процессного образа для внешних процессов (HMI, логгер, супервизор)
+     */
+    class Subscriber
+    {
+    public:
+        ~Subscriber();
+
+        bool open(const char *name);
+        void close();
+
+        /**
+         * @brief Согласованный снимок последнего цикла
+         * @param info - метаданные цикла
+         * @param iomap - буфер под копию IOmap, может быть nullptr
+         * @param size - размер буфера, копируется не больше iomapSize()
+         * @param maxRetries - число попыток, если писатель занят
+         * @return true - снимок согласован
+         */
+        bool read(CycleInfo &info, void *iomap, size_t size, int maxRetries = 1000) const;
+
+        uint32_t iomapSize() const;
+        uint16_t slaveCount() const;
+        uint16_t axisCount() const;
+        const SlaveEntry *slaves() const;
+
+    private:
+        const Header *header = nullptr;
+        const uint8_t *data = nullptr;
+        size_t mapSize = 0;
+    };
+}
+
+#endif //PROCESSIMAGE_H
@@ -0,0 +1,305 @@
+#include "RtGuard.h"
+
+#include <atomic>
+#include <iostream>
+#include <alloca.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <execinfo.h>
+#include <malloc.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+extern "C"
+{
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *ptr, size_t size);
+    void *__libc_memalign(size_t alignment, size_t size);
+    void *__libc_valloc(size_t size);
+}
+
+namespace
+{
+    using RtGuard::Mode;
+    using RtGuard::ViolationKind;
+
+    std::atomic<Mode> guardMode(Mode::OFF);
+
+    thread_local bool armed = false;
+    thread_local bool inHook = false;
+    thread_local uint64_t currentCycle = 0;
+    thread_local rusage cycleStart;
+
+    std::atomic<uint64_t> allocations(0);
+    std::atomic<uint64_t> minorFaults(0);
+    std::atomic<uint64_t> majorFaults(0);
+    std::atomic<uint64_t> guardedCycles(0);
+
+    RtGuard::Violation violations[RtGuard::MAX_VIOLATIONS];
+    std::atomic<uint32_t> violationCount(0);
+
+    const char *kindName(ViolationKind kind)
+    {
+        switch (kind)
+        {
+        case ViolationKind::ALLOCATION:
+            return "allocation";
+        case ViolationKind::MINOR_FAULT:
+            return "minor page fault";
+        case ViolationKind::MAJOR_FAULT:
+            return "major page fault";
+        }
+        return "unknown";
+    }
+
+    /**
+     * @brief Запись нарушения
+     * @details Не выделяет память: нарушения пишутся в статический массив, при его
+     * заполнении учитываются только счетчики
+     */
+    void recordViolation(ViolationKind kind, uint64_t value, bool withBacktrace)
+    {
+        uint32_t index = violationCount.fetch_add(1, std::memory_order_relaxed);
+
+        if (index < RtGuard::MAX_VIOLATIONS)
+        {
+            RtGuard::Violation &violation = violations[index];
+
+            violation.kind = kind;
+            violation.cycle = currentCycle;
+            violation.value = value;
+            violation.frames = withBacktrace ? backtrace(violation.backtrace, RtGuard::MAX_FRAMES) : 0;
+        }
+
+        if (guardMode.load(std::memory_order_relaxed) == Mode::TRAP)
+        {
+            static const char message[] = "RtGuard: violation inside real-time cycle\n";
+            write(STDERR_FILENO, message, sizeof(message) - 1);
+
+            if (index < RtGuard::MAX_VIOLATIONS)
+                backtrace_symbols_fd(violations[index].backtrace, violations[index].frames, STDERR_FILENO);
+
+            abort();
+        }
+    }
+
+    inline void onAllocation(size_t size)
+    {
+        if (!armed || inHook)
+            return;
+
+        inHook = true;
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        recordViolation(ViolationKind::ALLOCATION, size, true);
+        inHook = false;
+    }
+
+    /**
+     * @brief Подгрузка страниц стека на заданную глубину
+     */
+    __attribute__((noinline)) void prefaultStack(size_t stackBytes)
+    {
+        volatile char *stack = static_cast<volatile char*>(alloca(stackBytes));
+        long pageSize = sysconf(_SC_PAGESIZE);
+
+        for (size_t i = 0; i < stackBytes; i += pageSize)
+            stack[i] = 0;
+    }
+}
+
+// Перехват выделений памяти. operator new из libstdc++ также проходит через malloc
+extern "C" void *malloc(size_t size)
+{
+    onAllocation(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    onAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    onAllocation(size);
+    return __libc_realloc(ptr, size);
+}
+
+// Выделения с выравниванием не проходят через malloc, IOmap выделяется через aligned_alloc
+extern "C" void *memalign(size_t alignment, size_t size)
+{
+    onAllocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" void *aligned_alloc(size_t alignment, size_t size)
+{
+    onAllocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+    onAllocation(size);
+
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+
+    void *memory = __libc_memalign(alignment, size);
+
+    if (memory == nullptr)
+        return ENOMEM;
+
+    *ptr = memory;
+    return 0;
+}
+
+extern "C" void *valloc(size_t size)
+{
+    onAllocation(size);
+    return __libc_valloc(size);
+}
+
+/**
+ * @brief Подготовка памяти процесса к работе в реальном времени
+ * @details Вызывается до перехода в OP. Блокирует всю текущую и будущую память процесса,
+ * запрещает malloc возвращать память системе и использовать mmap, заранее подгружает
+ * страницы стека и кучи
+ * @param stackBytes - глубина стека, которая будет подгружена
+ * @param heapBytes - объем кучи, который будет подгружен
+ * @return 0 - успех, -1 - mlockall не выполнен (нужны права root или CAP_IPC_LOCK)
+ */
+int RtGuard::prepare(size_t stackBytes, size_t heapBytes)
+{
+    // Первый вызов backtrace подгружает libgcc и выделяет память, это делается заранее
+    void *frames[2];
+    backtrace(frames, 2);
+
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+        return -1;
+
+    long pageSize = sysconf(_SC_PAGESIZE);
+    char *heap = static_cast<char*>(malloc(heapBytes));
+
+    if (heap != nullptr)
+    {
+        for (size_t i = 0; i < heapBytes; i += pageSize)
+            heap[i] = 0;
+        free(heap);
+    }
+
+    prefaultStack(stackBytes);
+
+    return 0;
+}
+
+void RtGuard::setMode(Mode mode)
+{
+    guardMode.store(mode, std::memory_order_relaxed);
+}
+
+RtGuard::Mode RtGuard::mode()
+{
+    return guardMode.load(std::memory_order_relaxed);
+}
+
+void RtGuard::enterCycle(uint64_t cycle)
+{
+    if (guardMode.load(std::memory_order_relaxed) == Mode::OFF)
+        return;
+
+    currentCycle = cycle;
+    getrusage(RUSAGE_THREAD, &cycleStart);
+    armed = true;
+}
+
+void RtGuard::leaveCycle()
+{
+    if (!armed)
+        return;
+
+    armed = false;
+
+    rusage cycleEnd;
+    getrusage(RUSAGE_THREAD, &cycleEnd);
+
+    long minor = cycleEnd.ru_minflt - cycleStart.ru_minflt;
+    long major = cycleEnd.ru_majflt - cycleStart.ru_majflt;
+
+    if (minor > 0)
+    {
+        minorFaults.fetch_add(minor, std::memory_order_relaxed);
+        recordViolation(ViolationKind::MINOR_FAULT, minor, false);
+    }
+
+    if (major > 0)
+    {
+        majorFaults.fetch_add(major, std::memory_order_relaxed);
+        recordViolation(ViolationKind::MAJOR_FAULT, major, false);
+    }
+
+    guardedCycles.fetch_add(1, std::memory_order_relaxed);
+}
+
+RtGuard::Counters RtGuard::counters()
+{
+    Counters result;
+
+    result.allocations = allocations.load(std::memory_order_relaxed);
+    result.minorFaults = minorFaults.load(std::memory_order_relaxed);
+    result.majorFaults = majorFaults.load(std::memory_order_relaxed);
+    result.guardedCycles = guardedCycles.load(std::memory_order_relaxed);
+
+    return result;
+}
+
+/**
+ * @brief Копирование накопленных нарушений
+ * @details Вызывается из потока цикла вне участка enterCycle/leaveCycle, только копирует
+ * память, поэтому нарушения не пишутся одновременно с копированием
+ * @return число нарушений с прошлого вызова
+ */
+uint32_t RtGuard::collect(Report &report)
+{
+    report.count = violationCount.exchange(0, std::memory_order_relaxed);
+    report.stored = report.count < MAX_VIOLATIONS ? report.count : MAX_VIOLATIONS;
+    memcpy(report.violations, violations, report.stored * sizeof(Violation));
+    report.total = counters();
+
+    return report.count;
+}
+
+/**
+ * @brief Вывод нарушений с символизацией стека
+ * @details Символизация может выделять память, вызывается потоком вывода
+ */
+void RtGuard::print(const Report &report)
+{
+    std::cout << "RT violations: " << report.count;
+    if (report.count > report.stored)
+        std::cout << " (" << report.count - report.stored << " not stored)";
+    std::cout << std::endl;
+
+    for (uint32_t i = 0; i < report.stored; i++)
+    {
+        const Violation &violation = report.violations[i];
+
+        std::cout << "\tcycle " << violation.cycle << ": " << kindName(violation.kind) << " (" << violation.value << ")" << std::endl;
+
+        if (violation.frames == 0)
+            continue;
+
+        std::cout.flush();
+        backtrace_symbols_fd(const_cast<void* const*>(violation.backtrace), violation.frames, STDOUT_FILENO);
+    }
+
+    std::cout << "RT totals: " << report.total.guardedCycles << " cycles, " << report.total.allocations << " allocations, "
+              << report.total.minorFaults << " minor faults, " << report.total.majorFaults << " major faults" << std::endl;
+}
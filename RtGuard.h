@@ -0,0 +1,74 @@
+#ifndef RTGUARD_H
+#define RTGUARD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Режим реального времени без выделений памяти
+ * @details prepare() блокирует и заранее подгружает память процесса до перехода в OP.
+ * Между enterCycle() и leaveCycle() поток цикла находится под защитой: каждый вызов
+ * malloc/calloc/realloc/new, выделения с выравниванием и каждый page fault считаются нарушением.
+ * Для выделений в момент нарушения сохраняются только адреса стека вызовов. Цикл копирует
+ * нарушения через collect(), символизация и вывод выполняются в print() другим потоком
+ */
+namespace RtGuard
+{
+    enum class Mode : uint8_t
+    {
+        OFF = 0,
+        COUNT,          ///< Считать и запоминать нарушения
+        TRAP            ///< Аварийно завершать процесс на первом нарушении
+    };
+
+    enum class ViolationKind : uint8_t
+    {
+        ALLOCATION = 0,
+        MINOR_FAULT,
+        MAJOR_FAULT
+    };
+
+    constexpr int MAX_FRAMES = 16;
+    constexpr int MAX_VIOLATIONS = 64;
+
+    struct Violation
+    {
+        ViolationKind kind;
+        uint64_t cycle;
+        uint64_t value;         ///< Размер выделения либо число page fault
+        int frames;
+        void *backtrace[MAX_FRAMES];
+    };
+
+    struct Counters
+    {
+        uint64_t allocations;
+        uint64_t minorFaults;
+        uint64_t majorFaults;
+        uint64_t guardedCycles;
+    };
+
+    /**
+     * @brief Копия нарушений для вывода вне цикла
+     */
+    struct Report
+    {
+        uint32_t count;         ///< Нарушений с прошлого collect(), включая не сохраненные
+        uint32_t stored;
+        Violation violations[MAX_VIOLATIONS];
+        Counters total;
+    };
+
+    int prepare(size_t stackBytes, size_t heapBytes);
+    void setMode(Mode mode);
+    Mode mode();
+
+    void enterCycle(uint64_t cycle);
+    void leaveCycle();
+
+    Counters counters();
+    uint32_t collect(Report &report);
+    void print(const Report &report);
+}
+
+#endif //RTGUARD_H
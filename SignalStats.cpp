@@ -0,0 +1,105 @@
+#include "SignalStats.h"
+
+#include <climits>
+#include <cstring>
+#include <math.h>
+
+const char *SignalStats::channelName(Channel channel)
+{
+    switch (channel)
+    {
+    case TORQUE_ACTUAL:
+        return "torque";
+    case MODE_DISPLAY:
+        return "mode";
+    case STATUS_WORD:
+        return "status";
+    case FOLLOWING_ERROR:
+        return "following error";
+    default:
+        return "unknown";
+    }
+}
+
+SignalStats::Collector::Collector(uint16_t axisCount, uint32_t window)
+    : axisCount(axisCount), window(window == 0 ? 1 : (window > MAX_WINDOW ? MAX_WINDOW : window)), sequence(0)
+{
+    memset(current, 0, sizeof(current));
+    memset(&snapshot, 0, sizeof(snapshot));
+    reset();
+}
+
+void SignalStats::Collector::reset()
+{
+    for (int c = 0; c < CHANNEL_COUNT; c++)
+    {
+        for (int v = 0; v < VECTORS; v++)
+        {
+            Lane32 zero = {};
+
+            minimum[c][v] = zero + INT32_MAX;
+            maximum[c][v] = zero + INT32_MIN;
+            sum[c][v] = zero;
+            sumSquares[c][v] = ULane64{};
+        }
+    }
+
+    samples = 0;
+}
+
+/**
+ * @brief Расчет снимка из накопителей и публикация
+ * @details Выполняется раз в окно, копирование и расчет идут по всем осям
+ */
+void SignalStats::Collector::publish(uint64_t cycle)
+{
+    uint32_t seq = sequence.load(std::memory_order_relaxed);
+
+    sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    snapshot.cycle = cycle;
+    snapshot.samples = samples;
+    snapshot.axisCount = axisCount;
+
+    memcpy(snapshot.min, minimum, sizeof(snapshot.min));
+    memcpy(snapshot.max, maximum, sizeof(snapshot.max));
+
+    for (int c = 0; c < CHANNEL_COUNT; c++)
+    {
+        const int32_t *sums = reinterpret_cast<const int32_t*>(sum[c]);
+        const uint64_t *squares = reinterpret_cast<const uint64_t*>(sumSquares[c]);
+
+        for (int a = 0; a < MAX_AXES; a++)
+        {
+            snapshot.mean[c][a] = static_cast<float>(sums[a]) / samples;
+            snapshot.rms[c][a] = static_cast<float>(sqrt(static_cast<double>(squares[a]) / samples));
+        }
+    }
+
+    sequence.store(seq + 2, std::memory_order_release);
+
+    reset();
+}
+
+bool SignalStats::Collector::read(Snapshot &result, int retries) const
+{
+    for (int i = 0; i < retries; i++)
+    {
+        uint32_t before = sequence.load(std::memory_order_acquire);
+
+        if (before == 0)
+            return false;
+
+        if (before & 1)
+            continue;
+
+        memcpy(&result, &snapshot, sizeof(result));
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (sequence.load(std::memory_order_relaxed) == before)
+            return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,130 @@
+#ifndef SIGNALSTATS_H
+#define SIGNALSTATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "ProcessImage.h"
+
+/**
+ * @brief Оконная статистика входов всех осей внутри цикла
+ * @details Значения цикла записываются в буфер структуры массивов: строка на канал,
+ * столбец на ось. accumulate() обновляет min/max/сумму/сумму квадратов сразу для
+ * всех MAX_AXES осей векторными операциями (векторные типы GCC, компилятор сам
+ * выбирает SSE/AVX/NEON), стоимость не зависит от числа подключенных осей.
+ * По окончании окна из накопителей один раз считается снимок (mean, RMS) и
+ * публикуется через seqlock, сырые значения не сохраняются
+ */
+namespace SignalStats
+{
+    constexpr int MAX_AXES = ProcessImage::MAX_AXES;
+    constexpr uint32_t MAX_WINDOW = 32768;      ///< Сумма за окно должна помещаться в int32
+
+    enum Channel : uint8_t
+    {
+        TORQUE_ACTUAL = 0,      ///< 0x6077
+        MODE_DISPLAY,           ///< 0x6061
+        STATUS_WORD,            ///< 0x6041
+        FOLLOWING_ERROR,        ///< Заданный момент предыдущего кадра минус фактический
+        CHANNEL_COUNT
+    };
+
+    /**
+     * @brief Статистика окна
+     */
+    struct Snapshot
+    {
+        uint64_t cycle;             ///< Последний цикл окна
+        uint32_t samples;
+        uint16_t axisCount;
+        int32_t min[CHANNEL_COUNT][MAX_AXES];
+        int32_t max[CHANNEL_COUNT][MAX_AXES];
+        float mean[CHANNEL_COUNT][MAX_AXES];
+        float rms[CHANNEL_COUNT][MAX_AXES];
+    };
+
+    const char *channelName(Channel channel);
+
+    class Collector
+    {
+    public:
+        /**
+         * @param axisCount - число осей в снимке
+         * @param window - длина окна в циклах, не больше MAX_WINDOW
+         */
+        Collector(uint16_t axisCount, uint32_t window);
+
+        /**
+         * @brief Строка буфера значений текущего цикла для канала
+         */
+        int32_t *sample(Channel channel)
+        {
+            return reinterpret_cast<int32_t*>(current[channel]);
+        }
+
+        /**
+         * @brief Учет значений текущего цикла
+         * @details Не выделяет память и не делает системных вызовов
+         */
+        void accumulate(uint64_t cycle)
+        {
+            for (int c = 0; c < CHANNEL_COUNT; c++)
+            {
+                for (int v = 0; v < VECTORS; v++)
+                {
+                    Lane32 x = current[c][v];
+                    // |x| <= 65535, квадрат помещается в uint32 и расширяется только для суммы
+                    ULane32 magnitude = reinterpret_cast<ULane32>(x);
+                    ULane32 square = magnitude * magnitude;
+
+                    minimum[c][v] = x < minimum[c][v] ? x : minimum[c][v];
+                    maximum[c][v] = x > maximum[c][v] ? x : maximum[c][v];
+                    sum[c][v] += x;
+                    sumSquares[c][v] += __builtin_convertvector(square, ULane64);
+                }
+            }
+
+            if (++samples == window)
+                publish(cycle);
+        }
+
+        /**
+         * @brief Чтение последнего снимка
+         * @return false - снимков еще не было, либо не удалось прочитать за retries попыток
+         */
+        bool read(Snapshot &snapshot, int retries = 16) const;
+
+        uint64_t published() const
+        {
+            return sequence.load(std::memory_order_acquire) / 2;
+        }
+
+    private:
+        static constexpr int LANES = 8;
+        static constexpr int VECTORS = MAX_AXES / LANES;
+
+        typedef int32_t Lane32 __attribute__((vector_size(LANES * sizeof(int32_t))));
+        typedef uint32_t ULane32 __attribute__((vector_size(LANES * sizeof(uint32_t))));
+        typedef uint64_t ULane64 __attribute__((vector_size(LANES * sizeof(uint64_t))));
+
+        static_assert(MAX_AXES % LANES == 0, "MAX_AXES must be a multiple of vector width");
+
+        void publish(uint64_t cycle);
+        void reset();
+
+        uint16_t axisCount;
+        uint32_t window;
+        uint32_t samples;
+
+        alignas(64) Lane32 current[CHANNEL_COUNT][VECTORS];
+        alignas(64) Lane32 minimum[CHANNEL_COUNT][VECTORS];
+        alignas(64) Lane32 maximum[CHANNEL_COUNT][VECTORS];
+        alignas(64) Lane32 sum[CHANNEL_COUNT][VECTORS];
+        alignas(64) ULane64 sumSquares[CHANNEL_COUNT][VECTORS];
+
+        alignas(64) std::atomic<uint32_t> sequence;     ///< Нечетное значение - идет запись
+        Snapshot snapshot;
+    };
+}
+
+#endif //SIGNALSTATS_H
@@ -0,0 +1,464 @@
+#include "SiiReader.h"
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "ethercat.h"
+#include "Trace.h"
+
+namespace
+{
+    constexpr uint32_t HEADER_BYTES = 0x80;         ///< Слова 0x00..0x3F, категории начинаются с 0x40
+    constexpr uint32_t MAX_EEPROM_BYTES = 0x10000;
+    constexpr uint32_t CHECKSUM_OFFSET = 0x0E;      ///< Слово 7
+
+    uint16_t word(const std::vector<uint8_t> &image, uint32_t offset)
+    {
+        return image[offset] | (image[offset + 1] << 8);
+    }
+
+    uint32_t dword(const std::vector<uint8_t> &image, uint32_t offset)
+    {
+        return word(image, offset) | (static_cast<uint32_t>(word(image, offset + 2)) << 16);
+    }
+
+    /**
+     * @brief Последовательное чтение EEPROM одного slave блоками
+     */
+    class EepromStream
+    {
+    public:
+        EepromStream(uint16_t slave, std::vector<uint8_t> &image)
+            : slave(slave), configadr(ec_slave[slave].configadr), chunkBytes(ec_slave[slave].eep_8byte ? 8 : 4),
+              limit(MAX_EEPROM_BYTES), image(image), bytesRead(0)
+        {
+        }
+
+        /**
+         * @brief Дочитать EEPROM до адреса end (в байтах)
+         * @return false - адрес за пределами EEPROM
+         */
+        bool ensure(uint32_t end)
+        {
+            if (end > limit)
+                return false;
+
+            while (image.size() < end)
+            {
+                uint16_t address = static_cast<uint16_t>(image.size() / 2);
+
+                Trace::Scope span(Trace::Category::EEPROM, "EEPROM read", slave, address);
+                uint64_t data = ec_readeepromFP(configadr, address, EC_TIMEOUTEEP);
+                span.setBytes(chunkBytes);
+
+                for (int i = 0; i < chunkBytes; i++)
+                    image.push_back(static_cast<uint8_t>(data >> (8 * i)));
+
+                bytesRead += chunkBytes;
+            }
+
+            return true;
+        }
+
+        void setLimit(uint32_t bytes)
+        {
+            limit = bytes < MAX_EEPROM_BYTES ? bytes : MAX_EEPROM_BYTES;
+        }
+
+        uint32_t read() const
+        {
+            return bytesRead;
+        }
+
+    private:
+        uint16_t slave;
+        uint16_t configadr;
+        int chunkBytes;
+        uint32_t limit;
+        std::vector<uint8_t> &image;
+        uint32_t bytesRead;
+    };
+
+    void makeDirectories(const char *path)
+    {
+        std::string current;
+
+        for (const char *p = path; *p; p++)
+        {
+            current += *p;
+
+            if (p[1] == '/' || p[1] == '\0')
+                mkdir(current.c_str(), 0755);
+        }
+    }
+
+    std::string cachePath(const char *cacheDir, uint32_t vendorId, uint32_t productCode, uint32_t revision, uint16_t checksum)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "/%08x-%08x-%08x-%04x.sii", vendorId, productCode, revision, checksum);
+        return std::string(cacheDir) + name;
+    }
+
+    bool loadCache(const std::string &path, uint16_t checksum, std::vector<uint8_t> &image)
+    {
+        FILE *file = fopen(path.c_str(), "rb");
+
+        if (file == nullptr)
+            return false;
+
+        uint32_t magic = 0;
+        uint32_t size = 0;
+        bool ok = fread(&magic, sizeof(magic), 1, file) == 1 && magic == SiiReader::CACHE_MAGIC &&
+                  fread(&size, sizeof(size), 1, file) == 1 && size >= HEADER_BYTES && size <= MAX_EEPROM_BYTES;
+
+        if (ok)
+        {
+            image.resize(size);
+            ok = fread(image.data(), 1, size, file) == size && word(image, CHECKSUM_OFFSET) == checksum;
+        }
+
+        fclose(file);
+
+        if (!ok)
+            image.clear();
+
+        return ok;
+    }
+
+    /**
+     * @brief Запись образа в кэш
+     * @details Через временный файл и rename, чтобы параллельные запуски не видели частично записанный файл
+     */
+    void saveCache(const std::string &path, const std::vector<uint8_t> &image)
+    {
+        std::string temp = path + ".tmp" + std::to_string(getpid());
+        FILE *file = fopen(temp.c_str(), "wb");
+
+        if (file == nullptr)
+            return;
+
+        uint32_t magic = SiiReader::CACHE_MAGIC;
+        uint32_t size = static_cast<uint32_t>(image.size());
+
+        bool ok = fwrite(&magic, sizeof(magic), 1, file) == 1 && fwrite(&size, sizeof(size), 1, file) == 1 &&
+                  fwrite(image.data(), 1, size, file) == size;
+
+        if (fclose(file) == 0 && ok)
+            rename(temp.c_str(), path.c_str());
+        else
+            unlink(temp.c_str());
+    }
+
+    void parsePdo(const std::vector<uint8_t> &image, uint32_t offset, uint32_t end, std::vector<SiiReader::Pdo> &pdos)
+    {
+        while (offset + 8 <= end)
+        {
+            SiiReader::Pdo pdo;
+            pdo.index = word(image, offset);
+            uint8_t entryCount = image[offset + 2];
+            pdo.syncManager = image[offset + 3];
+            pdo.nameIdx = image[offset + 5];
+            pdo.flags = word(image, offset + 6);
+            offset += 8;
+
+            for (int i = 0; i < entryCount && offset + 8 <= end; i++, offset += 8)
+            {
+                SiiReader::PdoEntry entry;
+                entry.index = word(image, offset);
+                entry.subindex = image[offset + 2];
+                entry.nameIdx = image[offset + 3];
+                entry.dataType = image[offset + 4];
+                entry.bitLength = image[offset + 5];
+                pdo.entries.push_back(entry);
+            }
+
+            pdos.push_back(std::move(pdo));
+        }
+    }
+}
+
+/**
+ * @brief Разбор образа EEPROM
+ * @param image - образ от слова 0 до категории END
+ * @param info - результат разбора, образ копируется в info.image
+ * @return 1 - успех, -1 - образ поврежден
+ */
+int SiiReader::parse(const std::vector<uint8_t> &image, Info &info)
+{
+    if (image.size() < HEADER_BYTES)
+        return -1;
+
+    info = Info();
+    info.image = image;
+
+    info.checksum = word(image, CHECKSUM_OFFSET);
+    info.vendorId = dword(image, 0x10);
+    info.productCode = dword(image, 0x14);
+    info.revision = dword(image, 0x18);
+    info.serial = dword(image, 0x1C);
+    info.bootRxMailbox = {word(image, 0x28), word(image, 0x2A)};
+    info.bootTxMailbox = {word(image, 0x2C), word(image, 0x2E)};
+    info.rxMailbox = {word(image, 0x30), word(image, 0x32)};
+    info.txMailbox = {word(image, 0x34), word(image, 0x36)};
+    info.mailboxProtocols = word(image, 0x38);
+    info.eepromBytes = (word(image, 0x7C) + 1) * 128;
+
+    uint32_t offset = HEADER_BYTES;
+
+    while (offset + 2 <= image.size())
+    {
+        uint16_t type = word(image, offset);
+
+        if (type == CATEGORY_END)
+            return 1;
+
+        if (offset + 4 > image.size())
+            return -1;
+
+        uint32_t data = offset + 4;
+        uint32_t end = data + word(image, offset + 2) * 2;
+
+        if (end > image.size())
+            return -1;
+
+        switch (type)
+        {
+        case CATEGORY_STRINGS:
+        {
+            uint32_t p = data + 1;
+
+            for (int i = 0; i < image[data] && p < end; i++)
+            {
+                uint8_t length = image[p++];
+
+                if (p + length > end)
+                    break;
+
+                info.strings.emplace_back(reinterpret_cast<const char*>(&image[p]), length);
+                p += length;
+            }
+            break;
+        }
+        case CATEGORY_GENERAL:
+            if (end - data < 14)
+                break;
+
+            info.hasGeneral = true;
+            info.general.groupIdx = image[data];
+            info.general.imgIdx = image[data + 1];
+            info.general.orderIdx = image[data + 2];
+            info.general.nameIdx = image[data + 3];
+            info.general.coeDetails = image[data + 5];
+            info.general.foeDetails = image[data + 6];
+            info.general.eoeDetails = image[data + 7];
+            info.general.soeDetails = image[data + 8];
+            info.general.ds402Channels = image[data + 9];
+            info.general.sysmanClass = image[data + 10];
+            info.general.flags = image[data + 11];
+            info.general.currentOnEbus = static_cast<int16_t>(word(image, data + 12));
+            break;
+
+        case CATEGORY_FMMU:
+            info.fmmu.assign(image.begin() + data, image.begin() + end);
+            break;
+
+        case CATEGORY_SM:
+            for (uint32_t p = data; p + 8 <= end; p += 8)
+            {
+                info.sm.push_back({word(image, p), word(image, p + 2), image[p + 4], image[p + 5], image[p + 6], image[p + 7]});
+            }
+            break;
+
+        case CATEGORY_TXPDO:
+            parsePdo(image, data, end, info.txPdo);
+            break;
+
+        case CATEGORY_RXPDO:
+            parsePdo(image, data, end, info.rxPdo);
+            break;
+
+        default:
+            break;
+        }
+
+        offset = end;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Строка из категории Strings по индексу (с 1)
+ */
+const char *SiiReader::string(const Info &info, uint8_t index)
+{
+    if (index == 0 || index > info.strings.size())
+        return "";
+
+    return info.strings[index - 1].c_str();
+}
+
+/**
+ * @brief Чтение SII одного slave
+ * @details Ключ кэша берется из ec_slave (заполнены ec_config_init) и слова 7 EEPROM.
+ * При промахе EEPROM читается до категории END и образ кладется в кэш
+ * @param slave
+ * @param cacheDir - каталог кэша, nullptr - без кэша
+ * @param info - результат
+ * @param fromCache - образ взят из кэша
+ * @param eepromBytes - число байт, прочитанных с EEPROM
+ * @return 1 - успех, -1 - ошибка
+ */
+int SiiReader::readSlave(uint16_t slave, const char *cacheDir, Info &info, bool &fromCache, uint32_t &eepromBytes)
+{
+    std::vector<uint8_t> image;
+    EepromStream stream(slave, image);
+
+    fromCache = false;
+
+    ec_eeprom2master(slave);
+
+    stream.ensure(CHECKSUM_OFFSET + 2);
+    uint16_t checksum = word(image, CHECKSUM_OFFSET);
+
+    std::string path;
+
+    if (cacheDir != nullptr)
+    {
+        path = cachePath(cacheDir, ec_slave[slave].eep_man, ec_slave[slave].eep_id, ec_slave[slave].eep_rev, checksum);
+
+        std::vector<uint8_t> cached;
+
+        if (loadCache(path, checksum, cached) && parse(cached, info) > 0)
+        {
+            fromCache = true;
+            eepromBytes = stream.read();
+            return 1;
+        }
+    }
+
+    stream.ensure(HEADER_BYTES);
+    stream.setLimit((word(image, 0x7C) + 1) * 128);
+
+    uint32_t offset = HEADER_BYTES;
+
+    for (;;)
+    {
+        if (!stream.ensure(offset + 2))
+            break;
+
+        if (word(image, offset) == CATEGORY_END)
+            break;
+
+        if (!stream.ensure(offset + 4))
+            break;
+
+        uint32_t end = offset + 4 + word(image, offset + 2) * 2;
+
+        if (!stream.ensure(end))
+            break;
+
+        offset = end;
+    }
+
+    eepromBytes = stream.read();
+
+    image.resize(offset + 2 <= image.size() ? offset + 2 : image.size());
+
+    if (parse(image, info) < 0)
+        return -1;
+
+    if (!path.empty())
+        saveCache(path, image);
+
+    return 1;
+}
+
+/**
+ * @brief Чтение SII всех slave
+ * @details Вызывается после ec_config_init. Каждый поток читает свои slave, обращения
+ * к разным slave идут параллельно
+ * @param cacheDir - каталог кэша, nullptr - без кэша
+ * @param infos - результат, индекс совпадает с номером slave
+ * @param maxThreads - 0 - поток на каждый slave
+ */
+SiiReader::ReadStats SiiReader::readAll(const char *cacheDir, std::vector<Info> &infos, int maxThreads)
+{
+    ReadStats stats = {ec_slavecount, 0, 0, 0, 0};
+
+    infos.assign(ec_slavecount + 1, Info());
+
+    if (cacheDir != nullptr)
+        makeDirectories(cacheDir);
+
+    timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    std::atomic<int> next(1);
+    std::atomic<int> fromCache(0);
+    std::atomic<int> failed(0);
+    std::atomic<uint32_t> eepromBytes(0);
+
+    int threadCount = maxThreads > 0 && maxThreads < ec_slavecount ? maxThreads : ec_slavecount;
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([&]()
+        {
+            for (int slave = next++; slave <= ec_slavecount; slave = next++)
+            {
+                bool cached = false;
+                uint32_t bytes = 0;
+
+                if (readSlave(static_cast<uint16_t>(slave), cacheDir, infos[slave], cached, bytes) < 0)
+                    failed++;
+
+                fromCache += cached;
+                eepromBytes += bytes;
+            }
+        });
+    }
+
+    for (auto &it : threads)
+        it.join();
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    stats.fromCache = fromCache;
+    stats.failed = failed;
+    stats.eepromBytes = eepromBytes;
+    stats.seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    return stats;
+}
+
+/**
+ * @brief Заполнение ec_slave по категории General
+ * @details То же, что делал цикл ec_siifind/ec_siigetbyte в main
+ */
+void SiiReader::apply(uint16_t slave, const Info &info)
+{
+    if (!info.hasGeneral)
+        return;
+
+    ec_slave[slave].CoEdetails = info.general.coeDetails;
+    ec_slave[slave].FoEdetails = info.general.foeDetails;
+    ec_slave[slave].EoEdetails = info.general.eoeDetails;
+    ec_slave[slave].SoEdetails = info.general.soeDetails;
+
+    if (info.general.flags & 0x02)
+    {
+        ec_slave[slave].blockLRW = 1;
+        ec_slave[0].blockLRW++;
+    }
+
+    ec_slave[slave].Ebuscurrent = info.general.currentOnEbus;
+    ec_slave[0].Ebuscurrent += ec_slave[slave].Ebuscurrent;
+}
@@ -0,0 +1,128 @@
+#ifndef SIIREADER_H
+#define SIIREADER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Чтение SII (EEPROM) slave целиком с кэшем на диске
+ * @details EEPROM читается блоками по 8 байт (по 4, если slave не поддерживает 8-байтное
+ * чтение) через ec_readeepromFP, каждый slave в своем потоке. Образ разбирается
+ * по категориям в одну структуру Info. Образ сохраняется в кэш под ключом
+ * vendor/product/revision + контрольное слово 7, при повторном запуске с EEPROM
+ * читается только блок с контрольным словом
+ */
+namespace SiiReader
+{
+    constexpr uint32_t CACHE_MAGIC = 0x43494953;     ///< "SIIC"
+    constexpr const char *DEFAULT_CACHE_DIR = "/var/cache/ethercat-test/sii";
+
+    enum Category : uint16_t
+    {
+        CATEGORY_STRINGS = 10,
+        CATEGORY_GENERAL = 30,
+        CATEGORY_FMMU = 40,
+        CATEGORY_SM = 41,
+        CATEGORY_TXPDO = 50,
+        CATEGORY_RXPDO = 51,
+        CATEGORY_END = 0xFFFF
+    };
+
+    struct Mailbox
+    {
+        uint16_t offset;
+        uint16_t size;
+    };
+
+    /**
+     * @brief Категория General
+     * @details Индексы строк начинаются с 1, 0 - строки нет
+     */
+    struct General
+    {
+        uint8_t groupIdx;
+        uint8_t imgIdx;
+        uint8_t orderIdx;
+        uint8_t nameIdx;
+        uint8_t coeDetails;
+        uint8_t foeDetails;
+        uint8_t eoeDetails;
+        uint8_t soeDetails;
+        uint8_t ds402Channels;
+        uint8_t sysmanClass;
+        uint8_t flags;
+        int16_t currentOnEbus;
+    };
+
+    struct SyncManager
+    {
+        uint16_t startAddress;
+        uint16_t length;
+        uint8_t control;
+        uint8_t status;
+        uint8_t enable;
+        uint8_t type;
+    };
+
+    struct PdoEntry
+    {
+        uint16_t index;
+        uint8_t subindex;
+        uint8_t nameIdx;
+        uint8_t dataType;
+        uint8_t bitLength;
+    };
+
+    struct Pdo
+    {
+        uint16_t index;
+        uint8_t syncManager;
+        uint8_t nameIdx;
+        uint16_t flags;
+        std::vector<PdoEntry> entries;
+    };
+
+    struct Info
+    {
+        uint32_t vendorId;
+        uint32_t productCode;
+        uint32_t revision;
+        uint32_t serial;
+        uint16_t checksum;          ///< Слово 7 EEPROM
+        Mailbox bootRxMailbox;
+        Mailbox bootTxMailbox;
+        Mailbox rxMailbox;
+        Mailbox txMailbox;
+        uint16_t mailboxProtocols;
+        uint32_t eepromBytes;
+
+        bool hasGeneral;
+        General general;
+        std::vector<std::string> strings;
+        std::vector<uint8_t> fmmu;
+        std::vector<SyncManager> sm;
+        std::vector<Pdo> txPdo;
+        std::vector<Pdo> rxPdo;
+
+        std::vector<uint8_t> image;     ///< Прочитанная часть EEPROM до категории END
+    };
+
+    struct ReadStats
+    {
+        int slaves;
+        int fromCache;
+        int failed;
+        uint32_t eepromBytes;       ///< Байт, прочитанных с EEPROM
+        double seconds;
+    };
+
+    int parse(const std::vector<uint8_t> &image, Info &info);
+    const char *string(const Info &info, uint8_t index);
+
+    int readSlave(uint16_t slave, const char *cacheDir, Info &info, bool &fromCache, uint32_t &eepromBytes);
+    ReadStats readAll(const char *cacheDir, std::vector<Info> &infos, int maxThreads);
+    void apply(uint16_t slave, const Info &info);
+}
+
+#endif //SIIREADER_H
@@ -0,0 +1,476 @@
+#include "TopologyStress.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include "CycleTiming.h"
+
+namespace
+{
+    constexpr uint32_t SII_COLD_BYTES = 1024;       ///< EEPROM до категории END у типичного привода
+    constexpr uint32_t SII_WARM_BYTES = 16;         ///< Слова до 7 (ключ кэша)
+    constexpr uint32_t EEPROM_CHUNK_BYTES = 8;
+    constexpr int RESERVED_FRAMES = 2;              ///< Индексы EC_MAXBUF под кадр DC и mailbox
+
+    constexpr uint16_t STATUS_SWITCH_ON_DISABLED = 0x40;
+    constexpr uint16_t STATUS_READY = 0x21;
+    constexpr uint16_t STATUS_SWITCHED_ON = 0x23;
+    constexpr uint16_t STATUS_ENABLED = 0x27;
+
+    uint64_t residentBytes()
+    {
+        unsigned long pages = 0;
+        unsigned long resident = 0;
+        FILE *file = fopen("/proc/self/statm", "r");
+
+        if (file == nullptr)
+            return 0;
+
+        if (fscanf(file, "%lu %lu", &pages, &resident) != 2)
+            resident = 0;
+
+        fclose(file);
+
+        return static_cast<uint64_t>(resident) * sysconf(_SC_PAGESIZE);
+    }
+
+    double percentileUs(std::vector<int64_t> &samples, double percentile)
+    {
+        if (samples.empty())
+            return 0;
+
+        size_t index = static_cast<size_t>(percentile / 100.0 * (samples.size() - 1));
+        std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+
+        return samples[index] / 1000.0;
+    }
+
+    /**
+     * @brief Одинаковые slave с разметкой CiA 402 из 16-битных объектов
+     */
+    NetworkConfig::Config buildConfig(uint16_t slaves, const TopologyStress::Options &options)
+    {
+        NetworkConfig::Config config = {};
+        NetworkConfig::SlaveConfig slave = {};
+
+        slave.flags = NetworkConfig::HAS_SM | NetworkConfig::HAS_PDO_LAYOUT;
+        slave.outputBits = options.outputBytes * 8;
+        slave.inputBits = options.inputBytes * 8;
+
+        EthercatCOE::SMAssignment *assignments[] = { &slave.pdoLayout.rxPdo, &slave.pdoLayout.txPdo };
+        uint16_t bytes[] = { options.outputBytes, options.inputBytes };
+        uint16_t mappingIndex[] = { 0x1600, 0x1A00 };
+        uint16_t objectIndex[] = { 0x6040, 0x6041 };
+
+        slave.pdoLayout.rxPdo.smIndex = static_cast<uint16_t>(EthercatCOE::SMIndex::SM_RPDO);
+        slave.pdoLayout.txPdo.smIndex = static_cast<uint16_t>(EthercatCOE::SMIndex::SM_TPDO);
+
+        for (int k = 0; k < 2; k++)
+        {
+            EthercatCOE::PDOMapping &pdo = assignments[k]->pdos[0];
+
+            assignments[k]->pdoCount = 1;
+            pdo.pdoMappingIndex = mappingIndex[k];
+            pdo.entryCount = static_cast<uint8_t>(std::min<int>(bytes[k] / 2, EthercatCOE::MAX_PDO_ENTRIES));
+
+            for (int j = 0; j < pdo.entryCount; j++)
+                pdo.entries[j] = {static_cast<uint16_t>(objectIndex[k] + j), 0, 16};
+        }
+
+        config.slaves.assign(slaves, slave);
+
+        return config;
+    }
+
+    /**
+     * @brief Число SDO транзакций EthercatCOE::syncPDOLayout со Complete Access
+     * @details Теплый запуск - только чтение назначений и разметок. Холодный - чтение,
+     * запись каждого SM (обнуление, очистка разметки, объекты, размер, назначение, число)
+     * и повторное чтение для проверки
+     */
+    uint32_t pdoTransactions(const EthercatCOE::PDOLayout &layout, bool warm)
+    {
+        const EthercatCOE::SMAssignment *assignments[] = { &layout.rxPdo, &layout.txPdo };
+        uint32_t reads = 0;
+        uint32_t writes = 0;
+
+        for (const EthercatCOE::SMAssignment *sm : assignments)
+        {
+            reads += 1 + sm->pdoCount;
+            writes += 2 + sm->pdoCount;
+
+            for (int i = 0; i < sm->pdoCount; i++)
+                writes += 2 + sm->pdos[i].entryCount;
+        }
+
+        return warm ? reads : 2 * reads + writes;
+    }
+
+    /**
+     * @brief Оценка запуска slave пулом потоков, как SiiReader::readAll и NetworkConfig::syncPdoLayouts
+     * @details Каждая транзакция - отдельный сон на ее задержку, обмена с slave нет.
+     * Результат - оценка по заданным задержкам, а не замер реального запуска
+     * @return время в секундах
+     */
+    double simulateStartup(uint16_t slaves, uint32_t eepromReads, uint32_t mailboxTransactions,
+                           const TopologyStress::Options &options)
+    {
+        int threadCount = options.threads > 0 && options.threads < slaves ? options.threads : slaves;
+        std::atomic<int> next(1);
+        std::vector<std::thread> threads;
+
+        int64_t start = CycleTiming::nowNs();
+
+        for (int t = 0; t < threadCount; t++)
+        {
+            threads.emplace_back([&]()
+            {
+                for (int slave = next++; slave <= slaves; slave = next++)
+                {
+                    for (uint32_t i = 0; i < eepromReads; i++)
+                        std::this_thread::sleep_for(std::chrono::microseconds(options.eepromReadUs));
+
+                    for (uint32_t i = 0; i < mailboxTransactions; i++)
+                        std::this_thread::sleep_for(std::chrono::microseconds(options.mailboxLatencyUs));
+                }
+            });
+        }
+
+        for (auto &it : threads)
+            it.join();
+
+        return (CycleTiming::nowNs() - start) / 1e9;
+    }
+
+    /**
+     * @brief Положение процессных данных slave в кадрах и IOmap
+     */
+    struct SlaveSlot
+    {
+        uint16_t outputDatagram;
+        uint16_t inputDatagram;
+        uint32_t outputFrameOffset;
+        uint32_t inputFrameOffset;
+        uint32_t outputOffset;          ///< Смещение выходов в IOmap
+        uint32_t inputOffset;
+    };
+
+    /**
+     * @brief Размещение slave по датаграммам группы
+     * @details Повторяет разбиение IoLayout: данные slave не делятся между датаграммами.
+     * Без перекрытия логический образ - все выходы, затем все входы, IOmap совпадает с ним.
+     * С перекрытием выходы и входы slave лежат по одному логическому адресу, а в IOmap
+     * входы идут после логического образа выходов
+     */
+    void placeSlaves(const IoLayout::GroupPlan &group, uint16_t outputBytes, uint16_t inputBytes,
+                     std::vector<SlaveSlot> &slots, std::vector<uint32_t> &datagramStart)
+    {
+        uint32_t datagram = 0;
+        uint32_t inDatagram = 0;
+        uint32_t logical = 0;
+
+        datagramStart.assign(1, 0);
+
+        auto place = [&](uint32_t unit, uint16_t &slotDatagram, uint32_t &frameOffset)
+        {
+            if (inDatagram != 0 && inDatagram + unit > group.datagramBytes[datagram])
+            {
+                datagram++;
+                inDatagram = 0;
+                datagramStart.push_back(logical);
+            }
+
+            slotDatagram = static_cast<uint16_t>(datagram);
+            frameOffset = inDatagram;
+
+            uint32_t address = logical;
+
+            inDatagram += unit;
+            logical += unit;
+
+            return address;
+        };
+
+        if (group.overlap)
+        {
+            uint32_t unit = std::max(outputBytes, inputBytes);
+
+            for (auto &it : slots)
+            {
+                it.outputOffset = place(unit, it.outputDatagram, it.outputFrameOffset);
+                it.inputDatagram = it.outputDatagram;
+                it.inputFrameOffset = it.outputFrameOffset;
+                it.inputOffset = group.logicalBytes + it.outputOffset;
+            }
+        }
+        else
+        {
+            for (auto &it : slots)
+                it.outputOffset = place(outputBytes, it.outputDatagram, it.outputFrameOffset);
+
+            for (auto &it : slots)
+                it.inputOffset = place(inputBytes, it.inputDatagram, it.inputFrameOffset);
+        }
+    }
+
+    uint16_t readWord(const uint8_t *data)
+    {
+        return static_cast<uint16_t>(data[0] | (data[1] << 8));
+    }
+
+    void writeWord(uint8_t *data, uint16_t value)
+    {
+        data[0] = static_cast<uint8_t>(value);
+        data[1] = static_cast<uint8_t>(value >> 8);
+    }
+
+    /**
+     * @brief Привод: statusWord по controlWord прошлого кадра
+     */
+    uint16_t driveStatus(uint16_t controlWord)
+    {
+        switch (controlWord & 0x0F)
+        {
+        case 0x06:
+            return STATUS_READY;
+        case 0x07:
+            return STATUS_SWITCHED_ON;
+        case 0x0F:
+            return STATUS_ENABLED;
+        default:
+            return STATUS_SWITCH_ON_DISABLED;
+        }
+    }
+
+    /**
+     * @brief Приложение: перевод оси в Operation enabled
+     */
+    uint16_t axisControl(uint16_t statusWord)
+    {
+        switch (statusWord & 0x6F)
+        {
+        case STATUS_READY:
+            return 0x07;
+        case STATUS_SWITCHED_ON:
+        case STATUS_ENABLED:
+            return 0x0F;
+        default:
+            return 0x06;
+        }
+    }
+}
+
+/**
+ * @brief Прогон одного размера сегмента
+ * @details Кадры сверх EC_MAXIOSEGMENTS SOEM не может описать в группе, а сверх свободных
+ * индексов EC_MAXBUF переиспользует буфер до возврата кадра. Такие кадры в модели не
+ * доходят до slave: slave в них не отвечают и wkc падает
+ * @param slaves - не меньше 1
+ */
+TopologyStress::Result TopologyStress::run(uint16_t slaves, const Options &options)
+{
+    Result result = {};
+
+    if (slaves == 0)
+        return result;
+
+    NetworkConfig::Config config = buildConfig(slaves, options);
+
+    result.slaves = slaves;
+    result.plan = IoLayout::plan(config, {});
+
+    const IoLayout::GroupPlan &group = result.plan.groups[0];
+
+    // 100 Мбит/с - 80 нс на байт
+    result.wireUs = result.plan.wireBytes * 0.08;
+    result.roundTripUs = result.wireUs + slaves * options.slaveDelayNs / 1000.0;
+
+    uint32_t ioMapBytes = IoLayout::capacity(config, result.plan);
+    std::unique_ptr<uint8_t, decltype(&free)> ioMapBuffer(
+        static_cast<uint8_t*>(aligned_alloc(IoLayout::CACHE_LINE, ioMapBytes)), free);
+    uint8_t *ioMap = ioMapBuffer.get();
+
+    memset(ioMap, 0, ioMapBytes);
+
+    std::vector<SlaveSlot> slots(slaves);
+    std::vector<uint32_t> datagramStart;
+
+    placeSlaves(group, options.outputBytes, options.inputBytes, slots, datagramStart);
+
+    std::vector<std::vector<uint8_t>> frames(group.datagrams, std::vector<uint8_t>(EC_MAXECATFRAME));
+    std::vector<uint16_t> controlWords(slaves, 0);
+    std::vector<int64_t> exchange(options.cycles);
+    std::vector<int64_t> application(options.cycles);
+
+    uint32_t inputsBase = group.overlap ? group.logicalBytes : 0;
+    uint32_t sentDatagrams = std::min<uint32_t>(group.datagrams, std::min(EC_MAXIOSEGMENTS, EC_MAXBUF - RESERVED_FRAMES));
+    int expectedWkc = 3 * slaves;
+    uint32_t wkcErrors = 0;
+
+    for (uint32_t cycle = 0; cycle < options.cycles; cycle++)
+    {
+        int64_t start = CycleTiming::nowNs();
+
+        // Модель мастера: IOmap -> кадры, как ec_send_processdata
+        for (uint32_t d = 0; d < sentDatagrams; d++)
+            memcpy(frames[d].data(), ioMap + datagramStart[d], group.datagramBytes[d]);
+
+        int64_t sent = CycleTiming::nowNs();
+
+        // Сегмент: каждый slave забирает выходы и кладет входы на лету
+        int wkc = 0;
+
+        for (uint16_t i = 0; i < slaves; i++)
+        {
+            const SlaveSlot &slot = slots[i];
+
+            // LRW: запись выходов добавляет к wkc 2, чтение входов 1
+            if (slot.outputDatagram < sentDatagrams)
+            {
+                controlWords[i] = readWord(frames[slot.outputDatagram].data() + slot.outputFrameOffset);
+                wkc += 2;
+            }
+
+            if (slot.inputDatagram < sentDatagrams)
+            {
+                writeWord(frames[slot.inputDatagram].data() + slot.inputFrameOffset, driveStatus(controlWords[i]));
+                wkc += 1;
+            }
+        }
+
+        int64_t received = CycleTiming::nowNs();
+
+        // Модель мастера: кадры -> IOmap и проверка wkc, как ec_receive_processdata
+        for (uint32_t d = 0; d < sentDatagrams; d++)
+            memcpy(ioMap + inputsBase + datagramStart[d], frames[d].data(), group.datagramBytes[d]);
+
+        wkcErrors += wkc < expectedWkc;
+
+        int64_t unpacked = CycleTiming::nowNs();
+
+        for (uint16_t i = 0; i < slaves; i++)
+            writeWord(ioMap + slots[i].outputOffset, axisControl(readWord(ioMap + slots[i].inputOffset)));
+
+        int64_t computed = CycleTiming::nowNs();
+
+        exchange[cycle] = (sent - start) + (unpacked - received);
+        application[cycle] = computed - unpacked;
+    }
+
+    result.exchangeUs = percentileUs(exchange, options.percentile);
+    result.applicationUs = percentileUs(application, options.percentile);
+    result.minPeriodUs = result.roundTripUs + result.exchangeUs + result.applicationUs;
+
+    uint32_t eepromCold = SII_COLD_BYTES / EEPROM_CHUNK_BYTES;
+    uint32_t eepromWarm = SII_WARM_BYTES / EEPROM_CHUNK_BYTES;
+    uint32_t pdoCold = pdoTransactions(config.slaves[0].pdoLayout, false);
+    uint32_t pdoWarm = pdoTransactions(config.slaves[0].pdoLayout, true);
+
+    result.coldStartupSeconds = simulateStartup(slaves, eepromCold, pdoCold, options);
+    result.warmStartupSeconds = simulateStartup(slaves, eepromWarm, pdoWarm, options);
+    result.sequentialStartupSeconds = slaves * (eepromCold * options.eepromReadUs + pdoCold * options.mailboxLatencyUs) / 1e6;
+
+    result.masterBytes = ioMapBytes + group.datagrams * EC_MAXECATFRAME +
+                         slaves * (sizeof(NetworkConfig::SlaveConfig) + sizeof(SlaveSlot)) +
+                         sizeof(ec_slave) + sizeof(ec_group);
+    result.rssBytes = residentBytes();
+
+    // Индекс 0 таблицы slave SOEM занят группой
+    if (slaves + 1 > EC_MAXSLAVE)
+        result.limits.push_back("EC_MAXSLAVE (slave table)");
+    if (group.datagrams > EC_MAXIOSEGMENTS)
+        result.limits.push_back("EC_MAXIOSEGMENTS (datagrams per group)");
+    // Кроме кадров процессных данных в полете кадр DC и mailbox
+    if (group.datagrams + RESERVED_FRAMES > EC_MAXBUF)
+        result.limits.push_back("EC_MAXBUF (frames in flight)");
+    // wkc ниже ожидаемого - следствие кадров, которые SOEM не смог отправить
+    if (wkcErrors > 0)
+        result.limits.push_back("wkc (frames not sent)");
+    if (result.minPeriodUs * 1000 > options.periodNs)
+        result.limits.push_back("cycle period");
+
+    return result;
+}
+
+/**
+ * @brief Прогон всех размеров сегмента
+ * @return число размеров, на которых нарушен хотя бы один предел, -1 - неверный диапазон
+ */
+int TopologyStress::runAll(const Options &options, std::vector<Result> &results)
+{
+    int limited = 0;
+
+    results.clear();
+
+    if (options.firstSlaves < 1 || options.firstSlaves > options.lastSlaves)
+    {
+        std::cout << "Invalid slave range " << options.firstSlaves << ".." << options.lastSlaves << std::endl;
+        return -1;
+    }
+
+    for (uint32_t slaves = options.firstSlaves; slaves <= options.lastSlaves; slaves += std::max<uint16_t>(options.step, 1))
+    {
+        std::cout << "Simulating " << slaves << " slave(s)..." << std::endl;
+
+        results.push_back(run(static_cast<uint16_t>(slaves), options));
+        limited += !results.back().limits.empty();
+    }
+
+    return limited;
+}
+
+void TopologyStress::printResults(const Options &options, const std::vector<Result> &results)
+{
+    std::cout << "Segment of " << options.outputBytes << " B out / " << options.inputBytes << " B in per slave, "
+              << options.slaveDelayNs << " ns per slave, period " << options.periodNs / 1000.0 << " us, "
+              << options.threads << " startup thread(s), SDO " << options.mailboxLatencyUs << " us, EEPROM read "
+              << options.eepromReadUs << " us" << std::endl;
+
+    for (const auto &it : results)
+    {
+        if (it.plan.groups.empty())
+            continue;
+
+        const IoLayout::GroupPlan &group = it.plan.groups[0];
+
+        std::cout << it.slaves << " slaves: " << group.datagrams << " frame(s), " << it.plan.wireBytes
+                  << " wire bytes (" << (group.overlap ? "overlapped" : "separate") << "), round trip "
+                  << it.roundTripUs << " us" << std::endl;
+        std::cout << "\tcycle p" << options.percentile << ": exchange (packing model) " << it.exchangeUs
+                  << " us, application " << it.applicationUs << " us, min period " << it.minPeriodUs << " us"
+                  << std::endl;
+        std::cout << "\tstartup (model estimate from configured latencies): cold " << it.coldStartupSeconds
+                  << " s, warm " << it.warmStartupSeconds << " s, cold sequential " << it.sequentialStartupSeconds
+                  << " s" << std::endl;
+        std::cout << "\tmemory: IOmap " << it.plan.iomapSize << " B, master " << it.masterBytes / 1024
+                  << " KB, process RSS " << it.rssBytes / 1024 << " KB" << std::endl;
+        std::cout << "\tlimits:";
+
+        if (it.limits.empty())
+            std::cout << " none";
+
+        for (const char *limit : it.limits)
+            std::cout << " " << limit << ";";
+
+        std::cout << std::endl;
+    }
+
+    for (const auto &it : results)
+    {
+        if (!it.limits.empty())
+        {
+            std::cout << "First limit reached at " << it.slaves << " slaves: " << it.limits[0] << std::endl;
+            return;
+        }
+    }
+
+    if (!results.empty())
+        std::cout << "No limit reached up to " << results.back().slaves << " slaves" << std::endl;
+}
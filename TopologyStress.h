@@ -0,0 +1,65 @@
+#ifndef TOPOLOGYSTRESS_H
+#define TOPOLOGYSTRESS_H
+
+#include <stdint.h>
+#include <vector>
+#include "IoLayout.h"
+
+/**
+ * @brief Стресс-прогон мастера на программно смоделированном сегменте из сотен slave
+ * @details Для каждого числа slave
+ * 1. - строится план IOmap (IoLayout) по одинаковым slave, считаются кадры и байты на проводе
+ * 2. - выполняются циклы обмена над выделенным IOmap: модель упаковки датаграмм в кадры
+ *      и разбора ответов копированием памяти (код SOEM не вызывается), между ними модель
+ *      сегмента отвечает за каждый slave. Отдельно замеряется работа мастера на обмен
+ *      (не зависит от числа slave, кроме копирования байт) и приложение с осью на каждый slave
+ * 3. - оценивается запуск: SII и разметка PDO каждого slave как последовательность
+ *      снов на заданную задержку mailbox обмена, пулом потоков как в SiiReader::readAll и
+ *      NetworkConfig::syncPdoLayouts, холодный (пустой slave, нет кэша) и теплый.
+ *      Это оценка по модели, а не замер: SiiReader и EthercatCOE не вызываются
+ * 4. - считается память мастера
+ * и проверяются пределы SOEM и периода, чтобы показать, что ломается первым
+ */
+namespace TopologyStress
+{
+    struct Options
+    {
+        uint16_t firstSlaves;
+        uint16_t lastSlaves;
+        uint16_t step;
+        uint16_t outputBytes;           ///< Выходы одного slave (RxPDO)
+        uint16_t inputBytes;            ///< Входы одного slave (TxPDO)
+        uint32_t cycles;
+        int64_t periodNs;               ///< Проверяемый период цикла
+        int64_t slaveDelayNs;           ///< Задержка прохода кадра через один slave туда и обратно
+        int mailboxLatencyUs;           ///< Одна SDO транзакция
+        int eepromReadUs;               ///< Одно чтение EEPROM (8 байт)
+        int threads;                    ///< Потоки запуска, 0 - поток на каждый slave
+        double percentile;
+    };
+
+    constexpr Options DEFAULT_OPTIONS = {100, 500, 100, 12, 16, 5000, 1000000, 1000, 1000, 60, EC_MAXBUF / 2, 99.9};
+
+    struct Result
+    {
+        uint16_t slaves;
+        IoLayout::Plan plan;
+        double wireUs;                  ///< Передача всех кадров цикла на 100 Мбит/с
+        double roundTripUs;             ///< Передача и проход через все slave
+        double exchangeUs;              ///< Работа мастера на обмен, на процентиле
+        double applicationUs;           ///< Приложение (ось на каждый slave), на процентиле
+        double minPeriodUs;
+        double coldStartupSeconds;      ///< Параллельный запуск, оценка по модели задержек
+        double warmStartupSeconds;      ///< Теплый параллельный запуск, оценка по модели задержек
+        double sequentialStartupSeconds;    ///< Холодный запуск по одному slave, расчет
+        uint32_t masterBytes;           ///< IOmap, конфигурация и буферы мастера
+        uint64_t rssBytes;              ///< Резидентная память процесса после прогона
+        std::vector<const char*> limits;    ///< Нарушенные пределы, в порядке проверки
+    };
+
+    Result run(uint16_t slaves, const Options &options);
+    int runAll(const Options &options, std::vector<Result> &results);
+    void printResults(const Options &options, const std::vector<Result> &results);
+}
+
+#endif //TOPOLOGYSTRESS_H
@@ -0,0 +1,171 @@
+#include "Trace.h"
+
+#include <iostream>
+#include <cstdio>
+#include <vector>
+#include <thread>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "CycleTiming.h"
+
+std::atomic<bool> Trace::tracing{false};
+
+namespace
+{
+    std::vector<Trace::Span> spans;
+    std::atomic<uint32_t> reserved{0};
+    std::atomic<uint32_t> committed{0};
+    std::atomic<uint64_t> droppedSpans{0};
+
+    uint32_t threadId()
+    {
+        thread_local uint32_t id = static_cast<uint32_t>(syscall(SYS_gettid));
+        return id;
+    }
+
+    const char *categoryName(Trace::Category category)
+    {
+        switch (category)
+        {
+        case Trace::Category::STARTUP:
+            return "startup";
+        case Trace::Category::MAILBOX:
+            return "mailbox";
+        case Trace::Category::STATE:
+            return "state";
+        case Trace::Category::EEPROM:
+            return "eeprom";
+        default:
+            return "unknown";
+        }
+    }
+}
+
+/**
+ * @brief Выделение буфера интервалов
+ * @details Вызывается до первого setEnabled(true), повторный вызов при включенной
+ * трассировке запрещен
+ * @return 1 - успех, -1 - трассировка включена
+ */
+int Trace::init(uint32_t capacity)
+{
+    if (enabled())
+        return -1;
+
+    spans.assign(capacity, Span{});
+    clear();
+
+    return 1;
+}
+
+/**
+ * @brief Включение и выключение трассировки во время работы
+ * @return false - буфер не выделен
+ */
+bool Trace::setEnabled(bool enable)
+{
+    if (enable && spans.empty())
+        return false;
+
+    tracing.store(enable, std::memory_order_relaxed);
+
+    return true;
+}
+
+void Trace::clear()
+{
+    reserved.store(0);
+    committed.store(0);
+    droppedSpans.store(0);
+}
+
+void Trace::record(const Span &span)
+{
+    uint32_t slot = reserved.fetch_add(1, std::memory_order_relaxed);
+
+    if (slot >= spans.size())
+    {
+        reserved.fetch_sub(1, std::memory_order_relaxed);
+        droppedSpans.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    spans[slot] = span;
+    committed.fetch_add(1, std::memory_order_release);
+}
+
+uint32_t Trace::count()
+{
+    return committed.load(std::memory_order_acquire);
+}
+
+uint64_t Trace::dropped()
+{
+    return droppedSpans.load(std::memory_order_relaxed);
+}
+
+void Trace::Scope::begin(Category category, const char *name, uint16_t slave, uint16_t index, uint8_t subindex)
+{
+    span.name = name;
+    span.category = category;
+    span.slave = slave;
+    span.index = index;
+    span.subindex = subindex;
+    span.bytes = 0;
+    span.result = 0;
+    span.threadId = threadId();
+    span.startNs = CycleTiming::nowNs();
+}
+
+void Trace::Scope::end()
+{
+    span.durationNs = CycleTiming::nowNs() - span.startNs;
+    record(span);
+}
+
+/**
+ * @brief Выгрузка буфера в JSON формата Chrome trace (события "X")
+ * @details Интервалы, начатые до вызова, дописываются потоками-владельцами, поэтому перед
+ * выгрузкой ожидается их завершение (не дольше 100 мс). Время - в микросекундах
+ * CLOCK_MONOTONIC, поток - tid Linux
+ * @return число выгруженных интервалов, -1 - ошибка записи
+ */
+int Trace::exportJson(const char *path)
+{
+    for (int i = 0; i < 1000 && committed.load(std::memory_order_acquire) != reserved.load(std::memory_order_relaxed); i++)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+    uint32_t total = count();
+    FILE *file = fopen(path, "w");
+
+    if (file == nullptr)
+    {
+        std::cout << "Can't open trace file " << path << std::endl;
+        return -1;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"ethercat-test\"}}", getpid());
+
+    for (uint32_t i = 0; i < total; i++)
+    {
+        const Span &span = spans[i];
+
+        fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u,"
+                      "\"args\":{\"slave\":%u,\"index\":\"0x%04X\",\"subindex\":%u,\"bytes\":%d,\"result\":%d}}",
+                span.name, categoryName(span.category), span.startNs / 1000.0, span.durationNs / 1000.0, getpid(),
+                span.threadId, span.slave, span.index, span.subindex, span.bytes, span.result);
+    }
+
+    fprintf(file, "\n]}\n");
+
+    bool failed = ferror(file) != 0;
+
+    if (fclose(file) != 0 || failed)
+    {
+        std::cout << "Can't write trace file " << path << std::endl;
+        return -1;
+    }
+
+    return static_cast<int>(total);
+}
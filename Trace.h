@@ -0,0 +1,101 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * @brief Трассировка запуска и обмена через mailbox
+ * @details Интервалы (SDO/FoE/SDO Information, смена состояний, чтение EEPROM, этапы
+ * запуска) пишутся в заранее выделенный буфер: место занимается одним атомарным
+ * инкрементом, без блокировок и выделений памяти. Переполненный буфер отбрасывает новые
+ * интервалы и считает их. Выключенная трассировка стоит одной relaxed загрузки флага.
+ * Буфер выгружается в JSON формата Chrome trace, открывается в chrome://tracing и Perfetto
+ */
+namespace Trace
+{
+    constexpr uint32_t DEFAULT_CAPACITY = 65536;
+
+    enum class Category : uint8_t
+    {
+        STARTUP = 0,        ///< Этапы запуска (ec_config_init, ec_config_map, ...)
+        MAILBOX,            ///< Транзакции mailbox: SDO, FoE, SDO Information
+        STATE,              ///< Смена состояния AL
+        EEPROM              ///< Чтение SII EEPROM
+    };
+
+    struct Span
+    {
+        const char *name;           ///< Строковый литерал, копия не делается
+        Category category;
+        uint16_t slave;
+        uint16_t index;             ///< Индекс объекта, для STATE - требуемое состояние, для EEPROM - адрес в словах
+        uint8_t subindex;
+        int32_t bytes;
+        int32_t result;             ///< wkc либо итоговое состояние
+        uint32_t threadId;
+        int64_t startNs;            ///< CLOCK_MONOTONIC
+        int64_t durationNs;
+    };
+
+    extern std::atomic<bool> tracing;
+
+    inline bool enabled()
+    {
+        return tracing.load(std::memory_order_relaxed);
+    }
+
+    int init(uint32_t capacity);
+    bool setEnabled(bool enable);
+    void clear();
+
+    void record(const Span &span);
+
+    uint32_t count();
+    uint64_t dropped();
+
+    int exportJson(const char *path);
+
+    /**
+     * @brief Интервал на время жизни объекта
+     * @details При выключенной трассировке время не читается и ничего не пишется
+     */
+    class Scope
+    {
+    public:
+        Scope(Category category, const char *name, uint16_t slave = 0, uint16_t index = 0, uint8_t subindex = 0)
+            : active(enabled())
+        {
+            if (active)
+                begin(category, name, slave, index, subindex);
+        }
+
+        ~Scope()
+        {
+            if (active)
+                end();
+        }
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+        void setBytes(int32_t bytes)
+        {
+            span.bytes = bytes;
+        }
+
+        void setResult(int32_t result)
+        {
+            span.result = result;
+        }
+
+    private:
+        void begin(Category category, const char *name, uint16_t slave, uint16_t index, uint8_t subindex);
+        void end();
+
+        Span span;
+        bool active;
+    };
+}
+
+#endif //TRACE_H
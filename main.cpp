@@ -5,211 +5,112 @@
 #include <unistd.h>
 #include <inttypes.h>
 #include <math.h>
+#include <time.h>
+#include <cstdlib>
+#include <memory>
+#include <signal.h>
+#include <algorithm>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <pthread.h>
 #include "ethercat.h"
+#include "CoeTypes.h"
 #include "EthercatCOE.h"
-
-#define OTYPE_VAR               0x0007
-#define OTYPE_ARRAY             0x0008
-#define OTYPE_RECORD            0x0009
-
-#define ATYPE_Rpre              0x01
-#define ATYPE_Rsafe             0x02
-#define ATYPE_Rop               0x04
-#define ATYPE_Wpre              0x08
-#define ATYPE_Wsafe             0x10
-#define ATYPE_Wop               0x20
+#include "NetworkConfig.h"
+#include "ODScanner.h"
+#include "ProcessImage.h"
+#include "CommandChannel.h"
+#include "Cia402.h"
+#include "ControllerPipeline.h"
+#include "ControllerStages.h"
+#include "RtGuard.h"
+#include "FirmwareUpdate.h"
+#include "SiiReader.h"
+#include "SignalStats.h"
+#include "CycleTiming.h"
+#include "PdoRemap.h"
+#include "Diagnostics.h"
+#include "IoLayout.h"
+#include "Trace.h"
+#include "TopologyStress.h"
+
+using AxisPipeline = ControllerPipeline::Pipeline<ControllerStages::SetpointSource,
+                                                  ControllerStages::TorqueLimiter,
+                                                  ControllerStages::LowPassFilter,
+                                                  ControllerStages::Cia402Gate>;
 
 ec_ODlistt objectDescriptionList;
 ec_OElistt objectEntryInformationList;
 
+// Запрос перенастройки PDO по SIGUSR1
+volatile sig_atomic_t remapRequested = 0;
 
+// Переключение трассировки по SIGUSR2
+volatile sig_atomic_t traceToggleRequested = 0;
 
-struct currentPdoSubindexInfo
+// Полная перезапись разметки PDO без сравнения с текущей (--force-pdo-rewrite)
+bool forcePdoRewrite = false;
+
+/**
+ * @brief Выборочные замеры стадий конвейера за окно
+ */
+struct PipelineCost
 {
-    uint32_t subindex;
-    std::string name;
-    std::string type;
+    int64_t averageNs[AxisPipeline::STAGE_COUNT];
+    int64_t maxNs[AxisPipeline::STAGE_COUNT];
 };
 
-
-enum class CommandStates : uint8_t
+/**
+ * @brief Переход оси в FAULT, причину печатает поток вывода по последней диагностике
+ */
+struct AxisFault
 {
+    uint64_t cycle;
+    uint16_t statusWord;
+};
 
-    RESET_FAULT = 0,
-    SHUTDOWN,
-    SWITCH_ON,
-    OP,
-    FAULT
-}commandState = CommandStates::RESET_FAULT;
+// Период опроса очередей потоком вывода
+constexpr int CONSOLE_PERIOD_US = 20000;
 
-union StatusWord
-{
-    uint16_t data_16;
-    struct
-    {
-        uint8_t ready_to_switch_on: 1;
-        uint8_t switched_on: 1;
-        uint8_t operation_enabled: 1;
-        uint8_t fault: 1;
-        uint8_t voltage_enabled: 1;
-        uint8_t quick_stop: 1;
-        uint8_t switch_on_disabled: 1;
-        uint8_t warning: 1;
-        uint8_t manufacturer_specific_1: 1;
-        uint8_t remote: 1;
-        uint8_t target_reached: 1;
-        uint8_t internal_limit_active: 1;
-        uint8_t operation_mode_specific: 2;
-        uint8_t manufacturer_specific_2: 2;
-    };
-} ;
-
-union ControlWord
+/**
+ * @brief Отчеты цикла для вывода в консоль
+ * @details Цикл только копирует накопленные данные в lock-free очереди, печатает их
+ * отдельный поток без приоритета реального времени, поэтому iostream не попадает в цикл
+ */
+struct ConsoleReports
 {
-    uint16_t data_16;
-    struct
-    {
-        uint8_t switch_on: 1;
-        uint8_t enable_voltage: 1;
-        uint8_t quick_stop: 1;
-        uint8_t enable_operation: 1;
-        uint8_t op_mode_specific : 3;
-        uint8_t fault_reset : 1;
-        uint8_t halt : 1;
-        uint8_t reserved : 2;
-        uint8_t manufacturer_specific : 5;
-    };
+    MpscQueue<CommandChannel::LatencyStats, 4> commandLatency;
+    MpscQueue<PipelineCost, 4> pipelineCost;
+    MpscQueue<AxisFault, 4> axisFaults;
+    MpscQueue<RtGuard::Report, 2> rtViolations;
+    MpscQueue<CycleTiming::MissCounters, 4> deadlineMisses;
+    const char *tracePath = nullptr;
+    uint16_t remapSlave = 0;
+    const EthercatCOE::PDOLayout *remapLayout = nullptr;    ///< nullptr - перенастройка PDO не задана
+    std::atomic<bool> traceExportRequested{false};      ///< Трассировка выключена по SIGUSR2
+    std::atomic<bool> traceResumed{false};
+    std::atomic<bool> running{true};
+
+    ConsoleReports()
+    {
+        commandLatency.init();
+        pipelineCost.init();
+        axisFaults.init();
+        rtViolations.init();
+        deadlineMisses.init();
+    }
 };
 
-struct txPdoData_t
-{
-    ControlWord controlWord;
-    int8_t modesOfOperation;
-    int16_t targetTorque;
-} __attribute__((packed));
 
-struct rxPdoData_t
-{
-    StatusWord statusWord;
-    int8_t modesOfOperationDisplay;
-    int16_t torqueActualValue;
-} __attribute__((packed));
 
-char* otype2string(uint16 otype)
+struct currentPdoSubindexInfo
 {
-    static char str[32] = { 0 };
-
-    switch(otype)
-    {
-    case OTYPE_VAR:
-        sprintf(str, "VAR");
-        break;
-    case OTYPE_ARRAY:
-        sprintf(str, "ARRAY");
-        break;
-    case OTYPE_RECORD:
-        sprintf(str, "RECORD");
-        break;
-    default:
-        sprintf(str, "ot:0x%4.4X", otype);
-    }
-    return str;
-}
+    uint32_t subindex;
+    std::string name;
+    std::string type;
+};
 
-char* dtype2string(uint16 dtype, uint16 bitlen)
-{
-    static char str[32] = { 0 };
-
-    switch(dtype)
-    {
-    case ECT_BOOLEAN:
-        sprintf(str, "BOOLEAN");
-        break;
-    case ECT_INTEGER8:
-        sprintf(str, "INTEGER8");
-        break;
-    case ECT_INTEGER16:
-        sprintf(str, "INTEGER16");
-        break;
-    case ECT_INTEGER32:
-        sprintf(str, "INTEGER32");
-        break;
-    case ECT_INTEGER24:
-        sprintf(str, "INTEGER24");
-        break;
-    case ECT_INTEGER64:
-        sprintf(str, "INTEGER64");
-        break;
-    case ECT_UNSIGNED8:
-        sprintf(str, "UNSIGNED8");
-        break;
-    case ECT_UNSIGNED16:
-        sprintf(str, "UNSIGNED16");
-        break;
-    case ECT_UNSIGNED32:
-        sprintf(str, "UNSIGNED32");
-        break;
-    case ECT_UNSIGNED24:
-        sprintf(str, "UNSIGNED24");
-        break;
-    case ECT_UNSIGNED64:
-        sprintf(str, "UNSIGNED64");
-        break;
-    case ECT_REAL32:
-        sprintf(str, "REAL32");
-        break;
-    case ECT_REAL64:
-        sprintf(str, "REAL64");
-        break;
-    case ECT_BIT1:
-        sprintf(str, "BIT1");
-        break;
-    case ECT_BIT2:
-        sprintf(str, "BIT2");
-        break;
-    case ECT_BIT3:
-        sprintf(str, "BIT3");
-        break;
-    case ECT_BIT4:
-        sprintf(str, "BIT4");
-        break;
-    case ECT_BIT5:
-        sprintf(str, "BIT5");
-        break;
-    case ECT_BIT6:
-        sprintf(str, "BIT6");
-        break;
-    case ECT_BIT7:
-        sprintf(str, "BIT7");
-        break;
-    case ECT_BIT8:
-        sprintf(str, "BIT8");
-        break;
-    case ECT_VISIBLE_STRING:
-        sprintf(str, "VISIBLE_STR(%d)", bitlen);
-        break;
-    case ECT_OCTET_STRING:
-        sprintf(str, "OCTET_STR(%d)", bitlen);
-        break;
-    default:
-        sprintf(str, "dt:0x%4.4X (%d)", dtype, bitlen);
-    }
-    return str;
-}
-
-char* access2string(uint16 access)
-{
-    static char str[32] = { 0 };
-
-    sprintf(str, "%s%s%s%s%s%s",
-            ((access & ATYPE_Rpre) != 0 ? "R" : "_"),
-            ((access & ATYPE_Wpre) != 0 ? "W" : "_"),
-            ((access & ATYPE_Rsafe) != 0 ? "R" : "_"),
-            ((access & ATYPE_Wsafe) != 0 ? "W" : "_"),
-            ((access & ATYPE_Rop) != 0 ? "R" : "_"),
-            ((access & ATYPE_Wop) != 0 ? "W" : "_"));
-    return str;
-}
 
 void printObjectDescription(uint16_t slave)
 {
@@ -234,14 +135,16 @@ void printObjectDescription(uint16_t slave)
 
         ec_readODdescription(i, &objectDescriptionList);
 
-        std::cout << "Index: " << "0x" << std::hex << index << " [" << objectDescriptionList.Name[i] << "] " << "[" <<  otype2string(objectDescriptionList.ObjectCode[i]) << "]" << std::endl;
+        char objectCode[32];
+        CoeTypes::formatObjectCode(objectCode, sizeof(objectCode), objectDescriptionList.ObjectCode[i]);
+
+        std::cout << "Index: " << "0x" << std::hex << index << " [" << objectDescriptionList.Name[i] << "] " << "[" <<  objectCode << "]" << std::endl;
 
         ec_readOE(i, &objectDescriptionList, &objectEntryInformationList);
 
         if (objectDescriptionList.ObjectCode[i] != OTYPE_VAR)
         {
-            int l = sizeof(maxSubindexes);
-            int wkc = ec_SDOread(slave, objectDescriptionList.Index[i], 0, FALSE, &l, &maxSubindexes, EC_TIMEOUTRXM);
+            int wkc = EthercatCOE::read(slave, objectDescriptionList.Index[i], 0, maxSubindexes);
 
             if (wkc == 1 )
                 std::cout << "Good read (wkc: " << wkc << ")" << std::endl;
@@ -255,9 +158,15 @@ void printObjectDescription(uint16_t slave)
 
         for (int j = 0; j <= maxSubindexes; j++)
         {
+            char dataType[32];
+            char access[8];
+
+            CoeTypes::formatDataType(dataType, sizeof(dataType), objectEntryInformationList.DataType[j], objectEntryInformationList.BitLength[j]);
+            CoeTypes::formatAccess(access, sizeof(access), objectEntryInformationList.ObjAccess[j]);
+
             std::cout << "\t" << std::dec << j << ": " << objectEntryInformationList.Name[j] <<
-                    " [" << dtype2string(objectEntryInformationList.DataType[j], objectEntryInformationList.BitLength[j]) << "] = "
-                      << " [" << access2string(objectEntryInformationList.ObjAccess[j]) << "] " << std::endl;
+                    " [" << dataType << "] = "
+                      << " [" << access << "] " << std::endl;
         }
 
         std::cout << std::endl;
@@ -266,7 +175,7 @@ void printObjectDescription(uint16_t slave)
 
 int readInputPdoMapping(uint16_t slave, uint16_t pdoAssign)
 {
-    uint16_t pdo_number = 0;    // Число PDO объектов
+    uint8_t pdo_number = 0;    // Число PDO объектов
     uint16_t pdo_cnt = 0;
     uint32_t pdo_data = 0;
     uint16_t current_io_addr = 0;   // Используется для отображения PDO_description в iomap
@@ -275,15 +184,12 @@ int readInputPdoMapping(uint16_t slave, uint16_t pdoAssign)
     int bsize = 0;
     int wkc = 0;
 
-    int data_size = sizeof(pdo_number);
-
     // Получаем число PDO объектов с нулевого сабиндекса
-    wkc = ec_SDOread(slave, pdoAssign, 0x00, FALSE, &data_size, &pdo_number, EC_TIMEOUTRXM);
-    pdo_number = etohs(pdo_number); // Конвертация в зависимости от платформы
+    wkc = EthercatCOE::read(slave, pdoAssign, 0x00, pdo_number);
 
     if (wkc <= 0 || pdo_number <= 0)
     {
-        std::cout << "Can't get TxPDO mapping (wkc:" << wkc << ", pdo_number:" << pdo_number << ")" << std::endl;
+        std::cout << "Can't get TxPDO mapping (wkc:" << wkc << ", pdo_number:" << static_cast<int>(pdo_number) << ")" << std::endl;
         return -1;
     }
 
@@ -291,11 +197,7 @@ int readInputPdoMapping(uint16_t slave, uint16_t pdoAssign)
     {
         uint16_t currentIndex = 0;
 
-        data_size = sizeof(pdo_number);
-
-        wkc = ec_SDOread(slave, pdoAssign, (uint8_t)pdoCnt, FALSE, &data_size, &currentIndex, EC_TIMEOUTRXM);
-
-        currentIndex = etohs(currentIndex);
+        wkc = EthercatCOE::read(slave, pdoAssign, (uint8_t)pdoCnt, currentIndex);
 
         if (currentIndex <= 0)
         {
@@ -310,12 +212,10 @@ int readInputPdoMapping(uint16_t slave, uint16_t pdoAssign)
 
         uint8_t subindexNumber = 0;
 
-        data_size = sizeof(subindexNumber);
-
         std::cout << std::endl;
         std::cout << "Reading PDO subindex count..." << std::endl;
 
-        wkc = ec_SDOread(slave, currentIndex, 0x00, FALSE, &data_size, &subindexNumber, EC_TIMEOUTRXM);
+        wkc = EthercatCOE::read(slave, currentIndex, 0x00, subindexNumber);
 
         if (wkc <= 0)
         {
@@ -326,11 +226,9 @@ int readInputPdoMapping(uint16_t slave, uint16_t pdoAssign)
         std::cout << "Good read (wkc: " << wkc << ")" << std::endl;
         std::cout << std::endl;
 
-        data_size = sizeof(pdo_data);
-
         for (int iSubidx = 1; iSubidx <= subindexNumber; iSubidx++)
         {
-            ec_SDOread(slave, currentIndex, iSubidx, FALSE, &data_size, &pdo_data, EC_TIMEOUTRXM);
+            EthercatCOE::read(slave, currentIndex, iSubidx, pdo_data);
 
             uint16_t index = (uint16_t) (pdo_data >> 16);
             uint8_t subindex = (uint8_t) ( (pdo_data >> 8) & 0x000000ff);
@@ -370,7 +268,9 @@ int readInputPdoMapping(uint16_t slave, uint16_t pdoAssign)
 
             newInfo.subindex = static_cast<int>(subindex);
             newInfo.name = objectEntryInformationList.Name[subindex];
-            newInfo.type = dtype2string(objectEntryInformationList.DataType[subindex], bitlen);
+            char dataType[32];
+            CoeTypes::formatDataType(dataType, sizeof(dataType), objectEntryInformationList.DataType[subindex], bitlen);
+            newInfo.type = dataType;
 
             subindexesList.push_back(newInfo);
         }
@@ -390,7 +290,7 @@ int readInputPdoMapping(uint16_t slave, uint16_t pdoAssign)
 
 int readOutputPdoMapping(uint16_t slave, uint16_t pdoAssign)
 {
-    uint16_t pdo_number = 0;    // Число PDO объектов
+    uint8_t pdo_number = 0;    // Число PDO объектов
     uint16_t pdo_cnt = 0;
     uint32_t pdo_data = 0;
     uint16_t current_io_addr = 0;   // Используется для отображения PDO_description в iomap
@@ -399,15 +299,12 @@ int readOutputPdoMapping(uint16_t slave, uint16_t pdoAssign)
     int bsize = 0;
     int wkc = 0;
 
-    int data_size = sizeof(pdo_number);
-
     // Получаем число PDO объектов с нулевого сабиндекса
-    wkc = ec_SDOread(slave, pdoAssign, 0x00, FALSE, &data_size, &pdo_number, EC_TIMEOUTRXM);
-    pdo_number = etohs(pdo_number); // Конвертация в зависимости от платформы
+    wkc = EthercatCOE::read(slave, pdoAssign, 0x00, pdo_number);
 
     if (wkc <= 0 || pdo_number <= 0)
     {
-        std::cout << "Can't get RxPDO mapping (wkc:" << wkc << ", pdo_number:" << pdo_number << ")" << std::endl;
+        std::cout << "Can't get RxPDO mapping (wkc:" << wkc << ", pdo_number:" << static_cast<int>(pdo_number) << ")" << std::endl;
         return -1;
     }
 
@@ -415,11 +312,7 @@ int readOutputPdoMapping(uint16_t slave, uint16_t pdoAssign)
     {
         uint16_t currentIndex = 0;
 
-        data_size = sizeof(pdo_number);
-
-        wkc = ec_SDOread(slave, pdoAssign, (uint8_t)pdoCnt, FALSE, &data_size, &currentIndex, EC_TIMEOUTRXM);
-
-        currentIndex = etohs(currentIndex);
+        wkc = EthercatCOE::read(slave, pdoAssign, (uint8_t)pdoCnt, currentIndex);
 
         if (currentIndex <= 0)
         {
@@ -434,12 +327,10 @@ int readOutputPdoMapping(uint16_t slave, uint16_t pdoAssign)
 
         uint8_t subindexNumber = 0;
 
-        data_size = sizeof(subindexNumber);
-
         std::cout << std::endl;
         std::cout << "Reading PDO subindex count..." << std::endl;
 
-        wkc = ec_SDOread(slave, currentIndex, 0x00, FALSE, &data_size, &subindexNumber, EC_TIMEOUTRXM);
+        wkc = EthercatCOE::read(slave, currentIndex, 0x00, subindexNumber);
 
         if (wkc <= 0)
         {
@@ -450,14 +341,11 @@ int readOutputPdoMapping(uint16_t slave, uint16_t pdoAssign)
         std::cout << "Good read (wkc: " << wkc << ")" << std::endl;
         std::cout << std::endl;
 
-        data_size = sizeof(pdo_data);
         std::cout << "0x" << std::hex << currentIndex << std::endl;
 
         for (int iSubidx = 1; iSubidx <= subindexNumber; iSubidx++)
         {
-            ec_SDOread(slave, currentIndex, iSubidx, FALSE, &data_size, &pdo_data, EC_TIMEOUTRXM);
-
-            pdo_data = etohl(pdo_data);
+            EthercatCOE::read(slave, currentIndex, iSubidx, pdo_data);
 
             uint16_t index = (uint16_t) (pdo_data >> 16);
             uint8_t subindex = (uint8_t) ( (pdo_data >> 8) & 0x000000ff);
@@ -496,7 +384,9 @@ int readOutputPdoMapping(uint16_t slave, uint16_t pdoAssign)
 
             newInfo.subindex = subindex;
             newInfo.name = objectEntryInformationList.Name[subindex];
-            newInfo.type = dtype2string(objectEntryInformationList.DataType[subindex], bitlen);
+            char dataType[32];
+            CoeTypes::formatDataType(dataType, sizeof(dataType), objectEntryInformationList.DataType[subindex], bitlen);
+            newInfo.type = dataType;
 
             subindexesList.push_back(newInfo);
             std::cout << "\t" << std::dec << iSubidx << ": " << newInfo.name << " " << newInfo.type << std::endl;
@@ -525,15 +415,12 @@ void printPdoMapping(uint16_t slave)
     uint8_t syncManagerNumber, currentSyncManager = 0;
 
     int wkc = 0;
-    int syncManagerNumberSize = 0;
     int smBugAdd = 0;
 
     int outputsNum = 0;
     int inputsNum = 0;
 
-    syncManagerNumberSize = sizeof(syncManagerNumber);
-
-    wkc = ec_SDOread(slave, ECT_SDO_SMCOMMTYPE, 0x00, FALSE, &syncManagerNumberSize, &syncManagerNumber, EC_TIMEOUTRXM);
+    wkc = EthercatCOE::read(slave, ECT_SDO_SMCOMMTYPE, 0x00, syncManagerNumber);
 
     if (wkc <= 0 || syncManagerNumber <= 2)
     {
@@ -549,11 +436,9 @@ void printPdoMapping(uint16_t slave)
 
     for (int iSm = 2; iSm <= syncManagerNumber; iSm++)
     {
-        syncManagerNumberSize = sizeof(currentSyncManager);
-
         std::cout << "Reading current SM..." << std::endl;
 
-        wkc = ec_SDOread(slave, ECT_SDO_SMCOMMTYPE, iSm + 1, FALSE, &syncManagerNumberSize, &currentSyncManager, EC_TIMEOUTRXM);
+        wkc = EthercatCOE::read(slave, ECT_SDO_SMCOMMTYPE, iSm + 1, currentSyncManager);
 
         if (wkc <= 0)
         {
@@ -600,133 +485,651 @@ void printPdoMapping(uint16_t slave)
  */
 
 
+/**
+ * @brief Разметка оси, по которой цикл читает rxPdoData_t/txPdoData_t
+ */
+EthercatCOE::PDOLayout axisPdoLayout()
+{
+    EthercatCOE::PDOLayout layout = {};
+
+    layout.rxPdo.smIndex = static_cast<uint16_t>(EthercatCOE::SMIndex::SM_RPDO);
+    layout.rxPdo.pdoCount = 1;
+    layout.rxPdo.pdos[0] = {0x1608, 3, {{0x6040, 0, sizeof(uint16_t) * 8},
+                                        {0x6060, 0, sizeof(int8_t) * 8},
+                                        {0x6071, 0, sizeof(int16_t) * 8}}};
+
+    layout.txPdo.smIndex = static_cast<uint16_t>(EthercatCOE::SMIndex::SM_TPDO);
+    layout.txPdo.pdoCount = 1;
+    layout.txPdo.pdos[0] = {0x1A08, 3, {{0x6041, 0, sizeof(uint16_t) * 8},
+                                        {0x6061, 0, sizeof(int8_t) * 8},
+                                        {0x6077, 0, sizeof(int16_t) * 8}}};
+
+    return layout;
+}
+
 // PreOP to SafeOP state hook
 int po2soHook(uint16_t slave)
 {
-    int wkc = 0;
+    EthercatCOE::PDOLayout layout = axisPdoLayout();
 
     std::cout << std::endl;
     std::cout << "Set custom PDO map..." << std::endl;
 
-    std::cout << "\tClear input SM (0x1c13)...";
-    uint8_t pdoCounter = 0;
+    // Разметка читается из slave и переписывается, только если отличается
+    Trace::Scope span(Trace::Category::STARTUP, "PDO layout sync", slave);
+    EthercatCOE::PDOSyncReport report;
 
-    wkc = 0;
-    wkc = ec_SDOwrite(slave, static_cast<uint16_t>(0x1c13), 00, FALSE, sizeof(pdoCounter), &pdoCounter, EC_TIMEOUTRXM);
+    if (EthercatCOE::syncPDOLayout(slave, layout, forcePdoRewrite, report) <= 0)
+        std::cout << "\tBad PDO map write" << std::endl;
 
-    if (wkc == 1)
-        std::cout << "Good writing (wkc = 1)" << std::endl;
-    else
-        std::cout << "Bad writing (wkc = " << wkc << ")" << std::endl;
+    std::cout << "\t";
+    EthercatCOE::printPDOSyncReport(slave, report);
+    std::cout << std::endl;
 
-    wkc = 0;
+    return 1;
+}
 
-    std::cout << "\tClear output SM (0x1c12)...";
-    wkc = ec_SDOwrite(slave, static_cast<uint16_t>(0x1c12), 00, FALSE, sizeof(pdoCounter), &pdoCounter, EC_TIMEOUTRXM);
+/**
+ * @brief Офлайн сборка бинарной конфигурации сети из ENI/ESI XML или дампа
+ */
+int compileConfig(const char *inputPath, const char *outputPath)
+{
+    NetworkConfig::Config config;
 
-    if (wkc == 1)
-        std::cout << "Good write (wkc = 1)" << std::endl;
-    else
-        std::cout << "Bad write (wkc = " << wkc << ")" << std::endl;
+    if (NetworkConfig::compile(inputPath, config) < 0)
+        return -1;
 
-    std::cout << "\tReset RxPDO...";
-    wkc = 0;
+    NetworkConfig::print(config);
 
-    uint32_t clearObj =  0x656C3F00;
+    int size = NetworkConfig::save(outputPath, config);
 
-    wkc += ec_SDOwrite(slave, 0x1608, 00, FALSE, sizeof(clearObj), &clearObj, EC_TIMEOUTRXM);
-    wkc += ec_SDOwrite(slave, 0x1A08, 00, FALSE, sizeof(clearObj), &clearObj, EC_TIMEOUTRXM);
+    if (size < 0)
+        return -1;
 
-    if (wkc == 2)
-        std::cout << "Good write (wkc = 2)" << std::endl;
-    else
-        std::cout << "Bad write (wkc = " << wkc << ")" << std::endl;
+    std::cout << "Config written to " << outputPath << " (" << size << " bytes)" << std::endl;
 
-    std::cout << "\tSet PDO map...";
-    wkc = 0;
+    return 0;
+}
 
-    // RxPDO converted objects
-    uint32_t controlWordObj = (0x6040 << 16) | (0 << 8) | (sizeof(uint16_t) * 8);
-    uint32_t modesOfOpObj = (0x6060 << 16) | (0 << 8) | (sizeof(int8_t) * 8);
-    uint32_t targetTorqueObj = (0x6071 << 16) | (0 << 8) | (sizeof(int16_t) * 8);
+/**
+ * @brief Сканирование OD всех slave с выводом в JSON Lines или бинарном формате
+ * @details Slave после ec_config_init находятся в PreOP, этого достаточно для SDO Information
+ */
+int scanObjectDictionaries(const char *outputPath, ODScanner::OutputFormat format, int threads)
+{
+    FILE *out = stdout;
+
+    if (outputPath != nullptr)
+    {
+        out = fopen(outputPath, "wb");
+
+        if (out == nullptr)
+        {
+            std::cerr << "Can't open " << outputPath << std::endl;
+            return -1;
+        }
+    }
 
-    // TxPDO converted objects
-    uint32_t statusWordObj = (0x6041 << 16) | (0 << 8) | (sizeof(uint16_t) * 8);
-    uint32_t modesOfOpDisplayObj = (0x6061 << 16) | (0 << 8) | (sizeof(int8_t) * 8);
-    uint32_t torqueActualValueObj = (0x6077 << 16) | (0 << 8) | (sizeof(int16_t) * 8);
+    // Вывод результата может идти в stdout, поэтому статус пишется в stderr
+    timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-    wkc += ec_SDOwrite(slave, 0x1a08, 1, FALSE, sizeof(uint32_t), &statusWordObj, EC_TIMEOUTRXM);
-    wkc += ec_SDOwrite(slave, 0x1a08, 2, FALSE, sizeof(uint32_t), &modesOfOpDisplayObj, EC_TIMEOUTRXM);
-    wkc += ec_SDOwrite(slave, 0x1a08, 3, FALSE, sizeof(uint32_t), &torqueActualValueObj, EC_TIMEOUTRXM);
+    ODScanner::ScanResult result = ODScanner::scan(out, format, threads);
 
-    wkc += ec_SDOwrite(slave, 0x1608, 1, FALSE, sizeof(uint32_t), &controlWordObj, EC_TIMEOUTRXM);
-    wkc += ec_SDOwrite(slave, 0x1608, 2, FALSE, sizeof(uint32_t), &modesOfOpObj, EC_TIMEOUTRXM);
-    wkc += ec_SDOwrite(slave, 0x1608, 3, FALSE, sizeof(uint32_t), &targetTorqueObj, EC_TIMEOUTRXM);
+    clock_gettime(CLOCK_MONOTONIC, &end);
 
-    if (wkc == 6)
-        std::cout << "Good write (wkc = 6)" << std::endl;
-    else
-        std::cout << "Bad write (wkc = " << wkc << ")" << std::endl;
+    if (out != stdout)
+        fclose(out);
 
-    // Set PDO counters
-    std::cout << "\tSet PDOs counters...";
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
 
-    uint32_t rxPdoCounter = 0x776F4000 + 3;
-    uint32_t txPdoCounter = 0x776F4000 + 3;
+    std::cerr << "Scanned " << result.slaves << " slave(s), " << result.objects << " objects, "
+              << result.entries << " entries in " << seconds << " s";
+    if (result.failedSlaves)
+        std::cerr << " (" << result.failedSlaves << " slave(s) without OD)";
+    std::cerr << std::endl;
 
-    wkc = 0;
-    wkc += ec_SDOwrite(slave, 0x1608, 0, FALSE, sizeof(uint32_t), &rxPdoCounter, EC_TIMEOUTRXM);
-    wkc += ec_SDOwrite(slave, 0x1A08, 0, FALSE, sizeof(uint32_t), &txPdoCounter, EC_TIMEOUTRXM);
+    return result.failedSlaves == 0 ? 0 : -1;
+}
 
-    if (wkc == 2)
-        std::cout << "Good write (wkc = 2)" << std::endl;
-    else
-        std::cout << "Bad write (wkc = " << wkc << ")" << std::endl;
+/**
+ * @brief Вывод процессного образа, опубликованного другим процессом мастера
+ * @details Пример использования клиентской библиотеки ProcessImage
+ */
+int monitorProcessImage(const char *name)
+{
+    ProcessImage::Subscriber subscriber;
 
-    // Add PDOs to SMs
-    std::cout << "\tSet PDOs to SMs...";
+    if (!subscriber.open(name))
+    {
+        std::cout << "Can't open process image " << name << std::endl;
+        return -1;
+    }
 
-    wkc = 0;
+    std::vector<uint8_t> iomap(subscriber.iomapSize());
+    ProcessImage::CycleInfo info;
+    uint64_t lastCycle = 0;
 
-    uint16_t rxPdoIndex = 0x1608;
-    uint16_t txPdoIndex = 0x1A08;
+    while (true)
+    {
+        if (subscriber.read(info, iomap.data(), iomap.size()) && info.cycle != lastCycle)
+        {
+            std::cout << "cycle " << info.cycle << " wkc " << info.wkc << "/" << info.expectedWkc << " axes";
+            for (int i = 0; i < subscriber.axisCount(); i++)
+                std::cout << " " << static_cast<int>(info.axisStates[i]);
+            std::cout << std::endl;
 
-    wkc += ec_SDOwrite(slave, 0x1c13, 1, FALSE, sizeof(txPdoIndex), &txPdoIndex, EC_TIMEOUTRXM);
-    wkc += ec_SDOwrite(slave, 0x1c12, 1, FALSE, sizeof(rxPdoIndex), &rxPdoIndex, EC_TIMEOUTRXM);
+            lastCycle = info.cycle;
+        }
 
-    if (wkc == 2)
-        std::cout << "Good write (wkc = 3)" << std::endl;
-    else
-        std::cout << "Bad write (wkc = " << wkc << ")" << std::endl;
+        usleep(100000);
+    }
 
-    // Set SMs PDO counter
-    std::cout << "\tSet PDO counter to SMs...";
+    return 0;
+}
 
-    uint8_t rxPdoNumber = 1;
-    uint8_t txPdoNumber = 1;
+/**
+ * @brief Отправка одной команды в канал команд работающего мастера
+ */
+int sendCommand(const char *name, const CommandChannel::Command &command)
+{
+    CommandChannel::Client client;
 
-    wkc = 0;
-    wkc += ec_SDOwrite(slave, 0x1c13, 00, FALSE, sizeof(rxPdoNumber), &rxPdoNumber, EC_TIMEOUTRXM);
-    wkc += ec_SDOwrite(slave, 0x1c12, 00, FALSE, sizeof(txPdoNumber), &txPdoNumber, EC_TIMEOUTRXM);
+    if (!client.open(name))
+    {
+        std::cout << "Can't open command channel " << name << std::endl;
+        return -1;
+    }
 
-    if (wkc == 2)
-        std::cout << "Good write (wkc = 2)" << std::endl;
-    else
-        std::cout << "Bad write (wkc = " << wkc << ")" << std::endl;
+    if (!client.submit(command))
+    {
+        std::cout << "Command queue is full" << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
 
+/**
+ * @brief Обновление прошивки выбранных slave с выводом отчета
+ */
+int updateFirmware(FirmwareUpdate::Transport &transport, const std::vector<uint16_t> &slaves, int slaveCount,
+                   const char *imagePath, const FirmwareUpdate::Options &options)
+{
+    if (slaves.empty())
+    {
+        std::cout << "No slaves selected for firmware update" << std::endl;
+        return -1;
+    }
+
+    // Номер 0 адресует весь сегмент, номера больше числа slave - за таблицей ec_slave
+    for (uint16_t slave : slaves)
+    {
+        if (slave == 0 || slave > slaveCount)
+        {
+            std::cout << "Slave " << slave << " is out of range 1.." << slaveCount << std::endl;
+            return -1;
+        }
+    }
+
+    std::cout << "Updating " << slaves.size() << " slave(s) with " << imagePath << std::endl;
+
+    std::vector<FirmwareUpdate::SlaveResult> results = FirmwareUpdate::update(transport, slaves, imagePath, options);
+
+    if (results.empty())
+        return -1;
+
+    FirmwareUpdate::printReport(results);
+
+    for (const auto &it : results)
+    {
+        if (it.status != FirmwareUpdate::Status::OK)
+            return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Вывод оконной статистики входов по осям
+ */
+void printSignalStats(const SignalStats::Snapshot &snapshot)
+{
+    for (int axis = 0; axis < snapshot.axisCount; axis++)
+    {
+        std::cout << "Axis " << axis << " (" << snapshot.samples << " cycles):";
+
+        for (int c = 0; c < SignalStats::CHANNEL_COUNT; c++)
+        {
+            std::cout << " " << SignalStats::channelName(static_cast<SignalStats::Channel>(c))
+                      << " " << snapshot.min[c][axis] << "/" << snapshot.max[c][axis]
+                      << " mean " << snapshot.mean[c][axis] << " rms " << snapshot.rms[c][axis] << ";";
+        }
+
+        std::cout << std::endl;
+    }
+}
+
+void printCommandLatency(const CommandChannel::LatencyStats &latency)
+{
+    std::cout << "Command latency: " << latency.count << " cmds, min " << latency.minNs / 1000
+              << " us, avg " << latency.sumNs / latency.count / 1000
+              << " us, p99 " << latency.percentileNs(99.0) / 1000
+              << " us, max " << latency.maxNs / 1000 << " us, rejected " << latency.overflow
+              << ", stalled " << latency.stalled << std::endl;
+}
+
+void printPipelineCost(const PipelineCost &cost)
+{
+    std::cout << "Pipeline cost:";
+    for (size_t i = 0; i < AxisPipeline::STAGE_COUNT; i++)
+        std::cout << " " << AxisPipeline::stageName(i) << " " << cost.averageNs[i] << "/" << cost.maxNs[i] << " ns";
     std::cout << std::endl;
+}
 
-    return 1;
+void exportTrace(const char *tracePath)
+{
+    if (tracePath == nullptr)
+        return;
+
+    int spans = Trace::exportJson(tracePath);
+
+    if (spans >= 0)
+    {
+        std::cout << "Trace with " << spans << " span(s) written to " << tracePath;
+        if (Trace::dropped())
+            std::cout << " (" << Trace::dropped() << " dropped, buffer full)";
+        std::cout << std::endl;
+    }
+}
+
+/**
+ * @brief Поток вывода отчетов цикла
+ * @details Снимки статистики входов читаются через seqlock коллектора, цикл их только публикует.
+ * Поток - единственный потребитель очереди диагностики. События читаются раньше отказов оси,
+ * поэтому к отказу прикладывается диагностика, пришедшая до него. Выгрузка трассировки
+ * ждет незавершенных интервалов и пишет файл, поэтому тоже выполняется здесь.
+ * Перенастройка PDO по SIGUSR1 запускается этим потоком: поток перенастройки наследует
+ * политику планирования и не должен получать приоритет цикла
+ */
+void printConsoleReports(ConsoleReports &reports, const SignalStats::Collector &signalStats,
+                         Diagnostics::Service &diagnostics, PdoRemap::Remapper &pdoRemapper)
+{
+    // Запущенный через chrt процесс передает потоку политику реального времени, выводу она не нужна
+    sched_param param = {};
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+
+    CommandChannel::LatencyStats latency;
+    PipelineCost cost;
+    SignalStats::Snapshot statsSnapshot;
+    uint64_t statsPrinted = 0;
+    Diagnostics::Event diagEvent;
+    Diagnostics::Event axisDiagnosis = {};
+    AxisFault fault;
+    static RtGuard::Report rtReport;
+    CycleTiming::MissCounters misses;
+    PdoRemap::Report remapReport;
+
+    while (reports.running.load(std::memory_order_relaxed))
+    {
+        if (signalStats.published() != statsPrinted && signalStats.read(statsSnapshot))
+        {
+            statsPrinted = signalStats.published();
+            printSignalStats(statsSnapshot);
+        }
+
+        while (reports.commandLatency.pop(latency))
+            printCommandLatency(latency);
+
+        while (reports.pipelineCost.pop(cost))
+            printPipelineCost(cost);
+
+        while (diagnostics.poll(diagEvent))
+        {
+            Diagnostics::print(diagEvent);
+
+            if (diagEvent.slave == 1)
+                axisDiagnosis = diagEvent;
+        }
+
+        while (reports.rtViolations.pop(rtReport))
+            RtGuard::print(rtReport);
+
+        while (reports.deadlineMisses.pop(misses))
+            CycleTiming::printCounters(misses);
+
+        if (reports.traceExportRequested.exchange(false))
+            exportTrace(reports.tracePath);
+
+        if (reports.traceResumed.exchange(false))
+            std::cout << "Tracing resumed" << std::endl;
+
+        if (remapRequested)
+        {
+            remapRequested = 0;
+
+            if (reports.remapLayout != nullptr && !pdoRemapper.start(reports.remapSlave, *reports.remapLayout))
+                std::cout << "Can't start PDO remap of slave " << reports.remapSlave << std::endl;
+        }
+
+        if (pdoRemapper.finished(remapReport))
+            PdoRemap::printReport(remapReport);
+
+        while (reports.axisFaults.pop(fault))
+        {
+            std::cout << "Axis 0 fault at cycle " << fault.cycle << ", statusWord " << fault.statusWord;
+
+            if (axisDiagnosis.timestampNs != 0)
+            {
+                std::cout << ", last diagnosis:" << std::endl;
+                Diagnostics::print(axisDiagnosis);
+            }
+            else
+            {
+                std::cout << ", no diagnosis yet" << std::endl;
+            }
+        }
+
+        usleep(CONSOLE_PERIOD_US);
+    }
 }
 
-int main()
+void requestRemap(int)
+{
+    remapRequested = 1;
+}
+
+void requestTraceToggle(int)
+{
+    traceToggleRequested = 1;
+}
+
+/**
+ * @brief Стресс-прогон на смоделированном сегменте, сеть не нужна
+ */
+int stressTopologyScaling(TopologyStress::Options options, int64_t periodNs, int startupThreads)
 {
-    char ioMap[4096];
-    memset(ioMap, 0, 4096);
+    // Оси CiA 402: controlWord и statusWord занимают первые 2 байта
+    options.outputBytes = std::max<uint16_t>(options.outputBytes, 2);
+    options.inputBytes = std::max<uint16_t>(options.inputBytes, 2);
+    options.periodNs = periodNs;
+    options.threads = startupThreads;
+
+    std::vector<TopologyStress::Result> results;
+
+    if (TopologyStress::runAll(options, results) < 0)
+        return -1;
+
+    TopologyStress::printResults(options, results);
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *configPath = nullptr;
+    const char *dumpConfigPath = nullptr;
+    const char *outputPath = nullptr;
+    const char *interfaceName = "enp3s0";
+    const char *shmName = nullptr;
+    const char *commandChannelName = nullptr;
+    bool scanOD = false;
+    bool monitor = false;
+    bool stressTopology = false;
+    TopologyStress::Options stressOptions = TopologyStress::DEFAULT_OPTIONS;
+    bool command = false;
+    RtGuard::Mode rtMode = RtGuard::Mode::OFF;
+    CommandChannel::Command externalCommand = {};
+    ODScanner::OutputFormat scanFormat = ODScanner::OutputFormat::JSON_LINES;
+    int scanThreads = 0;
+    uint32_t statsWindow = 1000;
+    CycleTiming::CycleConfig cycleConfig = CycleTiming::DEFAULT_CONFIG;
+    CycleTiming::SweepOptions sweepOptions = CycleTiming::DEFAULT_SWEEP;
+    CycleTiming::MissPolicy missPolicy = CycleTiming::DEFAULT_MISS_POLICY;
+    bool tuneCycle = false;
+    uint16_t remapSlave = 0;
+    int diagPeriodUs = 10000;
+    const char *remapConfigPath = nullptr;
+    bool dcSync = false;
+    const char *tracePath = nullptr;
+    // Каждый mailbox обмен занимает индекс кадра SOEM, половина индексов остается циклу
+    int startupThreads = EC_MAXBUF / 2;
+    uint32_t traceCapacity = Trace::DEFAULT_CAPACITY;
+    bool ioPlan = false;
+    std::vector<std::pair<int, int>> ioGroups;
+    const char *siiCacheDir = SiiReader::DEFAULT_CACHE_DIR;
+    const char *firmwarePath = nullptr;
+    std::vector<uint16_t> firmwareSlaves;
+    uint32_t firmwareVendor = 0;
+    uint32_t firmwareProduct = 0;
+    int simulatedSlaves = 0;
+    FirmwareUpdate::Options firmwareOptions = {"firmware", 0, false, 0};
+
+    if (argc >= 2 && strcmp(argv[1], "compile-config") == 0)
+    {
+        if (argc != 4)
+        {
+            std::cout << "Usage: " << argv[0] << " compile-config <eni.xml|esi.xml|dump.bin> <config.bin>" << std::endl;
+            return -1;
+        }
+
+        return compileConfig(argv[2], argv[3]);
+    }
+
+    if (argc >= 3 && strcmp(argv[1], "foe-update") == 0)
+        firmwarePath = argv[2];
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "scan-od") == 0)
+            scanOD = true;
+        else if (strcmp(argv[i], "monitor") == 0)
+            monitor = true;
+        else if (strcmp(argv[i], "stress-topology") == 0)
+            stressTopology = true;
+        else if (strcmp(argv[i], "--stress-from") == 0 && i + 1 < argc)
+            stressOptions.firstSlaves = static_cast<uint16_t>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--stress-to") == 0 && i + 1 < argc)
+            stressOptions.lastSlaves = static_cast<uint16_t>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--stress-step") == 0 && i + 1 < argc)
+            stressOptions.step = static_cast<uint16_t>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--stress-out-bytes") == 0 && i + 1 < argc)
+            stressOptions.outputBytes = static_cast<uint16_t>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--stress-in-bytes") == 0 && i + 1 < argc)
+            stressOptions.inputBytes = static_cast<uint16_t>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--stress-cycles") == 0 && i + 1 < argc)
+            stressOptions.cycles = static_cast<uint32_t>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--stress-slave-delay-ns") == 0 && i + 1 < argc)
+            stressOptions.slaveDelayNs = atoll(argv[++i]);
+        else if (strcmp(argv[i], "--stress-sdo-us") == 0 && i + 1 < argc)
+            stressOptions.mailboxLatencyUs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--stress-eeprom-us") == 0 && i + 1 < argc)
+            stressOptions.eepromReadUs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc)
+            shmName = argv[++i];
+        else if (strcmp(argv[i], "--rt") == 0)
+            rtMode = RtGuard::Mode::COUNT;
+        else if (strcmp(argv[i], "--rt-trap") == 0)
+            rtMode = RtGuard::Mode::TRAP;
+        else if (strcmp(argv[i], "command") == 0)
+            command = true;
+        else if (strcmp(argv[i], "--cmd") == 0 && i + 1 < argc)
+            commandChannelName = argv[++i];
+        else if (strcmp(argv[i], "--axis") == 0 && i + 1 < argc)
+            externalCommand.axis = static_cast<uint16_t>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--torque") == 0 && i + 1 < argc)
+        {
+            externalCommand.targetTorque = static_cast<int16_t>(atoi(argv[++i]));
+            externalCommand.flags |= CommandChannel::SET_TORQUE;
+        }
+        else if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc)
+        {
+            externalCommand.mode = static_cast<int8_t>(atoi(argv[++i]));
+            externalCommand.flags |= CommandChannel::SET_MODE;
+        }
+        else if (strcmp(argv[i], "--enable") == 0)
+            externalCommand.flags |= CommandChannel::ENABLE;
+        else if (strcmp(argv[i], "--disable") == 0)
+            externalCommand.flags |= CommandChannel::DISABLE;
+        else if (strcmp(argv[i], "--fault-reset") == 0)
+            externalCommand.flags |= CommandChannel::FAULT_RESET;
+        else if (strcmp(argv[i], "--ifname") == 0 && i + 1 < argc)
+            interfaceName = argv[++i];
+        else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc)
+            configPath = argv[++i];
+        else if (strcmp(argv[i], "--dump-config") == 0 && i + 1 < argc)
+            dumpConfigPath = argv[++i];
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            outputPath = argv[++i];
+        else if (strcmp(argv[i], "--binary") == 0)
+            scanFormat = ODScanner::OutputFormat::BINARY;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            scanThreads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--period-us") == 0 && i + 1 < argc)
+            cycleConfig.periodNs = static_cast<int64_t>(atof(argv[++i]) * 1000);
+        else if (strcmp(argv[i], "--rx-timeout-us") == 0 && i + 1 < argc)
+            cycleConfig.receiveTimeoutUs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--dc-shift-us") == 0 && i + 1 < argc)
+            cycleConfig.dcShiftNs = static_cast<int64_t>(atof(argv[++i]) * 1000);
+        else if (strcmp(argv[i], "--miss-skip-compute") == 0)
+            missPolicy.skipCompute = true;
+        else if (strcmp(argv[i], "--miss-catch-up") == 0)
+            missPolicy.catchUp = true;
+        else if (strcmp(argv[i], "--miss-fault-after") == 0 && i + 1 < argc)
+            missPolicy.faultAfter = static_cast<uint32_t>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--miss-tolerance-us") == 0 && i + 1 < argc)
+            missPolicy.toleranceNs = static_cast<int64_t>(atof(argv[++i]) * 1000);
+        else if (strcmp(argv[i], "--dc-sync") == 0)
+            dcSync = true;
+        else if (strcmp(argv[i], "--startup-threads") == 0 && i + 1 < argc)
+            startupThreads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            tracePath = argv[++i];
+        else if (strcmp(argv[i], "--trace-capacity") == 0 && i + 1 < argc)
+            traceCapacity = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        else if (strcmp(argv[i], "--force-pdo-rewrite") == 0)
+            forcePdoRewrite = true;
+        else if (strcmp(argv[i], "--io-plan") == 0)
+            ioPlan = true;
+        else if (strcmp(argv[i], "--io-group") == 0 && i + 1 < argc)
+        {
+            int first = 0;
+            int last = 0;
+
+            if (sscanf(argv[++i], "%d-%d", &first, &last) == 2)
+                ioGroups.emplace_back(first, last);
+        }
+        else if (strcmp(argv[i], "--tune-cycle") == 0)
+            tuneCycle = true;
+        else if (strcmp(argv[i], "--tune-percentile") == 0 && i + 1 < argc)
+            sweepOptions.percentile = atof(argv[++i]);
+        else if (strcmp(argv[i], "--diag-period-us") == 0 && i + 1 < argc)
+            diagPeriodUs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--remap-slave") == 0 && i + 1 < argc)
+            remapSlave = static_cast<uint16_t>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--remap-config") == 0 && i + 1 < argc)
+            remapConfigPath = argv[++i];
+        else if (strcmp(argv[i], "--stats-window") == 0 && i + 1 < argc)
+            statsWindow = static_cast<uint32_t>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--sii-cache") == 0 && i + 1 < argc)
+            siiCacheDir = argv[++i];
+        else if (strcmp(argv[i], "--no-sii-cache") == 0)
+            siiCacheDir = nullptr;
+        else if (strcmp(argv[i], "--slave") == 0 && i + 1 < argc)
+        {
+            // Без обрезки до uint16_t: 65537 не должен стать slave 1
+            int slave = atoi(argv[++i]);
 
-    std::string interfaceName = "enp3s0";
+            if (slave < 1 || slave > UINT16_MAX)
+            {
+                std::cout << "Invalid slave number " << argv[i] << std::endl;
+                return -1;
+            }
+
+            firmwareSlaves.push_back(static_cast<uint16_t>(slave));
+        }
+        else if (strcmp(argv[i], "--vendor") == 0 && i + 1 < argc)
+            firmwareVendor = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        else if (strcmp(argv[i], "--product") == 0 && i + 1 < argc)
+            firmwareProduct = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        else if (strcmp(argv[i], "--foe-name") == 0 && i + 1 < argc)
+            firmwareOptions.fileName = argv[++i];
+        else if (strcmp(argv[i], "--password") == 0 && i + 1 < argc)
+            firmwareOptions.password = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        else if (strcmp(argv[i], "--verify") == 0)
+            firmwareOptions.verify = true;
+        else if (strcmp(argv[i], "--parallel") == 0 && i + 1 < argc)
+            firmwareOptions.maxParallel = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--simulate") == 0 && i + 1 < argc)
+            simulatedSlaves = atoi(argv[++i]);
+    }
 
-    if (ec_init(interfaceName.c_str()) == 0)
+    // С нулевым периодом CycleClock::end не найдет следующий дедлайн
+    if (cycleConfig.periodNs <= 0)
+    {
+        std::cout << "--period-us must be positive" << std::endl;
+        return -1;
+    }
+
+    // Подбор меняет период в OP, а SYNC0 настраивается до OP по заданному периоду
+    if (tuneCycle && dcSync)
+    {
+        std::cout << "--tune-cycle can't be combined with --dc-sync, tune first and pass the printed options" << std::endl;
+        return -1;
+    }
+
+    if (monitor)
+        return monitorProcessImage(shmName != nullptr ? shmName : ProcessImage::DEFAULT_NAME);
+
+    if (stressTopology)
+        return stressTopologyScaling(stressOptions, cycleConfig.periodNs, startupThreads);
+
+    if (command)
+        return sendCommand(commandChannelName != nullptr ? commandChannelName : CommandChannel::DEFAULT_NAME, externalCommand);
+
+    if (firmwarePath != nullptr && simulatedSlaves > 0)
+    {
+        // Программная модель: 1 КБ mailbox, 1 мс на сегмент, как при работе через цикл 1 мс
+        FirmwareUpdate::SimulatedTransport transport(simulatedSlaves, 1024, 1000);
+
+        if (firmwareSlaves.empty())
+        {
+            for (int i = 1; i <= simulatedSlaves; i++)
+                firmwareSlaves.push_back(static_cast<uint16_t>(i));
+        }
+
+        return updateFirmware(transport, firmwareSlaves, simulatedSlaves, firmwarePath, firmwareOptions);
+    }
+
+    NetworkConfig::Config config;
+
+    if (configPath != nullptr && NetworkConfig::load(configPath, config) < 0)
+        return -1;
+
+    if (ioPlan && configPath == nullptr)
+    {
+        std::cout << "--io-plan needs --config with process data sizes" << std::endl;
+        return -1;
+    }
+
+    // Группа 0 в SOEM - все slave, поэтому остальные slave идут в группу 1, диапазоны --io-group
+    // в группы 2..n. При EC_MAXGROUP=2 доступна только группа 1 и отдельный диапазон невозможен
+    if (!ioGroups.empty() && ioGroups.size() + 2 > EC_MAXGROUP)
+    {
+        std::cout << "--io-group needs EC_MAXGROUP of at least " << ioGroups.size() + 2
+                  << ", SOEM is built with " << EC_MAXGROUP << std::endl;
+        return -1;
+    }
+
+    if (tracePath != nullptr)
+    {
+        // Буфер выделяется до запуска, SIGUSR2 выключает трассировку с выгрузкой и включает снова
+        Trace::init(traceCapacity);
+        Trace::setEnabled(true);
+        signal(SIGUSR2, requestTraceToggle);
+    }
+
+    if (ec_init(interfaceName) == 0)
     {
         std::cout << "ERROR with init network. Start app with root permission!" << std::endl;
         return -1;
@@ -734,7 +1137,10 @@ int main()
 
     std::cout << "Network initialized at " << interfaceName << std::endl;
 
-    ec_config_init(FALSE);
+    {
+        Trace::Scope span(Trace::Category::STARTUP, "ec_config_init");
+        span.setResult(ec_config_init(FALSE));
+    }
 
     if (ec_slavecount == 0)
     {
@@ -743,45 +1149,181 @@ int main()
         return -1;
     }
 
-    int wkc;
+    if (firmwarePath != nullptr)
+    {
+        FirmwareUpdate::SoemTransport transport;
 
-    std::cout << "Found " << ec_slavecount << " slave(s)" << std::endl;
+        if (firmwareSlaves.empty())
+            firmwareSlaves = FirmwareUpdate::selectSlaves(firmwareVendor, firmwareProduct);
 
-    // Прикрепляем коллбек при переходе из PreOP в SafeOP для маппинга PDO
-    for (int i = 1; i <= ec_slavecount; i++)
+        int result = updateFirmware(transport, firmwareSlaves, ec_slavecount, firmwarePath, firmwareOptions);
+        exportTrace(tracePath);
+        ec_close();
+        return result;
+    }
+
+    if (scanOD)
     {
-        ec_slave[i].PO2SOconfig = po2soHook;
+        int result = scanObjectDictionaries(outputPath, scanFormat, scanThreads);
+        exportTrace(tracePath);
+        ec_close();
+        return result;
     }
 
-    int iomapSize = ec_config_map(&ioMap);
+    int wkc;
 
-    if (iomapSize > sizeof(ioMap))
+    std::cout << "Found " << ec_slavecount << " slave(s)" << std::endl;
+
+    if (configPath != nullptr)
     {
-        return -1;
+        // Сеть должна совпадать с конфигурацией, разметка PDO и SM берутся из неё
+        if (NetworkConfig::verifyIdentity(config) != 0)
+        {
+            std::cout << "Network doesn't match " << configPath << std::endl;
+            ec_close();
+            return -1;
+        }
+
+        NetworkConfig::apply(config, forcePdoRewrite);
+
+        int failedLayouts = NetworkConfig::syncPdoLayouts(config, startupThreads, forcePdoRewrite);
+
+        if (failedLayouts > 0)
+            std::cout << failedLayouts << " slave(s) failed PDO layout sync, retrying in ec_config_map" << std::endl;
     }
+    else
+    {
+        // Прикрепляем коллбек при переходе из PreOP в SafeOP для маппинга PDO
+        for (int i = 1; i <= ec_slavecount; i++)
+        {
+            ec_slave[i].PO2SOconfig = po2soHook;
+        }
 
-    ec_configdc();
+        // Разметка оси пишется заранее пулом потоков, хук остается только у slave с ошибкой
+        NetworkConfig::Config axisConfig = {};
+        NetworkConfig::SlaveConfig axisSlave;
+        memset(&axisSlave, 0, sizeof(axisSlave));
+        axisSlave.flags = NetworkConfig::HAS_PDO_LAYOUT;
+        axisSlave.outputsOffset = NetworkConfig::NO_OFFSET;
+        axisSlave.inputsOffset = NetworkConfig::NO_OFFSET;
+        axisSlave.pdoLayout = axisPdoLayout();
+        axisConfig.slaves.assign(ec_slavecount, axisSlave);
 
-    ec_statecheck(0, EC_STATE_SAFE_OP, EC_TIMEOUTSTATE);
+        int failedLayouts = NetworkConfig::syncPdoLayouts(axisConfig, startupThreads, forcePdoRewrite);
 
-    for(int cnt = 1 ; cnt <= ec_slavecount ; cnt++)
+        if (failedLayouts > 0)
+            std::cout << failedLayouts << " slave(s) failed PDO layout sync, retrying in ec_config_map" << std::endl;
+    }
+
+    // Без плана - одна группа 0, как у ec_config_map
+    IoLayout::Plan ioLayout = IoLayout::planDefault(config);
+    int iomapSize;
+
+    if (ioPlan)
     {
-        uint16_t ssigen = ec_siifind(cnt, ECT_SII_GENERAL);
-        if(ssigen)
+        std::vector<uint8_t> slaveGroups;
+
+        if (!ioGroups.empty())
         {
-            ec_slave[cnt].CoEdetails = ec_siigetbyte(cnt, ssigen + 0x07);
-            ec_slave[cnt].FoEdetails = ec_siigetbyte(cnt, ssigen + 0x08);
-            ec_slave[cnt].EoEdetails = ec_siigetbyte(cnt, ssigen + 0x09);
-            ec_slave[cnt].SoEdetails = ec_siigetbyte(cnt, ssigen + 0x0a);
-            if((ec_siigetbyte(cnt, ssigen + 0x0d) & 0x02) > 0)
+            slaveGroups.assign(ec_slavecount + 1, 1);
+
+            for (size_t g = 0; g < ioGroups.size(); g++)
             {
-                ec_slave[cnt].blockLRW = 1;
-                ec_slave[0].blockLRW++;
+                for (int i = std::max(ioGroups[g].first, 1); i <= ioGroups[g].second && i <= ec_slavecount; i++)
+                    slaveGroups[i] = static_cast<uint8_t>(g + 2);
             }
-            ec_slave[cnt].Ebuscurrent = ec_siigetbyte(cnt, ssigen + 0x0e);
-            ec_slave[cnt].Ebuscurrent += ec_siigetbyte(cnt, ssigen + 0x0f) << 8;
-            ec_slave[0].Ebuscurrent += ec_slave[cnt].Ebuscurrent;
         }
+
+        IoLayout::Plan before = ioLayout;
+        ioLayout = IoLayout::plan(config, slaveGroups);
+
+        IoLayout::printReport(before, ioLayout);
+    }
+
+    // IOmap выделяется по размеру плана, группы начинаются с границы кэш-линии
+    uint32_t ioMapBytes = IoLayout::capacity(config, ioLayout);
+    std::unique_ptr<uint8_t, decltype(&free)> ioMapBuffer(
+        static_cast<uint8_t*>(aligned_alloc(IoLayout::CACHE_LINE, ioMapBytes)), free);
+    uint8_t *ioMap = ioMapBuffer.get();
+
+    if (ioMap == nullptr)
+    {
+        std::cout << "Can't allocate " << ioMapBytes << " bytes for IOmap" << std::endl;
+        ec_close();
+        return -1;
+    }
+
+    memset(ioMap, 0, ioMapBytes);
+
+    if (ioPlan)
+    {
+        {
+            Trace::Scope span(Trace::Category::STARTUP, "IoLayout::apply");
+            iomapSize = IoLayout::apply(ioLayout, ioMap, ioMapBytes);
+            span.setBytes(iomapSize);
+        }
+
+        if (iomapSize < 0)
+        {
+            std::cout << "IOmap layout doesn't fit " << ioMapBytes << " bytes" << std::endl;
+            ec_close();
+            return -1;
+        }
+
+        IoLayout::Plan measured = IoLayout::measure(ioLayout);
+
+        std::cout << "Mapped: " << measured.datagrams << " datagram(s), " << measured.wireBytes
+                  << " bytes on the wire per cycle" << std::endl;
+    }
+    else
+    {
+        // Включает хуки PreOP -> SafeOP с разметкой PDO
+        Trace::Scope span(Trace::Category::STARTUP, "ec_config_map");
+        iomapSize = ec_config_map(ioMap);
+        span.setBytes(iomapSize);
+    }
+
+    if (iomapSize > static_cast<int>(ioMapBytes))
+    {
+        std::cout << "IOmap overflow: " << iomapSize << " of " << ioMapBytes << " bytes" << std::endl;
+        ec_close();
+        return -1;
+    }
+
+    // Смещения и FMMU из конфигурации описывают раскладку ec_config_map, план их меняет
+    if (configPath != nullptr && !ioPlan && NetworkConfig::verifyMapping(config, ioMap) != 0)
+    {
+        std::cout << "IOmap doesn't match " << configPath << std::endl;
+        ec_close();
+        return -1;
+    }
+
+    {
+        Trace::Scope span(Trace::Category::STARTUP, "ec_configdc");
+        ec_configdc();
+    }
+
+    {
+        Trace::Scope span(Trace::Category::STATE, "State check", 0, EC_STATE_SAFE_OP);
+        span.setResult(ec_statecheck(0, EC_STATE_SAFE_OP, EC_TIMEOUTSTATE));
+    }
+
+    // SII details уже взяты из конфигурации
+    if (configPath == nullptr)
+    {
+        std::vector<SiiReader::Info> sii;
+        Trace::Scope span(Trace::Category::STARTUP, "SII read");
+        SiiReader::ReadStats siiStats = SiiReader::readAll(siiCacheDir, sii, startupThreads);
+        span.setBytes(siiStats.eepromBytes);
+
+        for (int i = 1; i <= ec_slavecount; i++)
+            SiiReader::apply(static_cast<uint16_t>(i), sii[i]);
+
+        std::cout << "SII read for " << siiStats.slaves << " slave(s): " << siiStats.fromCache << " from cache, "
+                  << siiStats.eepromBytes << " EEPROM bytes in " << siiStats.seconds << " s";
+        if (siiStats.failed)
+            std::cout << " (" << siiStats.failed << " failed)";
+        std::cout << std::endl;
     }
 
 
@@ -807,19 +1349,44 @@ int main()
 
     std::cout << "All slaves are in SAFE OP state" << std::endl;
 
+    if (dumpConfigPath != nullptr)
+    {
+        NetworkConfig::Config dump;
+
+        NetworkConfig::capture(dump, ioMap, iomapSize);
+
+        if (NetworkConfig::save(dumpConfigPath, dump) > 0)
+            std::cout << "Config dumped to " << dumpConfigPath << std::endl;
+    }
+
     rxPdoData_t *rxPdoData = (rxPdoData_t*)ec_slave[1].inputs;
     txPdoData_t *txPdoData = (txPdoData_t*)ec_slave[1].outputs;
 
+    if (rtMode != RtGuard::Mode::OFF)
+    {
+        // Вся память блокируется и подгружается до OP, дальнейшие mmap (shm) блокируются сразу
+        if (RtGuard::prepare(512 * 1024, 8 * 1024 * 1024) != 0)
+            std::cout << "Can't lock memory for RT mode (mlockall), faults will be reported" << std::endl;
+
+        RtGuard::setMode(rtMode);
+    }
+
+    if (dcSync)
+        CycleTiming::applyDcShift(cycleConfig);
+
     std::cout << "Set slaves to OP state..." << std::endl;
 
     // Перед переводом в OP режим надо отправить пакет
-    ec_send_processdata();
-    ec_receive_processdata(EC_TIMEOUTRET);
+    IoLayout::send(ioLayout);
+    IoLayout::receive(ioLayout, EC_TIMEOUTRET);
 
     ec_slave[0].state = EC_STATE_OPERATIONAL;
 
-    ec_writestate(0);
-    ec_statecheck(0, EC_STATE_OPERATIONAL, EC_TIMEOUTSTATE);
+    {
+        Trace::Scope span(Trace::Category::STATE, "State change", 0, EC_STATE_OPERATIONAL);
+        ec_writestate(0);
+        span.setResult(ec_statecheck(0, EC_STATE_OPERATIONAL, EC_TIMEOUTSTATE));
+    }
 
     if (ec_slave[0].state != EC_STATE_OPERATIONAL)
     {
@@ -831,7 +1398,8 @@ int main()
 
     std::cout << "All slaves are in OP state" << std::endl;
 
-    int counter = 0;
+    // Трассировка запуска, дальше она продолжает писаться до SIGUSR2
+    exportTrace(tracePath);
 
     // for (int i = 1; i <= ec_slavecount; i++)
     // {
@@ -841,87 +1409,229 @@ int main()
 
     txPdoData->modesOfOperation = 10;
 
+    ProcessImage::Publisher publisher;
+    ProcessImage::CycleInfo cycleInfo = {};
+
+    if (shmName != nullptr)
+    {
+        std::vector<ProcessImage::SlaveEntry> slaves(ec_slavecount);
+
+        for (int i = 1; i <= ec_slavecount; i++)
+        {
+            slaves[i - 1].outputsOffset = ec_slave[i].outputs ? static_cast<uint32_t>(ec_slave[i].outputs - ioMap) : 0;
+            slaves[i - 1].outputsSize = ec_slave[i].Obytes;
+            slaves[i - 1].inputsOffset = ec_slave[i].inputs ? static_cast<uint32_t>(ec_slave[i].inputs - ioMap) : 0;
+            slaves[i - 1].inputsSize = ec_slave[i].Ibytes;
+        }
+
+        if (publisher.open(shmName, ioMap, iomapSize, slaves.data(), ec_slavecount, 1))
+            std::cout << "Process image published at " << shmName << std::endl;
+        else
+            std::cout << "Can't publish process image at " << shmName << std::endl;
+    }
+
+    cycleInfo.expectedWkc = IoLayout::expectedWkc(ioLayout);
+
+    CommandChannel::Server commandServer;
+    CommandChannel::AxisSetpoint setpoint = ControllerStages::DEFAULT_SETPOINT;
+
+    AxisPipeline axisPipeline;
+    ControllerPipeline::AxisContext axisContext = {};
+
+    SignalStats::Collector signalStats(1, statsWindow);
+
+    axisContext.inputs = rxPdoData;
+    axisContext.outputs = txPdoData;
+    axisContext.setpoint = &setpoint;
+    axisContext.state = CommandStates::RESET_FAULT;
+
+    if (commandChannelName != nullptr)
+    {
+        if (commandServer.open(commandChannelName))
+            std::cout << "Command channel opened at " << commandChannelName << std::endl;
+        else
+            std::cout << "Can't open command channel at " << commandChannelName << std::endl;
+    }
+
+    if (tuneCycle)
+    {
+        std::cout << "Sweeping cycle period at p" << sweepOptions.percentile << "..." << std::endl;
+
+        CycleTiming::SweepResult sweep = CycleTiming::sweep(cycleInfo.expectedWkc, sweepOptions,
+                                                            [&](int timeoutUs)
+                                                            {
+                                                                IoLayout::send(ioLayout);
+                                                                return IoLayout::receive(ioLayout, timeoutUs);
+                                                            },
+                                                            [&]() { axisPipeline.run(axisContext); });
+        CycleTiming::printResult(sweep);
+
+        if (sweep.found)
+            cycleConfig = sweep.config;
+    }
+
+    PdoRemap::Remapper pdoRemapper;
+
+    pdoRemapper.init();
+    EthercatCOE::PDOLayout remapLayout;
+    bool remapReady = false;
+
+    // Данные оси цикл читает через rxPdoData_t/txPdoData_t по фиксированным смещениям
+    EthercatCOE::PDOLayout axisLayout = axisPdoLayout();
+    pdoRemapper.bind(1, axisLayout);
+
+    if (remapConfigPath != nullptr)
+    {
+        // Новая разметка берется из скомпилированной конфигурации, применяется по SIGUSR1
+        NetworkConfig::Config remapConfig;
+
+        if (NetworkConfig::load(remapConfigPath, remapConfig) > 0 && remapSlave >= 1 &&
+            remapSlave <= remapConfig.slaves.size() &&
+            (remapConfig.slaves[remapSlave - 1].flags & NetworkConfig::HAS_PDO_LAYOUT) &&
+            (remapSlave != 1 || PdoRemap::keepsEntries(axisLayout, remapConfig.slaves[remapSlave - 1].pdoLayout)))
+        {
+            remapLayout = remapConfig.slaves[remapSlave - 1].pdoLayout;
+            remapReady = true;
+            signal(SIGUSR1, requestRemap);
+
+            std::cout << "Send SIGUSR1 to remap PDO of slave " << remapSlave << std::endl;
+        }
+        else
+        {
+            std::cout << "No usable PDO layout for slave " << remapSlave << " in " << remapConfigPath
+                      << " (slave 1 must keep the axis objects first)" << std::endl;
+        }
+    }
+
+    Diagnostics::Service diagnostics;
+    CommandStates lastAxisState = axisContext.state;
+
+    diagnostics.start(diagPeriodUs);
+
+    std::cout << "Cycle period " << cycleConfig.periodNs / 1000.0 << " us, receive timeout "
+              << cycleConfig.receiveTimeoutUs << " us" << std::endl;
+
+    ConsoleReports consoleReports;
+    consoleReports.tracePath = tracePath;
+    consoleReports.remapSlave = remapSlave;
+    consoleReports.remapLayout = remapReady ? &remapLayout : nullptr;
+    std::thread consoleThread(printConsoleReports, std::ref(consoleReports), std::cref(signalStats),
+                              std::ref(diagnostics), std::ref(pdoRemapper));
+
+    CycleTiming::CycleClock cycleClock(cycleConfig, missPolicy);
+
+    // Копия нарушений около 10 КБ, поэтому не на стеке цикла
+    static RtGuard::Report rtReport;
+
+    cycleClock.start();
+
     while (true)
     {
+        cycleClock.begin();
+
+        RtGuard::enterCycle(cycleInfo.cycle + 1);
+
         wkc = 0;
 
-        static int cntTest = 0;
-        cntTest += 2;
+        IoLayout::send(ioLayout);
+        commandServer.markSent(CycleTiming::nowNs());
+
+        wkc = IoLayout::receive(ioLayout, cycleConfig.receiveTimeoutUs);
 
-        ec_send_processdata();
-        wkc = ec_receive_processdata(EC_TIMEOUTRET);
+        // ec_DCtime обновляется кадром цикла, следующий дедлайн встает на сетку SYNC0
+        if (dcSync)
+            cycleClock.alignToDc(ec_DCtime);
 
-        counter++;
+        cycleInfo.cycle++;
+        cycleInfo.timestampNs = CycleTiming::nowNs();
+        cycleInfo.wkc = wkc;
+        pdoRemapper.observe(cycleInfo.cycle, wkc, cycleInfo.expectedWkc);
+        diagnostics.setCycle(cycleInfo.cycle);
+        cycleInfo.axisStates[0] = static_cast<uint8_t>(axisContext.state);
+        publisher.publish(cycleInfo);
 
-        if (counter >= 250)
+        // targetTorque еще содержит уставку, ушедшую в этом кадре
+        signalStats.sample(SignalStats::TORQUE_ACTUAL)[0] = rxPdoData->torqueActualValue;
+        signalStats.sample(SignalStats::MODE_DISPLAY)[0] = rxPdoData->modesOfOperationDisplay;
+        signalStats.sample(SignalStats::STATUS_WORD)[0] = rxPdoData->statusWord.data_16;
+        signalStats.sample(SignalStats::FOLLOWING_ERROR)[0] = txPdoData->targetTorque - rxPdoData->torqueActualValue;
+        signalStats.accumulate(cycleInfo.cycle);
+
+        // Окно статистики копируется в очередь, печатает поток вывода
+        if (cycleInfo.cycle % 10000 == 0 && commandServer.stats().count > 0)
         {
-            std::cout << rxPdoData->statusWord.data_16 << " " << (int) rxPdoData->modesOfOperationDisplay << std::endl;
-            counter = 0;
+            consoleReports.commandLatency.push(commandServer.stats());
+            commandServer.resetStats();
         }
 
-        switch(commandState)
+        if (cycleInfo.cycle % 10000 == 0 && axisPipeline.profiledSamples() > 0)
         {
+            PipelineCost cost;
 
-        case CommandStates::RESET_FAULT:
-
-            if(rxPdoData->statusWord.fault)
+            for (size_t i = 0; i < AxisPipeline::STAGE_COUNT; i++)
             {
-                txPdoData->controlWord.data_16 = 0;
-                txPdoData->controlWord.fault_reset = 1;
+                cost.averageNs[i] = axisPipeline.stageAverageNs(i);
+                cost.maxNs[i] = axisPipeline.stageMaxNs(i);
             }
+
+            consoleReports.pipelineCost.push(cost);
+            axisPipeline.resetProfile();
+        }
+
+        // Внешние команды применяются к выходам, которые уйдут следующим кадром
+        commandServer.drain(&setpoint, 1);
+
+        if (cycleClock.takeFault())
+            axisContext.state = CommandStates::FAULT;
+
+        // Опоздавший цикл может не считать выходы: в кадре останутся выходы прошлого цикла
+        if (cycleClock.shouldCompute())
+        {
+            // Стоимость стадий замеряется выборочно, раз в 100 циклов
+            if (cycleInfo.cycle % 100 == 0)
+                axisPipeline.runProfiled(axisContext);
             else
-            {
-                txPdoData->controlWord.data_16 = 0;
-                commandState = CommandStates::SHUTDOWN;
-            }
-            break;
+                axisPipeline.run(axisContext);
+        }
+
+        RtGuard::leaveCycle();
 
-        case CommandStates::SHUTDOWN:
+        if (traceToggleRequested)
+        {
+            traceToggleRequested = 0;
 
-            txPdoData->controlWord.data_16 = 0;
-            txPdoData->controlWord.switch_on = 0;
-            txPdoData->controlWord.enable_voltage = 1;
-            txPdoData->controlWord.quick_stop = 1;
-            if(rxPdoData->statusWord.ready_to_switch_on)
+            // Файл пишет поток вывода: выгрузка ждет интервалы перенастройки и может занять сотни мс
+            if (Trace::enabled())
             {
-                commandState = CommandStates::SWITCH_ON;
+                Trace::setEnabled(false);
+                consoleReports.traceExportRequested.store(true);
             }
-            break;
-
-        case CommandStates::SWITCH_ON:
-
-            txPdoData->controlWord.data_16 = 0;
-            txPdoData->controlWord.switch_on = 1;
-            txPdoData->controlWord.enable_voltage = 1;
-            txPdoData->controlWord.quick_stop = 1;
-            if(rxPdoData->statusWord.switched_on)
+            else
             {
-                commandState = CommandStates::OP;
+                Trace::setEnabled(true);
+                consoleReports.traceResumed.store(true);
             }
-            break;
+        }
 
-        case CommandStates::OP:
-        {
-            txPdoData->controlWord.data_16 = 0;
-            txPdoData->controlWord.switch_on = 1;
-            txPdoData->controlWord.enable_voltage = 1;
-            txPdoData->controlWord.quick_stop = 1;
-            txPdoData->controlWord.enable_operation = 1;
+        // Диагностику к отказу прикладывает поток вывода
+        if (axisContext.state == CommandStates::FAULT && lastAxisState != CommandStates::FAULT)
+            consoleReports.axisFaults.push({cycleInfo.cycle, rxPdoData->statusWord.data_16});
 
-            txPdoData->modesOfOperation = 10;
-            txPdoData->targetTorque = 100 * sin(2 * M_PI * cntTest / 10000);
+        lastAxisState = axisContext.state;
 
-            break;
-        }
-        case CommandStates::FAULT:
-            txPdoData->controlWord.data_16 = 0;
+        if (cycleInfo.cycle % 10000 == 0 && RtGuard::collect(rtReport) > 0)
+            consoleReports.rtViolations.push(rtReport);
 
-            break;
-        }
+        if (cycleInfo.cycle % 10000 == 0 && cycleClock.counters().maxConsecutive > 0)
+            consoleReports.deadlineMisses.push(cycleClock.counters());
 
-        usleep(1000);
+        // Дедлайн абсолютный, время работы цикла не сдвигает следующий кадр
+        cycleClock.end();
     }
 
+    consoleReports.running.store(false);
+    consoleThread.join();
+
     ec_close();
 
     return 0;